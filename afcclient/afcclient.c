@@ -39,14 +39,30 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "libidev.h"
+#include "afcxfer.h"
+#include "afcpool.h"
+#include "afcentry.h"
+#include "afcwalk.h"
+#include "afcxml.h"
+#include "afcout.h"
+#include "afclocal.h"
+#include "afcpipe.h"
+#include "afcresume.h"
+#include "afcmanifest.h"
+#include "afcscan.h"
+#include "afcsegment.h"
+#include "afchash.h"
+#include "afcverify.h"
+#include "afctar.h"
+#include "afczst.h"
+#include "afcstore.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#define CHUNKSZ 8192
-
 #pragma mark - AFC Implementation Utility Functions
 
 char *progname;
@@ -59,6 +75,24 @@ bool fs; //output only apps that have file sharing capabilities
 char *udid;
 bool appMode;
 bool quiet;
+int jobCount; // number of afc connections/workers used for clone and recursive listings (-j)
+bool namesOnly; // -1, list paths without stat'ing every entry
+unsigned int statColumns; // --stat, with -1 the AFC_ENTRY_HAS_* columns that are stat'ed and written after the path
+bool incremental; // --incremental, clone only what changed since the last --incremental clone
+bool syncDelete; // --delete, sync-up removes remote files that are not in the local folder
+bool syncDeleteRoot; // --delete-root, --delete even when the remote path is the top-level folder
+bool resumeTransfers; // --resume, continue partial downloads instead of starting over
+bool verifyTransfers; // --verify, hash get/put/clone in flight and read a sample of the target back
+afc_hash_algo_t hashAlgo; // --hash, the digest for sum and --verify
+char *tarPath; // --tar, clone into one tar stream (a file or - for stdout) instead of a folder
+int compressLevel; // --compress=zstd[:level], 0 when off
+int compressThreads; // --compress-threads, 0 is one per cpu
+bool compressIndex; // --compress-index, a seek table at the end of every .zst
+afc_zst_pool_t *compressPool; // set while a clone --compress runs, downloads then write <file>.zst
+char *storePath; // --store, clone into a content addressed store and hardlink the tree to it
+afc_store_t *cloneStore; // set while a clone --store runs
+char *linkDest; // --link-dest, hardlink files unchanged since this earlier clone instead of copying them
+afc_out_format_t outputFormat; // --format, ndjson/tsv/bplist records instead of ls style text or -x XML
 int _relativeYear;
 char * AFVersionNumber = "1.0.1";
 
@@ -152,38 +186,54 @@ void epochToTime(long epoch, char* s) {
  
  */
 
+plist_t afc_entry_plist(const afc_entry_t *entry) {
+    char s[100];
+    plist_t currentDevicePlist = plist_new_dict();
+    plist_dict_set_item(currentDevicePlist, "path", plist_new_string(entry->path));
+    // only the keys the device sent, like the plain afc_get_file_info reply
+    if (entry->has & AFC_ENTRY_HAS_SIZE) {
+        snprintf(s, sizeof(s), "%llu", (unsigned long long)entry->size);
+        plist_dict_set_item(currentDevicePlist, "st_size", plist_new_string(s));
+    }
+    if (entry->has & AFC_ENTRY_HAS_BLOCKS) {
+        snprintf(s, sizeof(s), "%llu", (unsigned long long)entry->blocks);
+        plist_dict_set_item(currentDevicePlist, "st_blocks", plist_new_string(s));
+    }
+    if (entry->has & AFC_ENTRY_HAS_NLINK) {
+        snprintf(s, sizeof(s), "%llu", (unsigned long long)entry->nlink);
+        plist_dict_set_item(currentDevicePlist, "st_nlink", plist_new_string(s));
+    }
+    if (afc_entry_type_name(entry->type)) {
+        plist_dict_set_item(currentDevicePlist, "st_ifmt", plist_new_string(afc_entry_type_name(entry->type)));
+    }
+    if (entry->has & AFC_ENTRY_HAS_MTIME) {
+        epochToTime((long)entry->mtime, s);
+        plist_dict_set_item(currentDevicePlist, "st_mtime", plist_new_string(s));
+    }
+    if (entry->has & AFC_ENTRY_HAS_BIRTHTIME) {
+        epochToTime((long)entry->birthtime, s);
+        plist_dict_set_item(currentDevicePlist, "st_birthtime", plist_new_string(s));
+    }
+    if (entry->link) {
+        plist_dict_set_item(currentDevicePlist, "LinkTarget", plist_new_string(entry->link));
+    }
+    return currentDevicePlist;
+}
+
 plist_t * afc_file_info_for_path(afc_client_t afc, const char *path) {
     
-    int i, ret=EXIT_FAILURE;
-    char **infolist=NULL;
-    plist_t currentDevicePlist = plist_new_dict();
-    afc_error_t err = afc_get_file_info(afc, path, &infolist);
-    
-    if (err == AFC_E_SUCCESS && infolist) {
-        plist_dict_set_item(currentDevicePlist, "path", plist_new_string(path));
-        int arraySize = 0;
-        for(i=0; infolist[i]; i++) {
-            arraySize++;
-        }
-        for(i=0; infolist[i]; i++) {
-            if (i+1 < arraySize && (i % 2 == 0)) {
-                if (strcmp("st_birthtime", infolist[i])== 0 || strcmp("st_mtime", infolist[i]) == 0) {
-                    char s[100];
-                    epochToTime(atol(infolist[i+1]),s);
-                    plist_dict_set_item(currentDevicePlist, infolist[i], plist_new_string(s));
-                } else {
-                    plist_dict_set_item(currentDevicePlist, infolist[i], plist_new_string(infolist[i+1]));
-                }
-            }
-        }
-        // printf("\t%s\n %i", path, i);
-        ret=EXIT_SUCCESS;
-        
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    plist_t currentDevicePlist = NULL;
+    afc_error_t err = afc_entry_stat(afc, &arena, path, &entry);
+    
+    if (err == AFC_E_SUCCESS) {
+        currentDevicePlist = afc_entry_plist(&entry);
     } else {
         fprintf(stderr, "Error: info error for path: %s - %s\n", path, idev_afc_strerror(err));
+        currentDevicePlist = plist_new_dict();
     }
-    if (infolist)
-        idevice_device_list_free(infolist);
+    afc_arena_free(&arena);
     
     return currentDevicePlist;
     
@@ -196,87 +246,27 @@ plist_t * afc_file_info_for_path(afc_client_t afc, const char *path) {
  */
 
 plist_t * afc_list_path(afc_client_t afc, const char *path, int8_t recursive) {
-    int ret=EXIT_FAILURE;
-    char **list=NULL;
     plist_t fileList = plist_new_array();
-    if (idev_verbose)
-        fprintf(stderr, "[debug] reading afc directory contents at \"%s\"\n", path);
+    afc_tree_t tree;
+    size_t i;
     
-    afc_error_t err = afc_read_directory(afc, path, &list);
+    // the walk fans out over jobCount connections, entries come back sorted by path
+    afc_error_t err = afc_walk(afc, path, (recursive) ? AFC_WALK_RECURSIVE | AFC_WALK_DIRS : 0, jobCount, &tree);
     
-    if (err == AFC_E_SUCCESS && list) {
-        int i;
-        if (idev_verbose){
-            printf("AFC Device Listing path=\"%s\":\n", path);
-        }
-        for (i=0; list[i]; i++) {
-            char tpath[PATH_MAX], *lpath;
-            if (!strcmp(path, "")) {
-                lpath=list[i];
-            } else {
-                if (path[strlen(path)-1]=='/') {
-                    snprintf(tpath, PATH_MAX-1, "%s%s", path, list[i]);
-                } else {
-                    snprintf(tpath, PATH_MAX-1, "%s/%s", path, list[i]);
-                }
-                lpath = tpath;
-            }
-            if (strcmp(list[i], ".") != 0 && strcmp(list[i], "..") != 0) {
-                plist_t *fileInfo = afc_file_info_for_path(afc, lpath);
-                
-                //if is a directory recurse into it
-                plist_t fmt_node = plist_dict_get_item(fileInfo, "st_ifmt");
-                char *fmt = NULL;
-                plist_get_string_val(fmt_node, &fmt);
-                
-                if ((strcmp(fmt, "S_IFDIR") == 0) && (recursive == true)){
-                    plist_t infoCopy = plist_copy(fileInfo);
-                    plist_array_append_item(fileList, infoCopy);
-                    if (idev_verbose){
-                        printf("%s folder, recurse!!\n", lpath);
-                    }
-                    plist_t *dirInfo = afc_list_path(afc, lpath, true);
-                    //          printf("lpath: %s\n", lpath);
-                    uint32_t arrayCount = plist_array_get_size(dirInfo);
-                    int j;
-                    for (j = 0; j < arrayCount; j++){
-                        //  printf("j: %i\n", j);
-                        plist_t arrayItem = NULL;
-                        arrayItem = plist_array_get_item(dirInfo, j);
-                        if (arrayItem != NULL) {
-                            //need to make a copy of the item for some reason... things just disappear otherwise
-                            plist_t itemCopy = plist_copy(arrayItem);
-                            plist_array_append_item(fileList, itemCopy);
-                        }
-                    }
-                    
-                } else if (strcmp(fmt, "S_IFREG") == 0) { //not a directory, just a file
-                    if (idev_verbose){
-                        printf("%s file, treat normally!!\n", lpath);
-                    }
-                    plist_array_append_item(fileList, fileInfo);
-                } else if (strcmp(fmt, "S_IFLNK") == 0) {
-                    if (idev_verbose){
-                        printf("%s symbolic link, treat normally!!\n", lpath);
-                    }
-                    plist_array_append_item(fileList, fileInfo);
-                }
-            }
+    if (err == AFC_E_SUCCESS) {
+        for (i = 0; i < tree.count; i++) {
+            plist_array_append_item(fileList, afc_entry_plist(&tree.entries[i]));
         }
-        
-        ret=EXIT_SUCCESS;
     } else if (err == AFC_E_READ_ERROR) { // fall-back to doing a file info request, incase its a file
         if (idev_verbose)
             fprintf(stderr, "[debug] directory read error -- falling back to file info at %s\n", path);
         
-        ret = dump_afc_file_info(afc, path);
+        dump_afc_file_info(afc, path);
     } else {
         fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", path, idev_afc_strerror(err));
     }
     
-    if (list)
-        free(list);
-    
+    afc_tree_free(&tree);
     
     return fileList;
 }
@@ -292,6 +282,76 @@ plist_t * afc_list_path(afc_client_t afc, const char *path, int8_t recursive) {
  l     1            11    Mar 14 05:24    etc -> private/etc
  
  */
+int print_afc_entry(const afc_entry_t *entry) {
+    char displayString[PATH_MAX];
+    char type = '\0';
+    char time[100];
+    switch (entry->type) {
+        case AFC_ENTRY_FILE:
+            type = 'f';
+            break;
+        case AFC_ENTRY_DIR:
+            type = 'd';
+            break;
+        case AFC_ENTRY_LINK:
+            type = 'l';
+            break;
+        case AFC_ENTRY_UNKNOWN:
+            return EXIT_FAILURE;
+        default:
+            break;
+    }
+    epochToTime((long)entry->mtime, time);
+    
+    if (entry->type == AFC_ENTRY_LINK){
+        snprintf(displayString, PATH_MAX-1, "%c %5llu\t%10llu\t%s\t%s -> %s", type, (unsigned long long)entry->nlink, (unsigned long long)entry->size, time, entry->path, entry->link);
+    } else {
+        snprintf(displayString, PATH_MAX-1, "%c %5llu\t%10llu\t%s\t%s", type, (unsigned long long)entry->nlink, (unsigned long long)entry->size, time, entry->path);
+    }
+    printf("%s\n", displayString);
+    return EXIT_SUCCESS;
+}
+
+/*
+ 
+ ls -1 --stat=size,mtime: the path and then just the columns asked for, tab separated.
+ times are formatted like the long listing, the rest is the raw number.
+ 
+ */
+
+static void print_afc_columns(const afc_entry_t *entry) {
+    char time[100];
+    
+    printf("%s", entry->path);
+    if (statColumns & AFC_ENTRY_HAS_TYPE)
+        printf("\t%s", (afc_entry_type_name(entry->type)) ? afc_entry_type_name(entry->type) : "-");
+    if (statColumns & AFC_ENTRY_HAS_SIZE)
+        printf("\t%llu", (unsigned long long)entry->size);
+    if (statColumns & AFC_ENTRY_HAS_BLOCKS)
+        printf("\t%llu", (unsigned long long)entry->blocks);
+    if (statColumns & AFC_ENTRY_HAS_NLINK)
+        printf("\t%llu", (unsigned long long)entry->nlink);
+    if (statColumns & AFC_ENTRY_HAS_MTIME) {
+        epochToTime((long)entry->mtime, time);
+        printf("\t%s", time);
+    }
+    if (statColumns & AFC_ENTRY_HAS_BIRTHTIME) {
+        epochToTime((long)entry->birthtime, time);
+        printf("\t%s", time);
+    }
+    if (statColumns & AFC_ENTRY_HAS_LINK)
+        printf("\t%s", (entry->link) ? entry->link : "");
+    printf("\n");
+}
+
+// -1 on its own is just the path
+static void print_afc_name(const afc_entry_t *entry) {
+    if (statColumns)
+        print_afc_columns(entry);
+    else
+        printf("%s\n", entry->path);
+}
+
 int dump_afc_file_info(afc_client_t afc, const char *path) {
     //return dump_afc_file_info_old(afc, path);
     int ret=EXIT_FAILURE;
@@ -300,66 +360,186 @@ int dump_afc_file_info(afc_client_t afc, const char *path) {
     }
     
     if (xml) {
-        plist_t *documentList = afc_list_path(afc, path, recursiveList);
-        char *xmlData = NULL;
-        uint32_t length = 0;
-        plist_to_xml(documentList, &xmlData, &length);
-        printf("%s", xmlData);
-        return 0;
-        //fprintf(outf, "%s\n", xmlData);
-    }
-    
-    plist_t *node = afc_file_info_for_path(afc, path);
-    if (node){
-        char displayString[PATH_MAX];
-        char type = '\0';
-        char *fmt = NULL;
-        char *link = NULL;
-        char *size = NULL;
-        char *time = NULL;
-        char *lt = NULL;
-        bool isLink = false;
-        bool isDirectory = false;
-        plist_get_string_val(plist_dict_get_item(node, "st_ifmt"), &fmt);
-        if (fmt){
-            if (strcmp(fmt, "S_IFREG") == 0){
-                type = 'f';
-            } else if (strcmp(fmt,"S_IFDIR") == 0) {
-                type = 'd';
-                isDirectory = true;
-            } else if (strcmp(fmt,"S_IFLNK") == 0) {
-                isLink = true;
-                type = 'l';
-            }
-        } else {
-            return ret;
-        }
-        plist_get_string_val(plist_dict_get_item(node, "st_nlink"), &link);
-        plist_get_string_val(plist_dict_get_item(node, "st_size"), &size);
-        long longsize = atol(size);
-        long longlink = atol(link);
-        plist_get_string_val(plist_dict_get_item(node, "st_mtime"), &time);
-        
-        if (isLink){
-            plist_get_string_val(plist_dict_get_item(node, "LinkTarget"), &lt);
-            snprintf(displayString, PATH_MAX-1, "%c %5ld\t%10ld\t%s\t%s -> %s", type, longlink, longsize, time, path, lt);
+        return xml_afc_path(afc, path, recursiveList, stdout);
+    }
+    
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    afc_error_t err = afc_entry_stat(afc, &arena, path, &entry);
+    if (err == AFC_E_SUCCESS){
+        if (namesOnly) {
+            print_afc_name(&entry);
+            ret = EXIT_SUCCESS;
         } else {
-            snprintf(displayString, PATH_MAX-1, "%c %5ld\t%10ld\t%s\t%s", type, longlink, longsize, time, path);
+            ret = print_afc_entry(&entry);
         }
-        printf("%s\n", displayString);
-        if (isDirectory && recursiveList){
+        if (ret == EXIT_SUCCESS && entry.type == AFC_ENTRY_DIR && recursiveList){
             dump_afc_list_path(afc, path);
         }
-        ret=EXIT_SUCCESS;
     } else {
-        //fprintf(stderr, "Error: info error for path: %s - %s\n", path, idev_afc_strerror(err));
+        fprintf(stderr, "Error: info error for path: %s - %s\n", path, idev_afc_strerror(err));
+    }
+    afc_arena_free(&arena);
+    return ret;
+}
+
+/*
+ 
+ walker flags for a listing. -1 only wants the names, so nothing is stat'ed unless -R
+ has to find the folders to descend into, or --stat asks for columns.
+ 
+ */
+
+static int listing_walk_flags(int flags) {
+    if (namesOnly && !statColumns)
+        flags |= AFC_WALK_NAMES;
+    return flags;
+}
+
+/*
+ 
+ -x listings and documents, written out one <dict> at a time as afc_walk_each hands
+ the entries over. same bytes for any -j.
+ 
+ */
+
+static void xml_afc_entry(const afc_entry_t *entry, void *ctx) {
+    char mtime[100], birthtime[100];
+    afc_entry_t shown = *entry;
+    if (namesOnly && !statColumns) {
+        afc_xml_name(ctx, entry->path);
+        return;
+    }
+    // -1 --stat, the dict gets only the columns asked for
+    if (namesOnly) {
+        shown.has &= statColumns;
+        if (!(statColumns & AFC_ENTRY_HAS_TYPE))
+            shown.type = AFC_ENTRY_UNKNOWN;
+        if (!(statColumns & AFC_ENTRY_HAS_LINK))
+            shown.link = NULL;
+    }
+    epochToTime((long)entry->mtime, mtime);
+    epochToTime((long)entry->birthtime, birthtime);
+    afc_xml_entry(ctx, &shown, mtime, birthtime);
+}
+
+int xml_afc_path(afc_client_t afc, const char *path, int8_t recursive, FILE *outf) {
+    afc_xml_t out;
+    afc_error_t err;
+    
+    afc_xml_begin(&out, outf);
+    err = afc_walk_each(afc, path, listing_walk_flags((recursive) ? AFC_WALK_RECURSIVE | AFC_WALK_DIRS : 0), jobCount, xml_afc_entry, &out);
+    afc_xml_end(&out);
+    
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ 
+ ls -R and ls -1, printed in path order. with -j 1 lines go out while the walk runs,
+ otherwise the whole tree comes from one parallel walk first.
+ 
+ */
+
+static void print_afc_walk_entry(const afc_entry_t *entry, void *ctx) {
+    (void)ctx;
+    if (strstr(entry->path, "/..") || strstr(entry->path, "/.")){
+        return;
+    }
+    if (namesOnly)
+        print_afc_name(entry);
+    else
+        print_afc_entry(entry);
+}
+
+int dump_afc_walk_path(afc_client_t afc, const char *path) {
+    int flags = listing_walk_flags((recursiveList) ? AFC_WALK_RECURSIVE | AFC_WALK_DIRS : 0);
+    afc_error_t err = afc_walk_each(afc, path, flags, jobCount, print_afc_walk_entry, NULL);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ 
+ --format=ndjson|tsv|bplist for ls, info and documents: one record per entry with raw values,
+ written as the walk hands the entries over. ls lists what is in a folder, info the path
+ itself and, with -R, everything below it. with -j N the records come straight from all the
+ walk connections in the order they are stat'ed, nothing waits for the whole tree to be sorted.
+ 
+ */
+
+static void record_afc_entry(const afc_entry_t *entry, void *ctx) {
+    if (namesOnly && statColumns)
+        afc_out_columns(ctx, entry, statColumns);
+    else if (namesOnly)
+        afc_out_name(ctx, entry->path);
+    else
+        afc_out_entry(ctx, entry);
+}
+
+typedef struct record_stream_t {
+    afc_out_t *out;
+    pthread_mutex_t lock;       // the walk connections write records side by side
+} record_stream_t;
+
+static void record_afc_stream_entry(const afc_entry_t *entry, void *ctx) {
+    record_stream_t *stream = ctx;
+    pthread_mutex_lock(&stream->lock);
+    record_afc_entry(entry, stream->out);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+int record_afc_list_path(afc_client_t afc, const char *path, int8_t recursive, afc_out_t *out) {
+    int flags = listing_walk_flags(AFC_WALK_DIRS | ((recursive) ? AFC_WALK_RECURSIVE : 0));
+    afc_error_t err;
+    if (jobCount > 1) {
+        record_stream_t stream = { .out = out };
+        pthread_mutex_init(&stream.lock, NULL);
+        err = afc_walk_stream(afc, path, flags, jobCount, record_afc_stream_entry, &stream);
+        pthread_mutex_destroy(&stream.lock);
+    } else {
+        err = afc_walk_ordered(afc, path, flags, record_afc_entry, out);
+    }
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int record_afc_file_info(afc_client_t afc, const char *path, afc_out_t *out) {
+    int ret=EXIT_FAILURE;
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    afc_error_t err = afc_entry_stat(afc, &arena, path, &entry);
+    if (err == AFC_E_SUCCESS) {
+        record_afc_entry(&entry, out);
+        ret = EXIT_SUCCESS;
+        if (entry.type == AFC_ENTRY_DIR && recursiveList) {
+            ret = record_afc_list_path(afc, path, true, out);
+        }
+    } else {
+        fprintf(stderr, "Error: info error for path: %s - %s\n", path, idev_afc_strerror(err));
     }
+    afc_arena_free(&arena);
     return ret;
 }
 
 int dump_afc_list_path(afc_client_t afc, const char *path) {
     int ret=EXIT_FAILURE;
     char **list=NULL;
+    if (xml)
+        return xml_afc_path(afc, path, recursiveList, stdout);
+    if (recursiveList || namesOnly)
+        return dump_afc_walk_path(afc, path);
+    
     if (idev_verbose)
         fprintf(stderr, "[debug] reading afc directory contents at \"%s\"\n", path);
     
@@ -410,12 +590,15 @@ int dump_afc_path(afc_client_t afc, const char *path, FILE *outf) {
     afc_error_t err = afc_file_open(afc, path, AFC_FOPEN_RDONLY, &handle);
     
     if (err == AFC_E_SUCCESS) {
-        char buf[CHUNKSZ];
+        afc_xfer_t xfer;
         uint32_t bytes_read=0;
         
-        while((err=afc_file_read(afc, handle, buf, CHUNKSZ, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
-            fwrite(buf, 1, bytes_read, outf);
+        afc_xfer_init(&xfer, 0);
+        while((err=afc_xfer_read(afc, handle, &xfer, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
+            fwrite(xfer.buf, 1, bytes_read, outf);
         }
+        afc_xfer_report(&xfer, path);
+        afc_xfer_free(&xfer);
         
         if (err)
             fprintf(stderr, "Error: Encountered error while reading %s: %s\n", path, idev_afc_strerror(err));
@@ -430,32 +613,328 @@ int dump_afc_path(afc_client_t afc, const char *path, FILE *outf) {
 }
 
 /*
- i think text files writing in binary will not be okay,
- but windows fopen defaults to text, so files get corrupt
- so this gets called every time we use fopen, make
- sure our plist files can get read back and forth without
- trouble.
  
- right now only focusing on plist, doubt it should matter with anything else.
+ the download loop behind get, clone and export. entry is the listing entry when the
+ caller already has one, NULL otherwise, in which case the file is only stat'ed when a
+ progress bar or --resume needs it. a known size preallocates the local file and lets a
+ small file come over in one read. openErr gets the afc_file_open result for get's return value.
  
  */
 
-char * write_mode_for_file(char *filename) {
-    char* ret = "w";
-#if defined(_WIN32)
-    char* ext;
-    ext = strrchr(filename,'.');
-    printf("%s extension: %s\n", filename, ext);
-    if (strcmp(".plist", ext) == 0 || strcmp(".PLIST", ext) == 0)
-    {
-        ret = "w";
+typedef struct transfer_progress_t {
+    const char *name;
+    off_t fsize;
+} transfer_progress_t;
+
+static void transfer_progress(uint64_t done, void *ctx) {
+    transfer_progress_t *progress = ctx;
+    loadBar((off_t)done, progress->fsize, 50, progress->name);
+}
+
+/*
+ 
+ --resume, picks dst up where an earlier run left it when the sidecar says it was cut from
+ this same remote file and its last block still matches, anything else starts over at 0.
+ the afc handle is left where the copy goes on.
+ 
+ */
+
+static int resume_local_file(afc_client_t afc, uint64_t handle, const char *dst, uint64_t size, uint64_t mtime, afc_local_t *local) {
+    uint64_t partSize = 0, partMtime = 0;
+    bool keep = (afc_resume_load(dst, &partSize, &partMtime) == EXIT_SUCCESS && partSize == size && partMtime == mtime);
+    
+    if (afc_local_append(local, dst, size) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    
+    if (local->offset > size)
+        keep = false;
+    if (keep && local->offset > 0) {
+        bool match = false;
+        keep = (afc_resume_check_tail(afc, handle, local, local->offset, &match) == AFC_E_SUCCESS && match);
+    }
+    
+    if (!keep && local->offset > 0) {
+        if (idev_verbose)
+            fprintf(stderr, "[debug] %s does not match %llu bytes of the remote file, starting over\n", dst, (unsigned long long)local->offset);
+        if (afc_local_truncate(local, 0) != EXIT_SUCCESS || afc_file_seek(afc, handle, 0, SEEK_SET) != AFC_E_SUCCESS) {
+            int saved = errno;
+            afc_local_close(local);
+            errno = saved;
+            return EXIT_FAILURE;
+        }
+    }
+    
+    // written before any data, an interrupted run has to leave it behind
+    if (afc_resume_save(dst, size, mtime) != EXIT_SUCCESS)
+        fprintf(stderr, "Warning: could not write %s%s, %s can't be resumed\n", dst, AFC_RESUME_SUFFIX, dst);
+    if (local->offset > 0)
+        printf("Resuming %s at %llu of %llu bytes\n", dst, (unsigned long long)local->offset, (unsigned long long)size);
+    return EXIT_SUCCESS;
+}
+
+/*
+ 
+ --verify, once a transfer between remote and the local file local is complete and closed.
+ the digest inflight picked up on the way has to match the local file hashed again now, so
+ what is on disk is every byte that went over afc. segmented and resumed transfers did not
+ go through the hash in one piece, they only have the local digest. either way the device
+ side is only sampled, see afcverify.h, reading all of it back would be a second transfer.
+ digest, when not NULL, gets the hex digest of a file that passed.
+ 
+ */
+
+static int verify_transfer(afc_client_t afc, const char *remote, const char *local, bool upload, afc_hash_t *inflight, char *digest) {
+    char hex[AFC_HASH_HEX_SIZE];
+    char sent[AFC_HASH_HEX_SIZE];
+    bool match = false;
+    uint64_t where = 0;
+    int localErr = 0;
+    
+    if (afc_hash_file(local, hashAlgo, hex, NULL) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: could not hash %s: %s\n", local, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (inflight) {
+        afc_hash_final(inflight, sent);
+        if (strcmp(sent, hex) != 0) {
+            fprintf(stderr, "Error: verify failed, %s is %s %s but %s %s went over afc\n", local, afc_hash_name(hashAlgo), hex, afc_hash_name(hashAlgo), sent);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    afc_error_t err = afc_verify_sample(afc, remote, local, &match, &where, &localErr);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: reading %s back failed: %s\n", remote, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    if (localErr) {
+        fprintf(stderr, "Error: reading %s back failed: %s\n", local, strerror(localErr));
+        return EXIT_FAILURE;
+    }
+    if (!match) {
+        fprintf(stderr, "Error: verify failed, %s and %s differ at byte %llu\n", local, remote, (unsigned long long)where);
+        return EXIT_FAILURE;
+    }
+    
+    printf("Verified %s, %s %s%s, device side sampled\n", (upload) ? remote : local, afc_hash_name(hashAlgo), hex, (inflight) ? " in flight and on disk" : "");
+    if (digest)
+        memcpy(digest, hex, AFC_HASH_HEX_SIZE);
+    return EXIT_SUCCESS;
+}
+
+int download_afc_file(afc_client_t afc, const char *src, const char *dst, const afc_entry_t *entry, bool progress, int connections, afc_error_t *openErr, char *digest) {
+    int ret=EXIT_FAILURE;
+    uint64_t handle=0;
+    
+    afc_error_t err = afc_file_open(afc, src, AFC_FOPEN_RDONLY, &handle);
+    if (openErr)
+        *openErr = err;
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc open file %s failed: %s\n", src, idev_afc_strerror(err));
+        return ret;
+    }
+    
+    progress = progress && !quiet;
+    bool known = (entry != NULL);
+    uint64_t size = (entry) ? entry->size : 0;
+    uint64_t mtime = (entry) ? entry->mtime : 0;
+    if (!known && (progress || resumeTransfers || connections > 1)) {
+        afc_arena_t arena = { NULL };
+        afc_entry_t statted;
+        if (afc_entry_stat(afc, &arena, src, &statted) == AFC_E_SUCCESS) {
+            known = true;
+            size = statted.size;
+            mtime = statted.mtime;
+        }
+        afc_arena_free(&arena);
+    }
+    
+    afc_local_t local;
+    afc_hash_t hash;
+    afc_hash_t *inflight = NULL;
+    int opened = (resumeTransfers && known) ? resume_local_file(afc, handle, dst, size, mtime, &local) : afc_local_create(&local, dst, (compressPool) ? 0 : size);
+    if (opened == EXIT_SUCCESS && compressPool && afc_local_compress(&local, compressPool) != EXIT_SUCCESS) {
+        afc_local_close(&local);
+        opened = EXIT_FAILURE;
+    }
+    if (opened == EXIT_SUCCESS) {
+        afc_xfer_t xfer;
+        int writeErr = 0;
+        bool writeFailed = false;
+        transfer_progress_t bar = { strrchr(dst, '/'), (off_t)size };
+        bar.name = (bar.name) ? bar.name + 1 : dst;
+        
+        int used = 0;
+        double seconds = 0;
+        
+        // a big file is read in ranges over several connections, --resume and --compress need it front to back
+        if (!resumeTransfers && !compressPool && known && afc_segment_count(size, connections) > 1) {
+            err = afc_segment_download(src, &local, size, connections, (progress) ? transfer_progress : NULL, &bar, &writeErr, &used, &seconds);
+            if (used == 0)
+                fprintf(stderr, "Warning: could not open any extra afc connections, reading %s over one\n", src);
+        }
+        if (used == 0) {
+            // afc reads on this thread, local writes on another one (--io-buffers)
+            // the mode comes from what is left, expected and offset are both absolute
+            afc_xfer_init(&xfer, size - local.offset);
+            xfer.expected = size;
+            xfer.offset = local.offset;
+            if (verifyTransfers && local.offset == 0) {
+                afc_hash_init(&hash, hashAlgo);
+                inflight = &hash;
+            }
+            xfer.hash = inflight;
+            err = afc_pipe_copy(afc, handle, &xfer, &local, (progress && size > 0) ? transfer_progress : NULL, &bar, &writeErr);
+            afc_xfer_report(&xfer, src);
+            afc_xfer_free(&xfer);
+        }
+        if (writeErr) {
+            fprintf(stderr, "Error: writing %s failed: %s\n", dst, strerror(writeErr));
+            writeFailed = true;
+        }
+        if (afc_local_close(&local) != EXIT_SUCCESS && !writeFailed) {
+            fprintf(stderr, "Error: writing %s failed: %s\n", dst, strerror(errno));
+            writeFailed = true;
+        }
+        if (err) {
+            fprintf(stderr, "Error: Encountered error while reading %s: %s\n", src, idev_afc_strerror(err));
+            fprintf(stderr, "Warning! - %llu bytes read - incomplete data in %s may have resulted.\n", (unsigned long long)local.offset, dst);
+        } else if (!writeFailed) {
+            printf("Saved %llu bytes to %s\n", (unsigned long long)local.offset, dst);
+            if (used > 0 && seconds > 0)
+                printf("Read over %d connections in %.2fs, %.1f MB/s\n", used, seconds, local.offset / seconds / (1024 * 1024));
+            if (resumeTransfers)
+                afc_resume_clear(dst);
+            ret=EXIT_SUCCESS;
+        }
+        
     } else {
-        ret = "wb";
+        fprintf(stderr, "Error opening local file for writing: %s - %s\n", dst, strerror(errno));
     }
-#endif
+    
+    afc_file_close(afc, handle);
+    
+    if (ret == EXIT_SUCCESS && verifyTransfers)
+        ret = verify_transfer(afc, src, dst, false, inflight, digest);
     return ret;
 }
 
+// up to size bytes from handle, into buf, the spool or the archive, whichever is set
+static afc_error_t read_afc_file(afc_client_t afc, uint64_t handle, uint64_t size, afc_tar_t *tar, char *buf, FILE *spool, uint64_t *got) {
+    afc_error_t err = AFC_E_SUCCESS;
+    afc_xfer_t xfer;
+    uint32_t bytes = 0;
+    
+    *got = 0;
+    afc_xfer_init(&xfer, size);
+    xfer.limit = size;
+    while (*got < size && (err = afc_xfer_read(afc, handle, &xfer, &bytes)) == AFC_E_SUCCESS && bytes > 0) {
+        if (bytes > size - *got)
+            bytes = (uint32_t)(size - *got);
+        if (buf)
+            memcpy(buf + *got, xfer.buf, bytes);
+        else if (spool && fwrite(xfer.buf, 1, bytes, spool) != bytes)
+            break;
+        else if (tar && afc_tar_write(tar, xfer.buf, bytes) != EXIT_SUCCESS)
+            break;
+        *got += bytes;
+    }
+    afc_xfer_free(&xfer);
+    return err;
+}
+
+/*
+ 
+ clone --store, the file is hashed as it arrives and goes into the store under its digest,
+ newPath becomes a hardlink to that object, see afcstore.h. one of up to STORE_MEMORY_FILE is
+ read into memory and only written at all when the store doesn't have it yet, a larger one is
+ downloaded into the store's temp folder first and dropped there if it turns out to be known.
+ 
+ */
+
+#define STORE_MEMORY_FILE   (4 * 1024 * 1024)
+
+static int store_afc_file(afc_client_t afc, const afc_entry_t *item, const char *newPath, bool progress, char *digest) {
+    const char *src = item->path;
+    char temp[PATH_MAX];
+    char hex[AFC_HASH_HEX_SIZE];
+    uint64_t handle = 0, got = 0;
+    afc_hash_t hash, inflight;
+    int ret = EXIT_FAILURE;
+    
+    afc_error_t err = afc_file_open(afc, src, AFC_FOPEN_RDONLY, &handle);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc open file %s failed: %s\n", src, idev_afc_strerror(err));
+        return ret;
+    }
+    
+    afc_hash_init(&hash, cloneStore->algo);
+    if (item->size <= STORE_MEMORY_FILE) {
+        char *buf = malloc((item->size) ? item->size : 1);
+        err = (buf) ? read_afc_file(afc, handle, item->size, NULL, buf, NULL, &got) : AFC_E_NO_MEM;
+        if (err == AFC_E_SUCCESS) {
+            afc_hash_update(&hash, buf, got);
+            inflight = hash;
+            afc_hash_final(&hash, hex);
+            if (afc_store_commit_buffer(cloneStore, buf, got, hex, newPath) == EXIT_SUCCESS)
+                ret = EXIT_SUCCESS;
+            else
+                fprintf(stderr, "Error: could not store %s: %s\n", newPath, strerror(errno));
+        }
+        free(buf);
+    } else if (afc_store_temp(cloneStore, temp, PATH_MAX) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: could not store %s: %s\n", newPath, strerror(errno));
+    } else {
+        afc_local_t local;
+        if (afc_local_create(&local, temp, item->size) == EXIT_SUCCESS) {
+            afc_xfer_t xfer;
+            int writeErr = 0;
+            transfer_progress_t bar = { strrchr(newPath, '/'), (off_t)item->size };
+            bar.name = (bar.name) ? bar.name + 1 : newPath;
+            
+            afc_xfer_init(&xfer, item->size);
+            xfer.hash = &hash;
+            err = afc_pipe_copy(afc, handle, &xfer, &local, (progress && !quiet) ? transfer_progress : NULL, &bar, &writeErr);
+            afc_xfer_report(&xfer, src);
+            afc_xfer_free(&xfer);
+            got = local.offset;
+            if (afc_local_close(&local) != EXIT_SUCCESS && !writeErr)
+                writeErr = errno;
+            
+            if (writeErr) {
+                fprintf(stderr, "Error: writing %s failed: %s\n", temp, strerror(writeErr));
+                unlink(temp);
+            } else if (err != AFC_E_SUCCESS) {
+                unlink(temp);
+            } else {
+                inflight = hash;
+                afc_hash_final(&hash, hex);
+                if (afc_store_commit(cloneStore, temp, hex, newPath, got) == EXIT_SUCCESS)
+                    ret = EXIT_SUCCESS;
+                else
+                    fprintf(stderr, "Error: could not store %s: %s\n", newPath, strerror(errno));
+            }
+        } else {
+            fprintf(stderr, "Error opening local file for writing: %s - %s\n", temp, strerror(errno));
+        }
+    }
+    afc_file_close(afc, handle);
+    
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: Encountered error while reading %s: %s\n", src, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    if (ret != EXIT_SUCCESS)
+        return ret;
+    printf("Saved %llu bytes to %s\n", (unsigned long long)got, newPath);
+    if (idev_verbose)
+        fprintf(stderr, "[debug] %s is %s object %s\n", newPath, afc_hash_name(cloneStore->algo), hex);
+    
+    // the digest is known already, only the sample read back is left
+    if (verifyTransfers)
+        return verify_transfer(afc, src, newPath, false, &inflight, digest);
+    return EXIT_SUCCESS;
+}
 
 /*
  (
@@ -494,304 +973,1701 @@ char * write_mode_for_file(char *filename) {
  
  */
 
-int clone_afc_path(afc_client_t afc, const char *src, const char *dst) {
-    int ret=EXIT_FAILURE;
-    
-    if (idev_verbose)
-        fprintf(stderr, "[debug] Cloning %s to %s - creating afc file connection\n", src, dst);
+/*
+ 
+ copies a single file for clone, shared by the serial loop and the -j workers so both
+ report, fail and --clean the same way. the original is only removed once this
+ particular file has been saved completely.
+ 
+ */
+
+int clone_afc_file(afc_client_t afc, const afc_entry_t *item, const char *newPath, bool progress, char *digest) {
+    const char *path = item->path;
+    printf("copy file to new path: %s\n", newPath);
     
-    plist_t fileList = afc_list_path(afc, src, true);
-    int fileCount = plist_array_get_size(fileList);
-    if (idev_verbose)
-        printf("fileCount: %i\n", fileCount);
+    int ret = (cloneStore) ? store_afc_file(afc, item, newPath, progress, digest) : download_afc_file(afc, path, newPath, item, progress, 1, NULL, digest);
     
-    int i;
-    //windows mkdir is different!
+    // the local mtime is what the next --incremental or --link-dest run falls back on without a
+    // manifest, a stored file shares its inode with every other tree that has the same content
+    if (ret == EXIT_SUCCESS && (incremental || linkDest) && !cloneStore)
+        afc_local_set_mtime(newPath, item->mtime);
     
-#if defined(_WIN32)
+    // download_afc_file has closed the file, which has to happen before it can be deleted
+    if (ret == EXIT_SUCCESS && clean == true) {
+        fprintf(stderr, "File cloned successfully, clearing original: %s\n", path);
+        rm_file(afc, (char*)path);
+    }
+    return ret;
+}
+
+/*
+ 
+ --incremental: a file is skipped when the local copy is still there with the remote size and
+ the manifest of the last run has the same st_size and st_mtime for it. a tree cloned before
+ there was a manifest is compared by the local mtime instead, which --incremental sets from the
+ device on every file it copies.
+ 
+ */
+
+static bool clone_is_unchanged(afc_manifest_t *previous, const afc_entry_t *item, const char *newPath) {
+    struct stat st;
+    afc_manifest_entry_t *known = afc_manifest_find(previous, item->path);
+    if (known)
+        known->seen = true;
+    
+    if (stat(newPath, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != item->size)
+        return false;
+    if (known)
+        return known->size == item->size && known->mtime == item->mtime;
+    return (uint64_t)st.st_mtime == item->mtime / 1000000000ULL;
+}
+
+// whether a manifest path came from cloning src, a destination can hold more than one clone
+static bool clone_in_scope(const char *path, const char *src) {
+    size_t len = strlen(src);
+    while (len > 0 && src[len-1] == '/')
+        len--;
+    return len == 0 || (strncmp(path, src, len) == 0 && path[len] == '/');
+}
+
+/*
+ 
+ files the last run copied that are no longer on the device are removed locally, only those, a
+ file that was put into the destination by something else is never touched. --clean deletes the
+ originals on purpose, so nothing is removed locally then. neither is anything after a walk that
+ had to skip a folder or a file, a file it didn't see may well still be there. those stay in the
+ manifest for the next complete run to sort out.
+ 
+ */
+
+static int clone_remove_deleted(afc_manifest_t *previous, afc_manifest_t *current, const char *src, const char *dst, bool complete) {
+    int deleted = 0;
+    size_t i;
     
-    _mkdir(dst);
+    for (i = 0; i < previous->count; i++) {
+        const afc_manifest_entry_t *entry = &previous->entries[i];
+        char newPath[PATH_MAX];
+        
+        if (entry->seen)
+            continue;
+        if (clean || !complete || !clone_in_scope(entry->path, src)) {
+            afc_manifest_add(current, entry->path, entry->size, entry->mtime);
+            continue;
+        }
+        snprintf(newPath, PATH_MAX, "%s/%s", dst, entry->path);
+        if (remove(newPath) == 0 || errno == ENOENT) {
+            printf("delete file at path: %s\n", newPath);
+            deleted++;
+        } else {
+            fprintf(stderr, "Error: could not delete %s: %s\n", newPath, strerror(errno));
+            afc_manifest_add(current, entry->path, entry->size, entry->mtime);
+        }
+    }
+    return deleted;
+}
+
+/*
+ 
+ the walk feeds the copies directly. clone_afc_entry is called for every entry as soon as it
+ has been stat'ed, from whichever walk connection stat'ed it. folders are made right there,
+ the walk hands a folder out before anything in it, and files go to the -j workers through a
+ queue of at most CLONE_QUEUE_DEPTH per worker, a full queue just holds the walk up. the first
+ file is on its way while the walk is still going, and memory is bounded by that queue and the
+ folder paths instead of the whole tree. without workers it is the ordered walk on this one
+ connection, copying each file between two stat requests.
+ 
+ */
+
+#define CLONE_QUEUE_DEPTH   4
+
+typedef struct clone_t {
+    afc_client_t afc;
+    const char *dst;
+    afc_pool_t *pool;
+    pthread_mutex_t lock;       // everything below, the walk and the workers both get at it
+    afc_local_dirs_t dirs;
+    afc_manifest_t previous;    // --incremental, or the one of the --link-dest clone
+    afc_manifest_t current;
+    afc_manifest_t previousSums;    // --verify
+    afc_manifest_t sums;
+    int copied;
+    int skipped;
+    int linked;                 // --link-dest
+    int failed;
+    int unread;                 // paths the walk couldn't list or stat, nothing is deleted then
+    int replaced;               // --incremental, files removed because they became folders
+    bool linkWarned;
+} clone_t;
+
+typedef struct clone_job_t {
+    clone_t *clone;
+    afc_entry_t item;           // a copy, the walk's entry is gone once the callback returns
+    char path[PATH_MAX];
+    char newPath[PATH_MAX];
+} clone_job_t;
+
+static int clone_job_run(afc_client_t afc, void *arg) {
+    clone_job_t *job = arg;
+    clone_t *clone = job->clone;
+    char digest[AFC_HASH_HEX_SIZE];
+    // one progress bar per worker would just scribble over each other, a clone that fell back to serial has one
+    int ret = clone_afc_file(afc, &job->item, job->newPath, clone->pool == NULL, digest);
+    
+    pthread_mutex_lock(&clone->lock);
+    if (ret == EXIT_SUCCESS) {
+        clone->copied++;
+        if (incremental || linkDest)
+            afc_manifest_add(&clone->current, job->item.path, job->item.size, job->item.mtime);
+        if (verifyTransfers)
+            afc_manifest_add_sum(&clone->sums, job->item.path, job->item.size, digest);
+    } else {
+        clone->failed++;
+    }
+    pthread_mutex_unlock(&clone->lock);
     
-#else
-    mkdir(dst, 0777); // notice that 777 is different than 0777
+    free(job);
+    return ret;
+}
+
+// a file --incremental skipped or --link-dest linked keeps the digest it had, one the last run has none for is hashed from the local copy
+static void clone_keep_sum(clone_t *clone, const afc_entry_t *item, const char *newPath) {
+    char hex[AFC_HASH_HEX_SIZE];
+    
+    pthread_mutex_lock(&clone->lock);
+    afc_manifest_entry_t *known = afc_manifest_find(&clone->previousSums, item->path);
+    if (known && known->size == item->size) {
+        afc_manifest_add_sum(&clone->sums, item->path, item->size, known->digest);
+        pthread_mutex_unlock(&clone->lock);
+        return;
+    }
+    pthread_mutex_unlock(&clone->lock);
     
-#endif
+    if (afc_hash_file(newPath, hashAlgo, hex, NULL) != EXIT_SUCCESS) {
+        fprintf(stderr, "Warning: could not hash %s, it is left out of %s: %s\n", newPath, AFC_SUMS_NAME, strerror(errno));
+        return;
+    }
+    pthread_mutex_lock(&clone->lock);
+    afc_manifest_add_sum(&clone->sums, item->path, item->size, hex);
+    pthread_mutex_unlock(&clone->lock);
+}
+
+/*
+ 
+ --link-dest: a file that is unchanged against the earlier clone, by the same test as
+ --incremental, becomes a hardlink to its copy there instead of being downloaded. every
+ snapshot is a whole tree and takes space only for what changed. a file that can't be linked,
+ another filesystem or too many links, is downloaded as usual.
+ 
+ */
+
+static bool clone_link_previous(clone_t *clone, const afc_entry_t *item, const char *newPath) {
+    char oldPath[PATH_MAX];
+    
+    snprintf(oldPath, PATH_MAX, "%s/%s", linkDest, item->path);
+    pthread_mutex_lock(&clone->lock);
+    bool unchanged = clone_is_unchanged(&clone->previous, item, oldPath);
+    pthread_mutex_unlock(&clone->lock);
+    if (!unchanged)
+        return false;
     
-    for (i = 0; i < fileCount; i++) {
-        char *path = NULL, *fmt = NULL, *size = NULL;
-        plist_t item = plist_array_get_item(fileList, i);
-        plist_get_string_val(plist_dict_get_item(item, "path"), &path);
-        plist_get_string_val(plist_dict_get_item(item, "st_ifmt"), &fmt);
-        plist_get_string_val(plist_dict_get_item(item, "st_size"), &size);
-        long fsize = atol(size);
-        char newPath[PATH_MAX], sys[PATH_MAX];
-        
-        if (strcmp(fmt, "S_IFDIR") == 0) {
-            sprintf(newPath,"%s/%s/",dst, path);
-            sprintf(sys, "/bin/mkdir -p %s", newPath); //using mkdir -p since theres no easy way to use mkdir() to create intermediate paths
 #if defined(_WIN32)
-            _mkdir(newPath);
-            
+    errno = ENOSYS;
+    bool linked = false;
 #else
-            printf("%s\n", sys);
-            system(sys);
-            mkdir(newPath, 0777); // notice that 777 is different than 0777
+    bool linked = (unlink(newPath) == 0 || errno == ENOENT) && link(oldPath, newPath) == 0;
 #endif
+    if (!linked) {
+        int linkErr = errno;
+        pthread_mutex_lock(&clone->lock);
+        bool warn = !clone->linkWarned;
+        clone->linkWarned = true;
+        pthread_mutex_unlock(&clone->lock);
+        if (warn)
+            fprintf(stderr, "Warning: could not link %s to %s, downloading instead: %s\n", newPath, oldPath, strerror(linkErr));
+        return false;
+    }
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] unchanged, linking %s\n", oldPath);
+    pthread_mutex_lock(&clone->lock);
+    afc_manifest_add(&clone->current, item->path, item->size, item->mtime);
+    clone->linked++;
+    pthread_mutex_unlock(&clone->lock);
+    if (verifyTransfers)
+        clone_keep_sum(clone, item, newPath);
+    return true;
+}
+
+static void clone_afc_entry(const afc_entry_t *item, void *ctx) {
+    clone_t *clone = ctx;
+    const char *path = item->path;
+    char newPath[PATH_MAX];
+    
+    if (item->unread) {
+        pthread_mutex_lock(&clone->lock);
+        clone->unread++;
+        pthread_mutex_unlock(&clone->lock);
+        return;
+    }
+    if (item->type == AFC_ENTRY_DIR) {
+        char oldPath[PATH_MAX];
+        struct stat st;
+        snprintf(newPath, PATH_MAX, "%s/%s/", clone->dst, path);
+        snprintf(oldPath, PATH_MAX, "%s/%s", clone->dst, path);
+        pthread_mutex_lock(&clone->lock);
+        afc_manifest_entry_t *known = (incremental) ? afc_manifest_find(&clone->previous, path) : NULL;
+        if (known) {
+            // a file the last run copied that became a folder, the file has to go first. if it
+            // can't, it stays unseen and clone_remove_deleted reports that
+            if (stat(oldPath, &st) != 0 || S_ISDIR(st.st_mode)) {
+                known->seen = true;
+            } else if (unlink(oldPath) == 0) {
+                printf("delete file at path: %s\n", oldPath);
+                known->seen = true;
+                clone->replaced++;
+            }
+        }
+        int made = afc_local_mkdirs(&clone->dirs, path);
+        pthread_mutex_unlock(&clone->lock);
+        if (made == EXIT_SUCCESS)
             printf("mkdir at new path: %s\n", newPath);
+        else
+            fprintf(stderr, "Error: mkdir %s failed: %s\n", newPath, strerror(errno));
+        return;
+    }
+    
+    snprintf(newPath, PATH_MAX, "%s/%s%s", clone->dst, path, (compressPool) ? AFC_ZST_SUFFIX : "");
+    pthread_mutex_lock(&clone->lock);
+    if (incremental && clone_is_unchanged(&clone->previous, item, newPath)) {
+        afc_manifest_add(&clone->current, path, item->size, item->mtime);
+        clone->skipped++;
+        pthread_mutex_unlock(&clone->lock);
+        if (idev_verbose)
+            fprintf(stderr, "[debug] unchanged, skipping %s\n", path);
+        if (verifyTransfers)
+            clone_keep_sum(clone, item, newPath);
+        return;
+    }
+    
+    // the walk only reports folders below src, not src itself or its parents
+    const char *slash = strrchr(path, '/');
+    if (slash && slash > path) {
+        char dir[PATH_MAX];
+        snprintf(dir, PATH_MAX, "%.*s", (int)(slash - path), path);
+        if (afc_local_mkdirs(&clone->dirs, dir) != EXIT_SUCCESS)
+            fprintf(stderr, "Error: mkdir %s/%s failed: %s\n", clone->dst, dir, strerror(errno));
+    }
+    pthread_mutex_unlock(&clone->lock);
+    
+    if (linkDest && clone_link_previous(clone, item, newPath))
+        return;
+    
+    clone_job_t *job = calloc(1, sizeof(clone_job_t));
+    if (job) {
+        job->clone = clone;
+        job->item = *item;
+        job->item.link = NULL;
+        strncpy(job->path, path, PATH_MAX-1);
+        job->item.path = job->path;
+        strncpy(job->newPath, newPath, PATH_MAX-1);
+        
+        if (!clone->pool) {
+            clone_job_run(clone->afc, job);
+            return;
+        }
+        // the walk's connections are all busy walking, there is none to copy on here instead
+        if (afc_pool_submit(clone->pool, clone_job_run, job) == EXIT_SUCCESS)
+            return;
+        free(job);
+    }
+    
+    fprintf(stderr, "Error: out of memory, not copying %s\n", path);
+    pthread_mutex_lock(&clone->lock);
+    clone->failed++;
+    pthread_mutex_unlock(&clone->lock);
+}
+
+int clone_afc_path(afc_client_t afc, const char *src, const char *dst) {
+    int ret=EXIT_FAILURE;
+    clone_t clone;
+    char manifestPath[PATH_MAX];
+    char sumsPath[PATH_MAX];
+    char previousPath[PATH_MAX];
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] Cloning %s to %s - creating afc file connection\n", src, dst);
+    
+    memset(&clone, 0, sizeof(clone_t));
+    clone.afc = afc;
+    clone.dst = dst;
+    if (afc_local_dirs_open(&clone.dirs, dst) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: could not create %s: %s\n", dst, strerror(errno));
+        return ret;
+    }
+    
+#if !defined(_WIN32)
+    // linking the destination to itself would unlink every file before it is linked back
+    if (linkDest) {
+        char *real = realpath(linkDest, NULL);
+        char *realDst = realpath(dst, NULL);
+        bool same = (real && realDst && !strcmp(real, realDst));
+        free(real);
+        free(realDst);
+        if (same) {
+            fprintf(stderr, "Error: --link-dest %s is the destination itself\n", linkDest);
+            afc_local_dirs_close(&clone.dirs);
+            return ret;
+        }
+    }
+#endif
+    pthread_mutex_init(&clone.lock, NULL);
+    
+    afc_manifest_init(&clone.previous);
+    afc_manifest_init(&clone.current);
+    afc_manifest_init(&clone.previousSums);
+    afc_manifest_init(&clone.sums);
+    snprintf(sumsPath, PATH_MAX, "%s/%s", dst, AFC_SUMS_NAME);
+    snprintf(manifestPath, PATH_MAX, "%s/%s", dst, AFC_MANIFEST_NAME);
+    if (incremental) {
+        if (afc_manifest_load(&clone.previous, manifestPath) != EXIT_SUCCESS)
+            fprintf(stderr, "Warning: could not read %s, copying everything\n", manifestPath);
+    }
+    if (linkDest) {
+        // without its manifest the earlier clone is compared by the mtime of its files
+        snprintf(previousPath, PATH_MAX, "%s/%s", linkDest, AFC_MANIFEST_NAME);
+        if (afc_manifest_load(&clone.previous, previousPath) != EXIT_SUCCESS)
+            fprintf(stderr, "Warning: could not read %s, comparing by the files in %s\n", previousPath, linkDest);
+    }
+    // the digests of linked files come from where they are linked from
+    if (linkDest)
+        snprintf(previousPath, PATH_MAX, "%s/%s", linkDest, AFC_SUMS_NAME);
+    else
+        snprintf(previousPath, PATH_MAX, "%s", sumsPath);
+    if (verifyTransfers && afc_manifest_load_sums(&clone.previousSums, previousPath, hashAlgo) != EXIT_SUCCESS)
+        fprintf(stderr, "Warning: could not read %s, starting a new one\n", previousPath);
+    
+    if (jobCount > 1) {
+        clone.pool = afc_pool_new(jobCount);
+        if (clone.pool)
+            afc_pool_set_depth(clone.pool, afc_pool_size(clone.pool) * CLONE_QUEUE_DEPTH);
+        else
+            fprintf(stderr, "Warning: could not start any afc workers, cloning serially\n");
+    }
+    
+    // the compression threads are apart from the afc ones, every download hands its blocks to them
+    if (compressLevel) {
+        compressPool = afc_zst_pool_new(compressThreads, compressLevel, compressIndex);
+        if (!compressPool) {
+            fprintf(stderr, "Error: could not start any compression threads\n");
+            afc_pool_free(clone.pool);
+            afc_manifest_free(&clone.previous);
+            afc_manifest_free(&clone.current);
+            afc_manifest_free(&clone.previousSums);
+            afc_manifest_free(&clone.sums);
+            pthread_mutex_destroy(&clone.lock);
+            afc_local_dirs_close(&clone.dirs);
+            return ret;
+        }
+        if (idev_verbose)
+            fprintf(stderr, "[debug] compressing with zstd level %d on %d threads\n", compressLevel, afc_zst_pool_size(compressPool));
+    }
+    
+    afc_store_t store;
+    if (storePath) {
+        if (afc_store_open(&store, storePath, hashAlgo) != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: could not open the store %s: %s\n", storePath, strerror(errno));
+            afc_pool_free(clone.pool);
+            afc_manifest_free(&clone.previous);
+            afc_manifest_free(&clone.current);
+            afc_manifest_free(&clone.previousSums);
+            afc_manifest_free(&clone.sums);
+            pthread_mutex_destroy(&clone.lock);
+            afc_local_dirs_close(&clone.dirs);
+            return ret;
+        }
+        cloneStore = &store;
+    }
+    
+    afc_error_t err;
+    if (clone.pool)
+        err = afc_walk_stream(afc, src, AFC_WALK_RECURSIVE | AFC_WALK_DIRS | AFC_WALK_UNREAD, jobCount, clone_afc_entry, &clone);
+    else
+        err = afc_walk_ordered(afc, src, AFC_WALK_RECURSIVE | AFC_WALK_DIRS | AFC_WALK_UNREAD, clone_afc_entry, &clone);
+    if (clone.pool) {
+        afc_pool_wait(clone.pool);
+        afc_pool_free(clone.pool);
+    }
+    if (compressPool) {
+        uint64_t original = 0, compressed = 0;
+        afc_zst_pool_totals(compressPool, &original, &compressed);
+        printf("Compressed %llu bytes to %llu (%.1f%%) with zstd level %d\n", (unsigned long long)original, (unsigned long long)compressed, (original) ? 100.0 * compressed / original : 0.0, compressLevel);
+        afc_zst_pool_free(compressPool);
+        compressPool = NULL;
+    }
+    if (cloneStore) {
+        printf("store: %d new objects (%llu bytes), %d already stored (%llu bytes), %d copied\n", store.added, (unsigned long long)store.added_bytes, store.linked, (unsigned long long)store.linked_bytes, store.copied);
+        afc_store_close(&store);
+        cloneStore = NULL;
+    }
+    
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", src, idev_afc_strerror(err));
+    } else {
+        if (clone.copied + clone.skipped + clone.linked > 0)
+            ret = EXIT_SUCCESS;
+        if (incremental) {
+            if (clone.unread)
+                fprintf(stderr, "Warning: %d path(s) below %s could not be read, nothing is deleted locally this time\n", clone.unread, src);
+            int deleted = clone_remove_deleted(&clone.previous, &clone.current, src, dst, clone.unread == 0);
+            if (afc_manifest_save(&clone.current, manifestPath) != EXIT_SUCCESS)
+                fprintf(stderr, "Error: could not write %s: %s\n", manifestPath, strerror(errno));
+            printf("incremental clone: %d copied, %d skipped, %d deleted, %d failed\n", clone.copied, clone.skipped, deleted + clone.replaced, clone.failed);
+        }
+        if (linkDest) {
+            // the manifest makes this clone the --link-dest of the next one
+            if (afc_manifest_save(&clone.current, manifestPath) != EXIT_SUCCESS)
+                fprintf(stderr, "Error: could not write %s: %s\n", manifestPath, strerror(errno));
+            printf("link-dest clone: %d copied, %d linked from %s, %d failed\n", clone.copied, clone.linked, linkDest, clone.failed);
+        }
+        if (verifyTransfers) {
+            // a destination can hold more than one clone, the others keep their lines
+            size_t i;
+            for (i = 0; i < clone.previousSums.count; i++) {
+                const afc_manifest_entry_t *entry = &clone.previousSums.entries[i];
+                if (!clone_in_scope(entry->path, src))
+                    afc_manifest_add_sum(&clone.sums, entry->path, entry->size, entry->digest);
+            }
+            if (afc_manifest_save_sums(&clone.sums, sumsPath, hashAlgo) != EXIT_SUCCESS)
+                fprintf(stderr, "Error: could not write %s: %s\n", sumsPath, strerror(errno));
+            else
+                printf("%s digests of %zu files in %s\n", afc_hash_name(hashAlgo), clone.sums.count, sumsPath);
+        }
+    }
+    
+    afc_manifest_free(&clone.previous);
+    afc_manifest_free(&clone.current);
+    afc_manifest_free(&clone.previousSums);
+    afc_manifest_free(&clone.sums);
+    pthread_mutex_destroy(&clone.lock);
+    afc_local_dirs_close(&clone.dirs);
+    return ret;
+}
+
+/*
+ 
+ clone --tar, the same walk as clone but into one tar stream instead of a local tree, under
+ the same device paths. entries go in as the walk hands them out, a folder before anything in
+ it, symlinks as symlinks. without workers every file is read straight into the archive on
+ the walk's connection. with -j N a worker reads a file of up to TAR_MEMORY_FILE into memory
+ on its own connection first and only takes the lock to append it. a larger one is read into
+ a tmpfile() the same way and copied in from there under the lock, a local copy is much quicker
+ than the device. only when no temp file can be made does the worker hold the lock while the
+ file comes straight from the device. stdout may be the archive, everything else goes to stderr.
+ 
+ */
+
+#define TAR_MEMORY_FILE     (4 * 1024 * 1024)
+#define TAR_SPOOL_BLOCK     (1024 * 1024)
+
+typedef struct tar_clone_t {
+    afc_client_t afc;
+    afc_pool_t *pool;
+    pthread_mutex_t lock;       // the archive and the counts
+    afc_tar_t tar;
+    int files;
+    int failed;
+    uint64_t bytes;
+} tar_clone_t;
+
+typedef struct tar_job_t {
+    tar_clone_t *clone;
+    afc_entry_t item;
+    char path[PATH_MAX];
+} tar_job_t;
+
+static int tar_add_file(tar_clone_t *clone, afc_client_t afc, const afc_entry_t *item) {
+    uint64_t handle = 0, got = 0, missing = 0;
+    char *buf = NULL;
+    
+    afc_error_t err = (item->size > 0) ? afc_file_open(afc, item->path, AFC_FOPEN_RDONLY, &handle) : AFC_E_SUCCESS;
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc open file %s failed: %s\n", item->path, idev_afc_strerror(err));
+        pthread_mutex_lock(&clone->lock);
+        clone->failed++;
+        pthread_mutex_unlock(&clone->lock);
+        return EXIT_FAILURE;
+    }
+    
+    bool buffered = (clone->pool && item->size > 0 && item->size <= TAR_MEMORY_FILE);
+    if (buffered) {
+        buf = malloc(item->size);
+        err = (buf) ? read_afc_file(afc, handle, item->size, NULL, buf, NULL, &got) : AFC_E_NO_MEM;
+    }
+    
+    // a larger one goes to a temp file first, the archive is only locked to copy that in
+    FILE *spool = NULL;
+    int spoolErr = 0;
+    if (clone->pool && item->size > TAR_MEMORY_FILE) {
+        buf = malloc(TAR_SPOOL_BLOCK);
+        spool = (buf) ? tmpfile() : NULL;
+        if (spool) {
+            err = read_afc_file(afc, handle, item->size, NULL, NULL, spool, &got);
+            if (fflush(spool) != 0 || ferror(spool) || fseek(spool, 0, SEEK_SET) != 0)
+                spoolErr = (errno) ? errno : EIO;
+        } else if (idev_verbose) {
+            fprintf(stderr, "[debug] could not spool %s, reading it into the archive directly: %s\n", item->path, strerror(errno));
+        }
+    }
+    if (spoolErr) {
+        fprintf(stderr, "Error: could not spool %s to a temp file: %s\n", item->path, strerror(spoolErr));
+        fclose(spool);
+        free(buf);
+        afc_file_close(afc, handle);
+        pthread_mutex_lock(&clone->lock);
+        clone->failed++;
+        pthread_mutex_unlock(&clone->lock);
+        return EXIT_FAILURE;
+    }
+    
+    pthread_mutex_lock(&clone->lock);
+    int ret = afc_tar_begin_file(&clone->tar, item->path, item->size, item->mtime);
+    int entryErr = (ret != EXIT_SUCCESS) ? errno : 0;
+    if (ret == EXIT_SUCCESS) {
+        if (buffered) {
+            afc_tar_write(&clone->tar, buf, got);
+        } else if (spool) {
+            size_t n;
+            while ((n = fread(buf, 1, TAR_SPOOL_BLOCK, spool)) > 0 && afc_tar_write(&clone->tar, buf, n) == EXIT_SUCCESS)
+                ;
+            if (ferror(spool))
+                spoolErr = (errno) ? errno : EIO;
+        } else if (item->size > 0) {
+            err = read_afc_file(afc, handle, item->size, &clone->tar, NULL, NULL, &got);
+        }
+        missing = afc_tar_end_file(&clone->tar);
+    }
+    bool broken = (clone->tar.error != 0);
+    if (ret != EXIT_SUCCESS || err != AFC_E_SUCCESS || spoolErr || broken) {
+        ret = EXIT_FAILURE;
+        clone->failed++;
+    } else {
+        clone->files++;
+        clone->bytes += got;
+    }
+    pthread_mutex_unlock(&clone->lock);
+    
+    if (spool)
+        fclose(spool);
+    free(buf);
+    if (handle)
+        afc_file_close(afc, handle);
+    
+    // the header has the size from the walk already, whatever did not arrive is zeros
+    if (broken)
+        return ret;     // the archive is what failed, afc_tar_close reports it once
+    if (entryErr)
+        fprintf(stderr, "Error: could not add %s to the archive: %s\n", item->path, strerror(entryErr));
+    else if (spoolErr)
+        fprintf(stderr, "Error: reading %s back from its temp file failed: %s, %llu bytes of it are zeros in the archive\n", item->path, strerror(spoolErr), (unsigned long long)missing);
+    else if (err != AFC_E_SUCCESS)
+        fprintf(stderr, "Error: reading %s failed: %s, %llu bytes of it are zeros in the archive\n", item->path, idev_afc_strerror(err), (unsigned long long)missing);
+    else if (missing > 0)
+        fprintf(stderr, "Warning: %s got shorter while it was read, %llu bytes of it are zeros in the archive\n", item->path, (unsigned long long)missing);
+    else if (ret == EXIT_SUCCESS && idev_verbose)
+        fprintf(stderr, "[debug] archived %s, %llu bytes\n", item->path, (unsigned long long)got);
+    return ret;
+}
+
+static int tar_job_run(afc_client_t afc, void *arg) {
+    tar_job_t *job = arg;
+    int ret = tar_add_file(job->clone, afc, &job->item);
+    free(job);
+    return ret;
+}
+
+static void tar_afc_entry(const afc_entry_t *item, void *ctx) {
+    tar_clone_t *clone = ctx;
+    
+    pthread_mutex_lock(&clone->lock);
+    bool broken = (clone->tar.error != 0);
+    pthread_mutex_unlock(&clone->lock);
+    if (broken)
+        return;     // the archive can't be written anymore, reported at the end
+    
+    if (item->type == AFC_ENTRY_LINK && !item->link) {
+        // no target to put in the header, it must not end up as an empty regular file
+        fprintf(stderr, "Warning: could not read the target of %s, it is not in the archive\n", item->path);
+        pthread_mutex_lock(&clone->lock);
+        clone->failed++;
+        pthread_mutex_unlock(&clone->lock);
+        return;
+    }
+    
+    if (item->type == AFC_ENTRY_DIR || item->type == AFC_ENTRY_LINK) {
+        pthread_mutex_lock(&clone->lock);
+        int ret;
+        if (item->type == AFC_ENTRY_DIR)
+            ret = afc_tar_add_dir(&clone->tar, item->path, item->mtime);
+        else
+            ret = afc_tar_add_symlink(&clone->tar, item->path, item->link, item->mtime);
+        int entryErr = errno;
+        if (ret != EXIT_SUCCESS)
+            clone->failed++;
+        broken = (clone->tar.error != 0);
+        pthread_mutex_unlock(&clone->lock);
+        if (ret != EXIT_SUCCESS && !broken)
+            fprintf(stderr, "Error: could not add %s to the archive: %s\n", item->path, strerror(entryErr));
+        return;
+    }
+    
+    if (!clone->pool) {
+        tar_add_file(clone, clone->afc, item);
+        return;
+    }
+    
+    tar_job_t *job = calloc(1, sizeof(tar_job_t));
+    if (job) {
+        job->clone = clone;
+        job->item = *item;
+        job->item.link = NULL;
+        strncpy(job->path, item->path, PATH_MAX-1);
+        job->item.path = job->path;
+        if (afc_pool_submit(clone->pool, tar_job_run, job) == EXIT_SUCCESS)
+            return;
+        free(job);
+    }
+    fprintf(stderr, "Error: out of memory, not archiving %s\n", item->path);
+    pthread_mutex_lock(&clone->lock);
+    clone->failed++;
+    pthread_mutex_unlock(&clone->lock);
+}
+
+int tar_afc_path(afc_client_t afc, const char *src, const char *path) {
+    tar_clone_t clone;
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] Archiving %s to %s\n", src, path);
+    
+    memset(&clone, 0, sizeof(tar_clone_t));
+    clone.afc = afc;
+    if (afc_tar_create(&clone.tar, path) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: could not create %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&clone.lock, NULL);
+    
+    if (jobCount > 1) {
+        clone.pool = afc_pool_new(jobCount);
+        if (clone.pool)
+            afc_pool_set_depth(clone.pool, afc_pool_size(clone.pool) * CLONE_QUEUE_DEPTH);
+        else
+            fprintf(stderr, "Warning: could not start any afc workers, archiving serially\n");
+    }
+    
+    afc_error_t err;
+    if (clone.pool)
+        err = afc_walk_stream(afc, src, AFC_WALK_RECURSIVE | AFC_WALK_DIRS, jobCount, tar_afc_entry, &clone);
+    else
+        err = afc_walk_ordered(afc, src, AFC_WALK_RECURSIVE | AFC_WALK_DIRS, tar_afc_entry, &clone);
+    if (clone.pool) {
+        afc_pool_wait(clone.pool);
+        afc_pool_free(clone.pool);
+    }
+    
+    int ret = EXIT_SUCCESS;
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", src, idev_afc_strerror(err));
+        ret = EXIT_FAILURE;
+    }
+    if (afc_tar_close(&clone.tar) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: writing %s failed: %s\n", path, strerror(errno));
+        ret = EXIT_FAILURE;
+    } else {
+        fprintf(stderr, "Archived %d files, %llu bytes to %s%s\n", clone.files, (unsigned long long)clone.bytes, (strcmp(path, "-")) ? path : "stdout", (clone.failed) ? ", some failed" : "");
+    }
+    if (clone.failed > 0)
+        ret = EXIT_FAILURE;
+    pthread_mutex_destroy(&clone.lock);
+    return ret;
+}
+
+typedef struct export_t {
+    afc_client_t afc;
+    const char *dst;
+    size_t fileCount;
+    int ret;
+} export_t;
+
+// copies each file as the listing reaches it, on the connection the listing runs on
+static void export_afc_entry(const afc_entry_t *item, void *ctx) {
+    export_t *export = ctx;
+    const char *path = item->path;
+    const char *name = strrchr(path, '/');
+    char newPath[PATH_MAX];
+    
+    if (item->type == AFC_ENTRY_DIR)
+        return;
+    
+    export->fileCount++;
+    snprintf(newPath, PATH_MAX, "%s/%s", export->dst, (name) ? name + 1 : path);
+    printf("copy file to new path: %s\n", newPath);
+    
+    if (download_afc_file(export->afc, path, newPath, item, true, 1, NULL, NULL) == EXIT_SUCCESS) {
+        export->ret = EXIT_SUCCESS;
+        /*
+         
+         download_afc_file has closed the file, which has to happen before it can be deleted
+         
+         TODO: make it so if we are done with a folder and it is empty, we clear it out!
+         
+         */
+        if (clean == true) {
+            fprintf(stderr, "File cloned successfully, clearing original: %s\n", path);
+            rm_file(export->afc, (char*)path);
+        }
+    }
+}
+
+int export_shallow_folder(afc_client_t afc, const char *src, const char *dst) {
+    export_t export = { afc, dst, 0, EXIT_FAILURE };
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] exporting %s to %s - creating afc file connection\n", src, dst);
+    
+    afc_error_t listErr = afc_walk_ordered(afc, src, 0, export_afc_entry, &export);
+    if (listErr != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", src, idev_afc_strerror(listErr));
+        return EXIT_FAILURE;
+    }
+    
+    if (idev_verbose)
+        printf("fileCount: %zu\n", export.fileCount);
+    return export.ret;
+}
+
+//if theres ever a need just to grab a single file and not do a whole clone, this can be used.
+
+int get_afc_path(afc_client_t afc, const char *src, const char *dst) {
+    if (idev_verbose)
+        fprintf(stderr, "[debug] Downloading %s to %s - creating afc file connection\n", src, dst);
+    
+    afc_error_t err = AFC_E_SUCCESS;
+    int ret = download_afc_file(afc, src, dst, NULL, true, jobCount, &err, NULL);
+    if (err != AFC_E_SUCCESS) {
+        //this is a little non standard for a return value, trying to make things easier for cross platform
+        //detection of whether or not the device is currently "locked"
+        ret = err;
+    }
+    return ret;
+}
+
+/*
+ 
+ sum, the digest of remote files as they come off the device, nothing touches the local
+ disk. a folder is walked and every file below it summed, on -j connections at once when
+ asked to, and printed in path order once all are done. lines are "digest  path" the way
+ sha256sum and b3sum print them.
+ 
+ */
+
+static afc_error_t sum_afc_file(afc_client_t afc, const char *path, uint64_t size, char *hex) {
+    uint64_t handle = 0;
+    afc_error_t err = afc_file_open(afc, path, AFC_FOPEN_RDONLY, &handle);
+    if (err != AFC_E_SUCCESS)
+        return err;
+    
+    afc_xfer_t xfer;
+    afc_hash_t hash;
+    uint32_t bytes_read = 0;
+    afc_xfer_init(&xfer, size);
+    afc_hash_init(&hash, hashAlgo);
+    while ((err = afc_xfer_read(afc, handle, &xfer, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0)
+        afc_hash_update(&hash, xfer.buf, bytes_read);
+    if (err == AFC_E_SUCCESS)
+        afc_hash_final(&hash, hex);
+    afc_xfer_free(&xfer);
+    afc_file_close(afc, handle);
+    return err;
+}
+
+typedef struct sum_job_t {
+    const afc_entry_t *entry;
+    afc_error_t err;
+    char hex[AFC_HASH_HEX_SIZE];
+} sum_job_t;
+
+static int sum_job_run(afc_client_t afc, void *arg) {
+    sum_job_t *job = arg;
+    job->err = sum_afc_file(afc, job->entry->path, job->entry->size, job->hex);
+    return (job->err == AFC_E_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int sum_afc_folder(afc_client_t afc, const char *path) {
+    afc_tree_t tree;
+    size_t i;
+    
+    afc_error_t err = afc_walk(afc, path, AFC_WALK_RECURSIVE, jobCount, &tree);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    
+    sum_job_t *jobs = calloc(tree.count ? tree.count : 1, sizeof(sum_job_t));
+    if (!jobs) {
+        afc_tree_free(&tree);
+        return EXIT_FAILURE;
+    }
+    afc_pool_t *pool = (jobCount > 1) ? afc_pool_new(jobCount) : NULL;
+    if (jobCount > 1 && !pool)
+        fprintf(stderr, "Warning: could not start any afc workers, summing serially\n");
+    
+    for (i = 0; i < tree.count; i++) {
+        jobs[i].entry = &tree.entries[i];
+        if (tree.entries[i].type != AFC_ENTRY_FILE)
+            continue;
+        if (!pool || afc_pool_submit(pool, sum_job_run, &jobs[i]) != EXIT_SUCCESS)
+            sum_job_run(afc, &jobs[i]);
+    }
+    if (pool) {
+        afc_pool_wait(pool);
+        afc_pool_free(pool);
+    }
+    
+    int ret = EXIT_SUCCESS;
+    for (i = 0; i < tree.count; i++) {
+        if (tree.entries[i].type != AFC_ENTRY_FILE)
+            continue;
+        if (jobs[i].err == AFC_E_SUCCESS) {
+            printf("%s  %s\n", jobs[i].hex, tree.entries[i].path);
         } else {
-           
-            sprintf(newPath,"%s/%s",dst, path);
-            char *dir = dirname(path);
-            if (!fileExists(dir)) {
-                char sys[PATH_MAX];
-                sprintf(sys, "/bin/mkdir -p %s", dir);
-                system(sys);
+            fprintf(stderr, "Error: reading %s failed: %s\n", tree.entries[i].path, idev_afc_strerror(jobs[i].err));
+            ret = EXIT_FAILURE;
+        }
+    }
+    free(jobs);
+    afc_tree_free(&tree);
+    return ret;
+}
+
+int sum_afc_path(afc_client_t afc, const char *path) {
+    char hex[AFC_HASH_HEX_SIZE];
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    
+    afc_error_t err = afc_entry_stat(afc, &arena, path, &entry);
+    bool folder = (err == AFC_E_SUCCESS && entry.type == AFC_ENTRY_DIR);
+    uint64_t size = (err == AFC_E_SUCCESS) ? entry.size : 0;
+    afc_arena_free(&arena);
+    
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc get file info for %s failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    if (folder)
+        return sum_afc_folder(afc, path);
+    
+    err = sum_afc_file(afc, path, size, hex);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: reading %s failed: %s\n", path, idev_afc_strerror(err));
+        return EXIT_FAILURE;
+    }
+    printf("%s  %s\n", hex, path);
+    return EXIT_SUCCESS;
+}
+
+off_t fsize(const char *filename) {
+    struct stat st;
+    
+    if (stat(filename, &st) == 0)
+        return st.st_size;
+    
+    return -1;
+}
+
+/*
+ 
+ put --resume, keeps what an earlier upload left at dst when it is no longer than src and its
+ last block matches the same range of src. the handle is then open without truncation and the
+ upload goes on from afc_file_tell, anything else opens dst the usual way and starts over.
+ 
+ */
+
+static afc_error_t resume_remote_file(afc_client_t afc, const char *dst, afc_local_t *local, uint64_t fsize, uint64_t *handle) {
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    uint64_t have = 0;
+    if (afc_entry_stat(afc, &arena, dst, &entry) == AFC_E_SUCCESS && entry.type == AFC_ENTRY_FILE)
+        have = entry.size;
+    afc_arena_free(&arena);
+    
+    if (have == 0 || have > fsize)
+        return afc_file_open(afc, dst, AFC_FOPEN_WRONLY, handle);
+    
+    afc_error_t err = afc_file_open(afc, dst, AFC_FOPEN_RW, handle);
+    if (err != AFC_E_SUCCESS)
+        return err;
+    
+    bool match = false;
+    uint64_t position = 0;
+    if (afc_resume_check_tail(afc, *handle, local, have, &match) == AFC_E_SUCCESS && match &&
+        afc_file_tell(afc, *handle, &position) == AFC_E_SUCCESS && position == have &&
+        afc_local_seek(local, position) == EXIT_SUCCESS) {
+        printf("Resuming %s at %llu of %llu bytes\n", dst, (unsigned long long)position, (unsigned long long)fsize);
+        return AFC_E_SUCCESS;
+    }
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] the %llu bytes already at %s do not match, starting over\n", (unsigned long long)have, dst);
+    afc_file_close(afc, *handle);
+    return afc_file_open(afc, dst, AFC_FOPEN_WRONLY, handle);
+}
+
+/*
+ 
+ uploads src to dst. the remote file is sized to the local one before the first write so
+ the device can allocate it in one go, and trimmed back to what was actually sent if the
+ upload stops short. larger files are read ahead on a second thread (--io-buffers) while
+ the current block is on the wire. with --resume the remote file is not sized up front,
+ its length has to say how much of it an interrupted upload really got across.
+ 
+ a big file with connections > 1 is written in ranges over that many connections instead
+ (afcsegment), and the device has to report the full size afterwards. a device that takes
+ only one writer per file gets the single stream after all.
+ 
+ */
+
+static int upload_afc_file(afc_client_t afc, const char *src, const char *dst, bool progress, int connections) {
+    int ret=EXIT_FAILURE;
+    
+    uint64_t handle=0;
+    uint64_t fsize=0;
+    afc_local_t local;
+    afc_hash_t hash;
+    afc_hash_t *inflight = NULL;
+    if (afc_local_open(&local, src, &fsize) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error opening local file for reading: %s - %s\n", src, strerror(errno));
+        return ret;
+    }
+    
+    if (idev_verbose)
+        fprintf(stderr, "[debug] Uploading %s to %s - creating afc file connection\n", src, dst);
+    
+    afc_error_t err = (resumeTransfers) ? resume_remote_file(afc, dst, &local, fsize, &handle) : afc_file_open(afc, dst, AFC_FOPEN_WRONLY, &handle);
+    
+    if (err == AFC_E_SUCCESS) {
+        afc_xfer_t xfer;
+        int readErr = 0;
+        bool presized = (!resumeTransfers && fsize > 0 && afc_file_truncate(afc, handle, fsize) == AFC_E_SUCCESS);
+        transfer_progress_t bar = { strrchr(src, '/'), (off_t)fsize };
+        bar.name = (bar.name) ? bar.name + 1 : src;
+        
+        uint64_t totbytes = 0;
+        int used = 0;
+        double seconds = 0;
+        
+        if (presized && afc_segment_count(fsize, connections) > 1) {
+            err = afc_segment_upload(dst, &local, fsize, connections, (progress) ? transfer_progress : NULL, &bar, &readErr, &used, &seconds);
+            totbytes = local.offset;
+            if (used == 0 && err == AFC_E_OBJECT_BUSY)
+                fprintf(stderr, "Warning: the device takes only one writer on %s, uploading over one connection\n", dst);
+            else if (used == 0)
+                fprintf(stderr, "Warning: could not open any extra afc connections, uploading %s over one\n", dst);
+            if (used == 0)
+                afc_local_seek(&local, 0);
+        }
+        if (used == 0) {
+            // the mode comes from what is left, expected and offset are both absolute
+            afc_xfer_init(&xfer, fsize - local.offset);
+            xfer.expected = fsize;
+            xfer.offset = local.offset;
+            if (verifyTransfers && local.offset == 0) {
+                afc_hash_init(&hash, hashAlgo);
+                inflight = &hash;
             }
-            printf("copy file to new path: %s\n", newPath);
-            //copy the file!
-            uint64_t handle=0;
-            afc_error_t err = afc_file_open(afc, path, AFC_FOPEN_RDONLY, &handle);
-            
-            if (err == AFC_E_SUCCESS) {
-                
-                char *writeMode = write_mode_for_file(path);
-                
-                char buf[CHUNKSZ];
-                uint32_t bytes_read=0;
-                size_t totbytes=0;
-                
-                FILE *outf = fopen(newPath, writeMode);
-                if (outf) {
-                    while((err=afc_file_read(afc, handle, buf, CHUNKSZ, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
-                        totbytes += fwrite(buf, 1, bytes_read, outf);
-                        if (fsize > 0){
-                            loadBar(totbytes, fsize, 50,basename((char*)newPath));
-                        }
-                    }
-                    fclose(outf);
-                    if (err) {
-                        fprintf(stderr, "Error: Encountered error while reading %s: %s\n", path, idev_afc_strerror(err));
-                        fprintf(stderr, "Warning! - %lu bytes read - incomplete data in %s may have resulted.\n", totbytes, newPath);
-                    } else {
-                        printf("Saved %lu bytes to %s\n", totbytes, newPath);
-                        ret=EXIT_SUCCESS;
-                    }
-                    
-                } else {
-                    fprintf(stderr, "Error opening local file for writing: %s - %s\n", newPath, strerror(errno));
-                }
-                
-                afc_file_close(afc, handle);
-                // i assume you need to wait till afc_file_close to actually delete a file
-                 if (ret == EXIT_SUCCESS) {
-                    if (clean == true) {
-                        fprintf(stderr, "File cloned successfully, clearing original: %s\n", path);
-                        rm_file(afc, (char*)path);
-                    }
-                }
-                
-            } else {
-                fprintf(stderr, "Error: afc open file %s failed: %s\n", path, idev_afc_strerror(err));
+            xfer.hash = inflight;
+            err = afc_pipe_upload(afc, handle, &xfer, &local, (progress && fsize > 0) ? transfer_progress : NULL, &bar, &readErr);
+            totbytes = xfer.offset;
+            afc_xfer_report(&xfer, dst);
+            afc_xfer_free(&xfer);
+        } else if (!err && !readErr) {
+            // every range said it was done, the device has to agree before this counts
+            afc_arena_t arena = { NULL };
+            afc_entry_t entry;
+            afc_error_t statErr = afc_entry_stat(afc, &arena, dst, &entry);
+            if (statErr != AFC_E_SUCCESS || entry.size != fsize) {
+                fprintf(stderr, "Error: %s should be %llu bytes on the device but is %llu\n", dst, (unsigned long long)fsize, (statErr == AFC_E_SUCCESS) ? (unsigned long long)entry.size : 0ULL);
+                err = (statErr != AFC_E_SUCCESS) ? statErr : AFC_E_IO_ERROR;
             }
-            
+            afc_arena_free(&arena);
+        }
+        
+        if (presized && totbytes != fsize)
+            afc_file_truncate(afc, handle, totbytes);
+        
+        if (readErr) {
+            fprintf(stderr, "Error: reading %s failed: %s\n", src, strerror(readErr));
+            fprintf(stderr, "Warning! - %llu bytes read - incomplete data in %s may have resulted.\n", (unsigned long long)totbytes, dst);
+        } else if (err) {
+            fprintf(stderr, "Error: Encountered error while writing %s: %s\n", src, idev_afc_strerror(err));
+            fprintf(stderr, "Warning! - %llu bytes read - incomplete data in %s may have resulted.\n", (unsigned long long)totbytes, dst);
+        } else {
+            printf("Uploaded %llu bytes to %s\n", (unsigned long long)totbytes, dst);
+            if (used > 0 && seconds > 0)
+                printf("Written over %d connections in %.2fs, %.1f MB/s\n", used, seconds, totbytes / seconds / (1024 * 1024));
+            ret=EXIT_SUCCESS;
         }
+        
+        afc_file_close(afc, handle);
+        
+        // the handle is closed, what gets read back is what the device kept
+        if (ret == EXIT_SUCCESS && verifyTransfers)
+            ret = verify_transfer(afc, dst, src, true, inflight, NULL);
+    } else {
+        fprintf(stderr, "Error: afc open file %s failed: %s\n", src, idev_afc_strerror(err));
+    }
+    afc_local_close(&local);
+    
+    return ret;
+}
+
+int put_afc_path(afc_client_t afc, const char *src, const char *dst) {
+    return upload_afc_file(afc, src, dst, true, jobCount);
+}
+
+/*
+ 
+ sync-up and put -R. sync-up makes the remote folder dst look like the local folder src:
+ missing folders are created, a file is uploaded unless the device already has one of the
+ same size and mtime, and the uploaded file gets the local mtime so the next run can tell it
+ apart by listing alone. mtimes are compared to the second, windows and some filesystems keep
+ nothing finer. with --delete whatever is below dst on the device but not in src is removed.
+ 
+ put -R uploads everything without looking at the device first, no remote walk and no extra
+ request per file for the mtime. each folder comes up once in the scan, parents first, so
+ each one is created exactly once before anything goes into it.
+ 
+ */
+
+typedef struct sync_job_t {
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    uint64_t mtime;
+    bool stamp;             // set mtime on the device afterwards
+    char *uploaded;         // this file's slot in the outcome array
+} sync_job_t;
+
+static int sync_upload_file(afc_client_t afc, const char *src, const char *dst, uint64_t mtime, bool stamp) {
+    // one progress bar per worker would just scribble over each other
+    int ret = upload_afc_file(afc, src, dst, jobCount <= 1, 1);
+    if (ret == EXIT_SUCCESS && stamp) {
+        afc_error_t err = afc_set_file_time(afc, dst, mtime);
+        if (err != AFC_E_SUCCESS)
+            fprintf(stderr, "Warning: could not set the mtime of %s, it will be uploaded again next time: %s\n", dst, idev_afc_strerror(err));
+    }
+    return ret;
+}
+
+static int sync_job_run(afc_client_t afc, void *arg) {
+    sync_job_t *job = arg;
+    int ret = sync_upload_file(afc, job->src, job->dst, job->mtime, job->stamp);
+    *job->uploaded = (ret == EXIT_SUCCESS);
+    free(job);
+    return ret;
+}
+
+static int sync_remote_compare(const void *key, const void *entry) {
+    return afc_walk_path_compare(key, ((const afc_entry_t *)entry)->path);
+}
+
+static bool sync_same_file(const afc_entry_t *mine, const afc_entry_t *theirs) {
+    return theirs->type == AFC_ENTRY_FILE && theirs->size == mine->size &&
+           theirs->mtime / 1000000000ULL == mine->mtime / 1000000000ULL;
+}
+
+// "", "/", "/." and the like all name the top-level folder
+static bool remote_path_is_root(const char *path) {
+    while (*path) {
+        size_t len = strcspn(path, "/");
+        if (len > 2 || strspn(path, ".") < len)
+            return false;
+        path += len;
+        path += (*path == '/');
     }
-    return ret;
+    return true;
 }
 
-int export_shallow_folder(afc_client_t afc, const char *src, const char *dst) {
+static bool remote_is_folder(afc_client_t afc, const char *path) {
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    bool folder = (afc_entry_stat(afc, &arena, path, &entry) == AFC_E_SUCCESS && entry.type == AFC_ENTRY_DIR);
+    afc_arena_free(&arena);
+    return folder;
+}
+
+// dst and any missing parents, one request per level, a level that is already there is fine
+static afc_error_t make_remote_path(afc_client_t afc, const char *path) {
+    char partial[PATH_MAX];
+    afc_error_t err = AFC_E_SUCCESS;
+    size_t i, len = strlen(path);
+    
+    if (len >= PATH_MAX)
+        return AFC_E_INVALID_ARG;
+    for (i = 1; i <= len && (err == AFC_E_SUCCESS || err == AFC_E_OBJECT_EXISTS); i++) {
+        if (path[i] != '/' && path[i] != '\0')
+            continue;
+        memcpy(partial, path, i);
+        partial[i] = '\0';
+        err = afc_make_directory(afc, partial);
+    }
+    return err;
+}
+
+static int upload_tree(afc_client_t afc, const char *src, const char *dst, bool sync) {
     int ret=EXIT_FAILURE;
+    afc_tree_t local, remote;
+    char base[PATH_MAX];
+    size_t i;
     
     if (idev_verbose)
-        fprintf(stderr, "[debug] exporting %s to %s - creating afc file connection\n", src, dst);
+        fprintf(stderr, "[debug] %s %s to %s - creating afc file connection\n", (sync) ? "Syncing" : "Uploading", src, dst);
     
-    plist_t fileList = afc_list_path(afc, src, false);
-    int fileCount = plist_array_get_size(fileList);
+    if (sync && syncDelete && !syncDeleteRoot && remote_path_is_root(dst)) {
+        fprintf(stderr, "Error: sync-up --delete to the top-level folder removes everything on the device that is not in %s, use --delete-root for that\n", src);
+        return ret;
+    }
     
-    if (idev_verbose)
-        printf("fileCount: %i\n", fileCount);
-    
-    int i;
-    
-    for (i = 0; i < fileCount; i++) {
-        char *path = NULL;
-        plist_t item = plist_array_get_item(fileList, i);
-        plist_t path_node = plist_dict_get_item(item, "path");
-        plist_t fmt_node = plist_dict_get_item(item, "st_ifmt");
-        char *fmt = NULL;
-        char *size = NULL;
-        plist_get_string_val(plist_dict_get_item(item, "st_size"), &size);
-        long fsize = atol(size);
-        plist_get_string_val(fmt_node, &fmt);
-        plist_get_string_val(path_node, &path);
-        char newPath[PATH_MAX];
+    if (afc_scan(src, &local) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: could not read %s: %s\n", src, strerror(errno));
+        return ret;
+    }
+    
+    // remote paths of the walk are dst + "/" + the local relative path
+    snprintf(base, PATH_MAX, "%s", dst);
+    size_t baseLen = strlen(base);
+    while (baseLen > 0 && base[baseLen-1] == '/')
+        base[--baseLen] = '\0';
+    
+    afc_error_t err = AFC_E_OBJECT_NOT_FOUND;
+    if (sync)
+        err = afc_walk(afc, (baseLen) ? base : "/", AFC_WALK_RECURSIVE | AFC_WALK_DIRS, jobCount, &remote);
+    if (err == AFC_E_OBJECT_NOT_FOUND) {
+        memset(&remote, 0, sizeof(afc_tree_t));
+        err = (baseLen) ? make_remote_path(afc, base) : AFC_E_SUCCESS;
+        if (err == AFC_E_SUCCESS && baseLen)
+            printf("mkdir at remote path: %s\n", base);
+        else if (err == AFC_E_OBJECT_EXISTS && !sync)
+            err = AFC_E_SUCCESS;
+    }
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", dst, idev_afc_strerror(err));
+        afc_tree_free(&local);
+        return ret;
+    }
+    
+    char *seen = calloc(remote.count ? remote.count : 1, 1);
+    char *uploaded = calloc(local.count ? local.count : 1, 1);
+    if (!seen || !uploaded) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(seen);
+        free(uploaded);
+        afc_tree_free(&local);
+        afc_tree_free(&remote);
+        return ret;
+    }
+    
+    // same as clone, folders are made here in order before any file inside goes out to a worker
+    afc_pool_t *pool = NULL;
+    if (jobCount > 1) {
+        pool = afc_pool_new(jobCount);
+        if (pool)
+            afc_pool_set_depth(pool, afc_pool_size(pool) * CLONE_QUEUE_DEPTH);    // a job is two PATH_MAX paths
+        else
+            fprintf(stderr, "Warning: could not start any afc workers, uploading serially\n");
+    }
+    
+    int skipped = 0, created = 0, failed = 0, deleted = 0, attempted = 0, uploadedCount = 0;
+    for (i = 0; i < local.count; i++) {
+        const afc_entry_t *item = &local.entries[i];
+        char srcPath[PATH_MAX], dstPath[PATH_MAX];
+        snprintf(srcPath, PATH_MAX, "%s/%s", src, item->path);
+        snprintf(dstPath, PATH_MAX, "%s/%s", base, item->path);
         
-        if (strcmp(fmt, "S_IFDIR") != 0) {
-            sprintf(newPath,"%s/%s",dst, basename(path));
-            printf("copy file to new path: %s\n", newPath);
-            //copy the file!
-            uint64_t handle=0;
-            afc_error_t err = afc_file_open(afc, path, AFC_FOPEN_RDONLY, &handle);
-            
-            if (err == AFC_E_SUCCESS) {
-                
-                char *writeMode = write_mode_for_file(path);
-                char buf[CHUNKSZ];
-                uint32_t bytes_read=0;
-                size_t totbytes=0;
-                
-                FILE *outf = fopen(newPath, writeMode);
-                if (outf) {
-                    while((err=afc_file_read(afc, handle, buf, CHUNKSZ, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
-                        totbytes += fwrite(buf, 1, bytes_read, outf);
-                        if (fsize > 0){
-                            loadBar(totbytes, fsize, 50,basename((char*)src));
-                        }
-                    }
-                    fclose(outf);
-                    if (err) {
-                        fprintf(stderr, "Error: Encountered error while reading %s: %s\n", path, idev_afc_strerror(err));
-                        fprintf(stderr, "Warning! - %lu bytes read - incomplete data in %s may have resulted.\n", totbytes, newPath);
-                    } else {
-                        printf("Saved %lu bytes to %s\n", totbytes, newPath);
-                        ret=EXIT_SUCCESS;
-                    }
-                    
+        const afc_entry_t *theirs = (remote.count == 0) ? NULL : bsearch(dstPath, remote.entries, remote.count, sizeof(afc_entry_t), sync_remote_compare);
+        if (theirs)
+            seen[theirs - remote.entries] = 1;
+        if (item->unread) {
+            // its contents are unknown, not missing. nothing below it is deleted
+            size_t j, len = strlen(dstPath);
+            for (j = (theirs) ? (size_t)(theirs - remote.entries) + 1 : remote.count; j < remote.count && !strncmp(remote.entries[j].path, dstPath, len) && remote.entries[j].path[len] == '/'; j++)
+                seen[j] = 1;
+            failed++;
+        }
+        
+        if (item->type == AFC_ENTRY_DIR) {
+            if (theirs && theirs->type == AFC_ENTRY_DIR)
+                continue;
+            err = (theirs) ? AFC_E_OBJECT_EXISTS : afc_make_directory(afc, dstPath);
+            if (err == AFC_E_OBJECT_EXISTS && !sync && remote_is_folder(afc, dstPath))
+                continue;   // put -R didn't look, a folder that is already there is fine
+            if (err == AFC_E_OBJECT_EXISTS && sync && syncDelete) {
+                // a file where the folder goes, it is an extra like any other
+                err = afc_remove_path(afc, dstPath);
+                if (err == AFC_E_SUCCESS) {
+                    printf("Removed: %s\n", dstPath);
+                    deleted++;
+                    err = afc_make_directory(afc, dstPath);
                 } else {
-                    fprintf(stderr, "Error opening local file for writing: %s - %s\n", newPath, strerror(errno));
+                    fprintf(stderr, "Error: could not remove %s: %s\n", dstPath, idev_afc_strerror(err));
                 }
-                
-                afc_file_close(afc, handle);
-                /*
-                 
-                 i assume you need to wait till afc_file_close to actually delete a file
-                 
-                 TODO: make it so if we are done with a folder and it is empty, we clear it out!
-                 
-                 */
-                if (ret == EXIT_SUCCESS) {
-                    if (clean == true) {
-                        fprintf(stderr, "File cloned successfully, clearing original: %s\n", path);
-                        rm_file(afc, (char*)path);
-                    }
-                }
-                
+            }
+            if (err == AFC_E_SUCCESS) {
+                printf("mkdir at remote path: %s\n", dstPath);
+                created++;
+                continue;
+            }
+            if (err == AFC_E_OBJECT_EXISTS)
+                fprintf(stderr, "Error: %s is a file on the device, not uploading %s or anything in it%s\n", dstPath, srcPath, (sync) ? " (--delete replaces it)" : "");
+            else
+                fprintf(stderr, "Error: mkdir %s failed, not uploading anything in %s: %s\n", dstPath, srcPath, idev_afc_strerror(err));
+            failed++;
+            // one error for the folder, not one more for every file below it
+            size_t len = strlen(item->path);
+            while (i + 1 < local.count && !strncmp(local.entries[i+1].path, item->path, len) && local.entries[i+1].path[len] == '/')
+                i++;
+        } else if (theirs && sync_same_file(item, theirs)) {
+            if (idev_verbose)
+                fprintf(stderr, "[debug] unchanged, skipping %s\n", dstPath);
+            skipped++;
+        } else if (theirs && theirs->type == AFC_ENTRY_DIR) {
+            fprintf(stderr, "Error: %s is a folder on the device, not uploading %s\n", dstPath, srcPath);
+            failed++;
+        } else {
+            printf("copy file to remote path: %s\n", dstPath);
+            attempted++;
+            sync_job_t *job = NULL;
+            if (pool && (job = calloc(1, sizeof(sync_job_t)))) {
+                strncpy(job->src, srcPath, PATH_MAX-1);
+                strncpy(job->dst, dstPath, PATH_MAX-1);
+                job->mtime = item->mtime;
+                job->stamp = sync;
+                job->uploaded = &uploaded[i];
+                if (afc_pool_submit(pool, sync_job_run, job) != EXIT_SUCCESS)
+                    sync_job_run(afc, job);
             } else {
-                fprintf(stderr, "Error: afc open file %s failed: %s\n", path, idev_afc_strerror(err));
+                uploaded[i] = (sync_upload_file(afc, srcPath, dstPath, item->mtime, sync) == EXIT_SUCCESS);
             }
-            
         }
     }
+    
+    if (pool) {
+        afc_pool_wait(pool);
+        afc_pool_free(pool);
+    }
+    for (i = 0; i < local.count; i++)
+        uploadedCount += uploaded[i];
+    failed += attempted - uploadedCount;
+    
+    // backwards, so a folder's contents are gone before the folder itself
+    for (i = remote.count; sync && syncDelete && i-- > 0; ) {
+        const afc_entry_t *extra = &remote.entries[i];
+        if (seen[i] || strncmp(extra->path, base, baseLen) != 0 || extra->path[baseLen] != '/' || extra->path[baseLen+1] == '\0')
+            continue;
+        err = afc_remove_path(afc, extra->path);
+        if (err == AFC_E_SUCCESS) {
+            printf("Removed: %s\n", extra->path);
+            deleted++;
+        } else {
+            fprintf(stderr, "Error: could not remove %s: %s\n", extra->path, idev_afc_strerror(err));
+            failed++;
+        }
+    }
+    
+    if (sync)
+        printf("sync-up: %d uploaded, %d skipped, %d folders created, %d deleted, %d failed\n", uploadedCount, skipped, created, deleted, failed);
+    else
+        printf("put: %d uploaded, %d folders created, %d failed\n", uploadedCount, created, failed);
+    if (failed == 0)
+        ret = EXIT_SUCCESS;
+    
+    free(seen);
+    free(uploaded);
+    afc_tree_free(&local);
+    afc_tree_free(&remote);
     return ret;
 }
 
-//if theres ever a need just to grab a single file and not do a whole clone, this can be used.
+int sync_up_path(afc_client_t afc, const char *src, const char *dst) {
+    return upload_tree(afc, src, dst, true);
+}
 
-int get_afc_path(afc_client_t afc, const char *src, const char *dst) {
-    int ret=EXIT_FAILURE;
-    
-    if (idev_verbose)
-        fprintf(stderr, "[debug] Downloading %s to %s - creating afc file connection\n", src, dst);
-    
-    uint64_t handle=0;
-    plist_t *node = afc_file_info_for_path(afc, src);
-    off_t fsize = 0;
-    if (node){
-        char *size = NULL;
-        plist_get_string_val(plist_dict_get_item(node, "st_size"), &size);
-        fsize = atol(size);
+int put_tree_path(afc_client_t afc, const char *src, const char *dst) {
+    return upload_tree(afc, src, dst, false);
+}
+
+/*
+ 
+ put --tar, clone --tar the other way around: the members of one archive (a file or stdin)
+ are made below dst on the device as they are read, nothing is extracted locally. a folder
+ is made when it comes up, a member whose folder has no entry of its own gets its parents
+ made first. file data goes from the archive's read buffer straight into afc_file_write.
+ with -j N a file of up to TAR_MEMORY_FILE is copied out and handed to a worker on its own
+ connection while the archive reads on. a larger one is written on this connection, the
+ archive can only be read in order. hardlinks wait until every file is up since their
+ target may still be with a worker, and folder mtimes come last since writing into a
+ folder changes its mtime.
+ 
+ */
+
+typedef struct tar_put_t {
+    afc_pool_t *pool;
+    pthread_mutex_t lock;       // the counts, workers report into them
+    int uploaded;
+    int failed;
+    uint64_t bytes;
+} tar_put_t;
+
+typedef struct tar_put_job_t {
+    tar_put_t *put;
+    char dst[PATH_MAX];
+    char *data;
+    uint64_t size;
+    uint64_t mtime;
+} tar_put_job_t;
+
+// a member's data onto the device, from data when it is in memory, otherwise straight out of the archive
+static int tar_put_file(afc_client_t afc, const char *dst, afc_untar_t *untar, const char *data, uint64_t size, uint64_t mtime, int *readErr) {
+    uint64_t handle = 0, sent = 0;
+    uint32_t written = 0;
+    afc_xfer_t xfer;
+    
+    afc_error_t err = afc_file_open(afc, dst, AFC_FOPEN_WRONLY, &handle);
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: afc open file %s failed: %s\n", dst, idev_afc_strerror(err));
+        return EXIT_FAILURE;
     }
-    afc_error_t err = afc_file_open(afc, src, AFC_FOPEN_RDONLY, &handle);
     
-    if (err == AFC_E_SUCCESS) {
-        char buf[CHUNKSZ];
-        uint32_t bytes_read=0;
-        size_t totbytes=0;
-        char *writeMode = write_mode_for_file((char*)src);
-        FILE *outf = fopen(dst, writeMode);
-        if (outf) {
-            while((err=afc_file_read(afc, handle, buf, CHUNKSZ, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
-                totbytes += fwrite(buf, 1, bytes_read, outf);
-                if (fsize > 0){
-                    loadBar(totbytes, fsize, 50,basename((char*)src));
-                }
-            }
-            fclose(outf);
-            if (err) {
-                fprintf(stderr, "Error: Encountered error while reading %s: %s\n", src, idev_afc_strerror(err));
-                fprintf(stderr, "Warning! - %lu bytes read - incomplete data in %s may have resulted.\n", totbytes, dst);
-            } else {
-                printf("Saved %lu bytes to %s\n", totbytes, dst);
-                ret=EXIT_SUCCESS;
+    afc_xfer_init(&xfer, size);
+    if (data) {
+        err = afc_xfer_write(afc, handle, &xfer, data, (uint32_t)size, &written);
+        sent = written;
+    } else {
+        const char *piece;
+        size_t length;
+        while (err == AFC_E_SUCCESS && sent < size) {
+            if (afc_untar_read(untar, &piece, &length) != EXIT_SUCCESS) {
+                *readErr = errno;
+                break;
             }
-            
-        } else {
-            fprintf(stderr, "Error opening local file for writing: %s - %s\n", dst, strerror(errno));
+            err = afc_xfer_write(afc, handle, &xfer, piece, (uint32_t)length, &written);
+            sent += written;
         }
-        afc_file_close(afc, handle);
+    }
+    afc_xfer_free(&xfer);
+    afc_file_close(afc, handle);
+    
+    if (*readErr) {
+        fprintf(stderr, "Warning! - %llu bytes read - incomplete data in %s may have resulted.\n", (unsigned long long)sent, dst);
+        return EXIT_FAILURE;
+    }
+    if (err != AFC_E_SUCCESS) {
+        fprintf(stderr, "Error: Encountered error while writing %s: %s\n", dst, idev_afc_strerror(err));
+        fprintf(stderr, "Warning! - %llu bytes read - incomplete data in %s may have resulted.\n", (unsigned long long)sent, dst);
+        return EXIT_FAILURE;
+    }
+    err = afc_set_file_time(afc, dst, mtime);
+    if (err != AFC_E_SUCCESS)
+        fprintf(stderr, "Warning: could not set the mtime of %s: %s\n", dst, idev_afc_strerror(err));
+    return EXIT_SUCCESS;
+}
+
+static int tar_put_job_run(afc_client_t afc, void *arg) {
+    tar_put_job_t *job = arg;
+    int readErr = 0;
+    int ret = tar_put_file(afc, job->dst, NULL, job->data, job->size, job->mtime, &readErr);
+    
+    pthread_mutex_lock(&job->put->lock);
+    if (ret == EXIT_SUCCESS) {
+        job->put->uploaded++;
+        job->put->bytes += job->size;
     } else {
-        fprintf(stderr, "Error: afc open file %s failed: %s\n", src, idev_afc_strerror(err));
-        //this is a little non standard for a return value, trying to make things easier for cross platform
-        //detection of whether or not the device is currently "locked"
-        ret = err;
+        job->put->failed++;
     }
+    pthread_mutex_unlock(&job->put->lock);
+    free(job->data);
+    free(job);
     return ret;
 }
 
-off_t fsize(const char *filename) {
-    struct stat st;
-    
-    if (stat(filename, &st) == 0)
-        return st.st_size;
+// copies a small member out of the archive for a worker, false leaves it to be streamed here (or readErr set)
+static bool tar_put_submit(tar_put_t *put, afc_client_t afc, afc_untar_t *untar, const char *dst, const afc_tar_member_t *member, int *readErr) {
+    tar_put_job_t *job = calloc(1, sizeof(tar_put_job_t));
+    if (job)
+        job->data = malloc(member->size ? member->size : 1);
+    if (!job || !job->data) {
+        free(job);
+        return false;
+    }
     
-    return -1;
+    // the read buffer moves on with the archive, the worker gets its own copy
+    const char *piece;
+    size_t length;
+    while (job->size < member->size) {
+        if (afc_untar_read(untar, &piece, &length) != EXIT_SUCCESS) {
+            *readErr = errno;
+            pthread_mutex_lock(&put->lock);
+            put->failed++;
+            pthread_mutex_unlock(&put->lock);
+            free(job->data);
+            free(job);
+            return true;
+        }
+        memcpy(job->data + job->size, piece, length);
+        job->size += length;
+    }
+    job->put = put;
+    strncpy(job->dst, dst, PATH_MAX-1);
+    job->mtime = member->mtime;
+    if (afc_pool_submit(put->pool, tar_put_job_run, job) != EXIT_SUCCESS)
+        tar_put_job_run(afc, job);
+    return true;
 }
 
-int put_afc_path(afc_client_t afc, const char *src, const char *dst) {
+// no ".." anywhere, a member can't land outside dst
+static bool tar_put_inside(const char *name) {
+    const char *p = name;
+    
+    while (*p) {
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.')
+            return false;
+        p += len;
+        while (*p == '/')
+            p++;
+    }
+    return true;
+}
+
+// the member's folder, unless it is the last one made or one of its parents
+static afc_error_t tar_put_parent(afc_client_t afc, const char *path, char *made) {
+    char parent[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    
+    if (!slash || slash == path)
+        return AFC_E_SUCCESS;
+    snprintf(parent, PATH_MAX, "%.*s", (int)(slash - path), path);
+    size_t len = strlen(parent);
+    if (!strncmp(made, parent, len) && (made[len] == '\0' || made[len] == '/'))
+        return AFC_E_SUCCESS;
+    
+    afc_error_t err = make_remote_path(afc, parent);
+    if (err == AFC_E_SUCCESS || err == AFC_E_OBJECT_EXISTS) {
+        strcpy(made, parent);
+        err = AFC_E_SUCCESS;
+    }
+    return err;
+}
+
+// afc won't make a link over something that is there, tar replaces it
+static afc_error_t tar_put_link(afc_client_t afc, afc_link_type_t type, const char *target, const char *path) {
+    afc_error_t err = afc_make_link(afc, type, target, path);
+    if (err == AFC_E_OBJECT_EXISTS && afc_remove_path(afc, path) == AFC_E_SUCCESS)
+        err = afc_make_link(afc, type, target, path);
+    return err;
+}
+
+// children before their parents, the reverse of a walk
+static int tar_put_symlink_compare(const void *a, const void *b) {
+    return afc_walk_path_compare(((const afc_entry_t *)b)->path, ((const afc_entry_t *)a)->path);
+}
+
+// folders for their mtime and links, all done after everything else
+static int tar_put_defer(afc_entry_t **later, size_t *count, afc_arena_t *arena, const char *path, const char *link, uint64_t mtime) {
+    if ((*count & (*count + 1)) == 0 || *count == 0) {
+        afc_entry_t *grown = realloc(*later, (*count * 2 + 1) * sizeof(afc_entry_t));
+        if (!grown)
+            return EXIT_FAILURE;
+        *later = grown;
+    }
+    afc_entry_t *entry = &(*later)[*count];
+    memset(entry, 0, sizeof(afc_entry_t));
+    entry->type = (link) ? AFC_ENTRY_LINK : AFC_ENTRY_DIR;
+    entry->path = afc_arena_strdup(arena, path);
+    entry->link = (link) ? afc_arena_strdup(arena, link) : NULL;
+    entry->mtime = mtime;
+    if (!entry->path || (link && !entry->link))
+        return EXIT_FAILURE;
+    (*count)++;
+    return EXIT_SUCCESS;
+}
+
+int put_tar_path(afc_client_t afc, const char *src, const char *dst) {
     int ret=EXIT_FAILURE;
+    afc_untar_t untar;
+    afc_tar_member_t member;
+    tar_put_t put;
+    char base[PATH_MAX];
+    char made[PATH_MAX] = "";
+    afc_entry_t *later = NULL, *symlinks = NULL;
+    size_t laterCount = 0, symlinkCount = 0, i;
+    afc_arena_t arena = { NULL };
+    int created = 0, links = 0, skipped = 0, readErr = 0, next;
     
-    uint64_t handle=0;
-    struct stat st;
-    off_t fsize = 0;
-    if (stat(src, &st) == 0) {
-        fsize = st.st_size;
+    if (idev_verbose)
+        fprintf(stderr, "[debug] Uploading the members of %s to %s - creating afc file connection\n", src, (dst[0]) ? dst : "/");
+    
+    if (afc_untar_open(&untar, src) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error opening local file for reading: %s - %s\n", src, strerror(errno));
+        return ret;
     }
-    FILE *inf = fopen(src, "r");
-    if (inf) {
-        if (idev_verbose)
-            fprintf(stderr, "[debug] Uploading %s to %s - creating afc file connection\n", src, dst);
+    
+    snprintf(base, PATH_MAX, "%s", dst);
+    size_t baseLen = strlen(base);
+    while (baseLen > 0 && base[baseLen-1] == '/')
+        base[--baseLen] = '\0';
+    if (baseLen) {
+        afc_error_t err = make_remote_path(afc, base);
+        if (err != AFC_E_SUCCESS && err != AFC_E_OBJECT_EXISTS) {
+            fprintf(stderr, "Error: mkdir %s failed: %s\n", base, idev_afc_strerror(err));
+            afc_untar_close(&untar);
+            return ret;
+        }
+        strcpy(made, base);
+    }
+    
+    memset(&put, 0, sizeof(tar_put_t));
+    pthread_mutex_init(&put.lock, NULL);
+    if (jobCount > 1) {
+        put.pool = afc_pool_new(jobCount);
+        if (put.pool)
+            afc_pool_set_depth(put.pool, afc_pool_size(put.pool) * CLONE_QUEUE_DEPTH);
+        else
+            fprintf(stderr, "Warning: could not start any afc workers, uploading serially\n");
+    }
+    
+    while ((next = afc_untar_next(&untar, &member)) == 1) {
+        char dstPath[PATH_MAX];
         
-        afc_error_t err = afc_file_open(afc, dst, AFC_FOPEN_WRONLY, &handle);
+        if (member.name[0] == '\0')
+            continue;   // "./", dst itself
+        if (!tar_put_inside(member.name) || (member.type == AFC_TAR_HARDLINK && !tar_put_inside(member.link))) {
+            fprintf(stderr, "Warning: skipping %s, it points outside of %s\n", member.name, src);
+            skipped++;
+            continue;
+        }
+        if (member.type == AFC_TAR_OTHER) {
+            fprintf(stderr, "Warning: skipping %s, afc can only make files, folders and links\n", member.name);
+            skipped++;
+            continue;
+        }
+        snprintf(dstPath, PATH_MAX, "%s%s%s", base, (baseLen) ? "/" : "", member.name);
         
-        if (err == AFC_E_SUCCESS) {
-            char buf[CHUNKSZ];
-            size_t bytes_read=0;
-            size_t totbytes=0;
-            
-            while(err==AFC_E_SUCCESS && (bytes_read=fread(buf, 1, CHUNKSZ, inf)) > 0) {
-                uint32_t bytes_written=0;
-                err=afc_file_write(afc, handle, buf, (uint32_t)bytes_read, &bytes_written);
-                totbytes += bytes_written;
-                loadBar(totbytes, fsize, 50,basename((char*)src));
+        afc_error_t err = tar_put_parent(afc, dstPath, made);
+        if (err != AFC_E_SUCCESS) {
+            fprintf(stderr, "Error: mkdir for %s failed: %s\n", dstPath, idev_afc_strerror(err));
+            put.failed++;
+            continue;
+        }
+        
+        if (member.type == AFC_TAR_DIR) {
+            err = afc_make_directory(afc, dstPath);
+            if (err == AFC_E_SUCCESS) {
+                printf("mkdir at remote path: %s\n", dstPath);
+                created++;
             }
-            
-            if (err) {
-                fprintf(stderr, "Error: Encountered error while writing %s: %s\n", src, idev_afc_strerror(err));
-                fprintf(stderr, "Warning! - %lu bytes read - incomplete data in %s may have resulted.\n", totbytes, dst);
+            if (err == AFC_E_SUCCESS || err == AFC_E_OBJECT_EXISTS) {
+                snprintf(made, PATH_MAX, "%s", dstPath);
+                if (tar_put_defer(&later, &laterCount, &arena, dstPath, NULL, member.mtime) != EXIT_SUCCESS)
+                    fprintf(stderr, "Warning: out of memory, not setting the mtime of %s\n", dstPath);
             } else {
-                printf("Uploaded %lu bytes to %s\n", totbytes, dst);
-                ret=EXIT_SUCCESS;
+                fprintf(stderr, "Error: mkdir %s failed: %s\n", dstPath, idev_afc_strerror(err));
+                put.failed++;
             }
-            
-            afc_file_close(afc, handle);
+        } else if (member.type == AFC_TAR_SYMLINK) {
+            // made last, a later "link/x" member must not be written through it
+            if (tar_put_defer(&symlinks, &symlinkCount, &arena, dstPath, member.link, 0) != EXIT_SUCCESS) {
+                fprintf(stderr, "Error: out of memory, not linking %s\n", dstPath);
+                put.failed++;
+            }
+        } else if (member.type == AFC_TAR_HARDLINK) {
+            char target[PATH_MAX];
+            snprintf(target, PATH_MAX, "%s%s%s", base, (baseLen) ? "/" : "", member.link);
+            if (tar_put_defer(&later, &laterCount, &arena, dstPath, target, 0) != EXIT_SUCCESS) {
+                fprintf(stderr, "Error: out of memory, not linking %s\n", dstPath);
+                put.failed++;
+            }
+        } else {
+            printf("copy file to remote path: %s\n", dstPath);
+            bool handedOff = (put.pool && member.size <= TAR_MEMORY_FILE && tar_put_submit(&put, afc, &untar, dstPath, &member, &readErr));
+            if (!handedOff) {
+                int uploaded = tar_put_file(afc, dstPath, &untar, NULL, member.size, member.mtime, &readErr);
+                pthread_mutex_lock(&put.lock);
+                if (uploaded == EXIT_SUCCESS) {
+                    put.uploaded++;
+                    put.bytes += member.size;
+                } else {
+                    put.failed++;
+                }
+                pthread_mutex_unlock(&put.lock);
+            }
+            if (readErr)
+                break;
+        }
+    }
+    if (next < 0 && !readErr)
+        readErr = errno;
+    
+    if (put.pool) {
+        afc_pool_wait(put.pool);
+        afc_pool_free(put.pool);
+    }
+    
+    for (i = 0; i < laterCount; i++) {
+        const afc_entry_t *entry = &later[i];
+        if (entry->type != AFC_ENTRY_LINK)
+            continue;
+        afc_error_t err = tar_put_link(afc, AFC_HARDLINK, entry->link, entry->path);
+        if (err == AFC_E_SUCCESS) {
+            links++;
         } else {
-            fprintf(stderr, "Error: afc open file %s failed: %s\n", src, idev_afc_strerror(err));
+            fprintf(stderr, "Error: link %s -> %s - %s\n", entry->path, entry->link, idev_afc_strerror(err));
+            put.failed++;
         }
-        fclose(inf);
-    } else {
-        fprintf(stderr, "Error opening local file for reading: %s - %s\n", dst, strerror(errno));
     }
+    // symlinks after files and hardlinks, inner ones first. with "link" and "link/x" in one archive,
+    // "link" is a real folder by then that afc won't replace, nothing is written through the symlink
+    if (symlinkCount > 1)
+        qsort(symlinks, symlinkCount, sizeof(afc_entry_t), tar_put_symlink_compare);
+    for (i = 0; i < symlinkCount; i++) {
+        const afc_entry_t *entry = &symlinks[i];
+        afc_error_t err = tar_put_link(afc, AFC_SYMLINK, entry->link, entry->path);
+        if (err == AFC_E_SUCCESS) {
+            links++;
+        } else {
+            fprintf(stderr, "Error: link %s -> %s - %s\n", entry->path, entry->link, idev_afc_strerror(err));
+            put.failed++;
+        }
+    }
+    // backwards, a folder's mtime is set after the ones inside it
+    for (i = laterCount; i-- > 0; ) {
+        const afc_entry_t *entry = &later[i];
+        if (entry->type != AFC_ENTRY_DIR)
+            continue;
+        afc_error_t err = afc_set_file_time(afc, entry->path, entry->mtime);
+        if (err != AFC_E_SUCCESS)
+            fprintf(stderr, "Warning: could not set the mtime of %s: %s\n", entry->path, idev_afc_strerror(err));
+    }
+    
+    if (readErr)
+        fprintf(stderr, "Error: reading %s failed at byte %llu: %s\n", src, (unsigned long long)untar.offset, (readErr == EINVAL) ? "truncated or damaged archive" : strerror(readErr));
+    printf("put: %d uploaded, %d folders created, %d links, %d skipped, %d failed\n", put.uploaded, created, links, skipped, put.failed);
+    if (put.failed == 0 && !readErr)
+        ret = EXIT_SUCCESS;
     
+    free(later);
+    free(symlinks);
+    afc_arena_free(&arena);
+    pthread_mutex_destroy(&put.lock);
+    afc_untar_close(&untar);
     return ret;
 }
 
@@ -800,7 +2676,14 @@ int put_afc_path(afc_client_t afc, const char *src, const char *dst) {
 
 int do_info(afc_client_t afc, int argc, char **argv) {
     int i, ret = EXIT_SUCCESS;
-    if (argc > 1) {
+    if (argc > 1 && afc_out_is_records(outputFormat)) {
+        afc_out_t out;
+        afc_out_begin(&out, outputFormat, stdout);
+        for (i=1; i<argc ; i++) {
+            ret |= record_afc_file_info(afc, argv[i], &out);
+        }
+        ret |= afc_out_end(&out);
+    } else if (argc > 1) {
         for (i=1; i<argc ; i++) {
             ret |= dump_afc_file_info(afc, argv[i]);
         }
@@ -814,7 +2697,18 @@ int do_info(afc_client_t afc, int argc, char **argv) {
 
 int do_list(afc_client_t afc, int argc, char **argv) {
     int i, ret = EXIT_SUCCESS;
-    if (argc > 1) {
+    if (afc_out_is_records(outputFormat)) {
+        afc_out_t out;
+        afc_out_begin(&out, outputFormat, stdout);
+        if (argc > 1) {
+            for (i=1; i<argc ; i++) {
+                ret |= record_afc_list_path(afc, argv[i], recursiveList, &out);
+            }
+        } else {
+            ret = record_afc_list_path(afc, "", recursiveList, &out);
+        }
+        ret |= afc_out_end(&out);
+    } else if (argc > 1) {
         for (i=1; i<argc ; i++) {
             ret |= dump_afc_list_path(afc, argv[i]);
         }
@@ -957,6 +2851,18 @@ int do_cat(afc_client_t afc, int argc, char **argv) {
     return ret;
 }
 
+int do_sum(afc_client_t afc, int argc, char **argv) {
+    int ret=EXIT_SUCCESS;
+    
+    if (argc < 2) {
+        fprintf(stderr, "Error: sum takes at least one remote path\n");
+        return EXIT_FAILURE;
+    }
+    for (int i=1; i<argc; i++)
+        ret |= sum_afc_path(afc, argv[i]);
+    return ret;
+}
+
 int do_get(afc_client_t afc, int argc, char **argv) {
     int ret=EXIT_FAILURE;
     
@@ -969,7 +2875,7 @@ int do_get(afc_client_t afc, int argc, char **argv) {
             snprintf(dpath, PATH_MAX-1, "%s/%s", dst, basename(argv[1]));
             dst = dpath;
         }
-        ret = get_afc_path(afc, argv[1], dpath);
+        ret = get_afc_path(afc, argv[1], dst);
     } else {
         fprintf(stderr, "Error: invalid number of arguments for get command.\n");
     }
@@ -978,23 +2884,47 @@ int do_get(afc_client_t afc, int argc, char **argv) {
 }
 
 int do_puts(afc_client_t afc, int argc, char **argv) {
-    int ret=EXIT_FAILURE;
+    int ret=EXIT_SUCCESS;
     for (int i=1; i<argc ; i++) {
         printf("processing %s\n", argv[i]);
-        ret |= put_afc_path(afc, argv[i], basename(argv[1]));
+        ret |= put_afc_path(afc, argv[i], basename(argv[i]));
     }
     return ret;
 }
 
 int do_put(afc_client_t afc, int argc, char **argv) {
     int ret=EXIT_FAILURE;
+    bool recursive = recursiveList;
     
-    if (argc == 2) {
+    // getopt only sees a -R after the command where it reorders argv (glibc), the usage promises it everywhere
+    if (argc > 1 && !strcmp(argv[1], "-R")) {
+        recursive = true;
+        argc--;
+        argv++;
+    }
+    
+    if (tarPath) {
+        if (recursive || resumeTransfers || verifyTransfers) {
+            fprintf(stderr, "Error: put --tar can't be combined with -R, --resume or --verify\n");
+        } else if (argc <= 2) {
+            ret = put_tar_path(afc, tarPath, (argc == 2) ? argv[1] : "");
+        } else {
+            fprintf(stderr, "Error: put --tar takes at most a remote path, the archive comes from --tar\n");
+        }
+    } else if (recursive) {
+        if (argc == 2) {
+            ret = put_tree_path(afc, argv[1], basename(argv[1]));
+        } else if (argc == 3) {
+            ret = put_tree_path(afc, argv[1], argv[2]);
+        } else {
+            fprintf(stderr, "Error: put -R takes a local folder and optionally a remote path\n");
+        }
+    } else if (argc == 2) {
         ret = put_afc_path(afc, argv[1], basename(argv[1]));
     } else if (argc == 3) {
         ret = put_afc_path(afc, argv[1], argv[2]);
     } else if (argc > 3){
-        do_puts(afc, argc, argv);
+        ret = do_puts(afc, argc, argv);
     }
     
     return ret;
@@ -1010,6 +2940,14 @@ int list_devices(FILE *outf) {
         return -1;
     }
     
+    if (afc_out_is_records(outputFormat)) {
+        afc_out_t out;
+        afc_out_begin(&out, outputFormat, outf);
+        devices_to_records(devices, counts, &out);
+        free(devices);
+        return afc_out_end(&out);
+    }
+    
     char *xmlData = devices_to_xml(devices, counts);
     fprintf(outf, "%s\n", xmlData);
     free(devices);
@@ -1018,12 +2956,15 @@ int list_devices(FILE *outf) {
 
 
 int recursive_document_list(afc_client_t afc, FILE *outf) {
-    plist_t *documentList = afc_list_path(afc, "Documents", true);
-    char *xmlData = NULL;
-    uint32_t length = 0;
-    plist_to_xml(documentList, &xmlData, &length);
-    fprintf(outf, "%s\n", xmlData);
-    return 0;
+    if (afc_out_is_records(outputFormat)) {
+        afc_out_t out;
+        afc_out_begin(&out, outputFormat, outf);
+        int ret = record_afc_list_path(afc, "Documents", true, &out);
+        return ret | afc_out_end(&out);
+    }
+    int ret = xml_afc_path(afc, "Documents", true, outf);
+    fprintf(outf, "\n");
+    return ret;
 }
 
 int cmd_main(afc_client_t afc, int argc, char **argv) {
@@ -1064,6 +3005,8 @@ int cmd_main(afc_client_t afc, int argc, char **argv) {
         ret = do_cat(afc, argc, argv);
     } else if (!strcmp(cmd, "get")) {
         ret = do_get(afc, argc, argv);
+    } else if (!strcmp(cmd, "sum")) {
+        ret = do_sum(afc, argc, argv);
     } else if (!strcmp(cmd, "put")) {
         ret = do_put(afc, argc, argv);
         
@@ -1074,8 +3017,39 @@ int cmd_main(afc_client_t afc, int argc, char **argv) {
         char *input = argv[1];
         char *output = argv[2];
         ret = export_shallow_folder(afc, input, output);
+    } else if (!strcmp(cmd, "sync-up")) {
+        if (argc == 3) {
+            ret = sync_up_path(afc, argv[1], argv[2]);
+        } else {
+            fprintf(stderr, "Error: sync-up takes a local folder and a remote path\n");
+            ret = EXIT_FAILURE;
+        }
     }  else if (!strcmp(cmd, "clone")) {
-        if (argc >=3){
+        if (tarPath) {
+            if (clean || incremental || verifyTransfers || compressLevel || storePath || linkDest) {
+                fprintf(stderr, "Error: --tar can't be combined with --clean, --incremental, --verify, --compress, --store or --link-dest\n");
+                ret = EXIT_FAILURE;
+            } else if (argc > 2) {
+                fprintf(stderr, "Error: clone --tar takes one path, the archive goes to --tar\n");
+                ret = EXIT_FAILURE;
+            } else if (argc == 2) {
+                ret = tar_afc_path(afc, argv[1], tarPath);
+            } else if (hasAppID == false) {
+                ret = -1;
+                fprintf(stderr, "clone requires an appid to be set!\n");
+            } else {
+                ret = tar_afc_path(afc, "Documents", tarPath);
+            }
+        } else if (compressLevel && (incremental || resumeTransfers || verifyTransfers)) {
+            fprintf(stderr, "Error: --compress can't be combined with --incremental, --resume or --verify\n");
+            ret = EXIT_FAILURE;
+        } else if (storePath && (compressLevel || resumeTransfers)) {
+            fprintf(stderr, "Error: --store can't be combined with --compress or --resume\n");
+            ret = EXIT_FAILURE;
+        } else if (linkDest && (incremental || compressLevel)) {
+            fprintf(stderr, "Error: --link-dest can't be combined with --incremental or --compress\n");
+            ret = EXIT_FAILURE;
+        } else if (argc >=3){
             char *input = argv[1];
             char *output = argv[2];
             ret = clone_afc_path(afc, input, output);
@@ -1104,7 +3078,28 @@ int cmd_main(afc_client_t afc, int argc, char **argv) {
     return ret;
 }
 
-#define OPTION_FLAGS "rs:a:u:vhlcRAfxq"
+#define OPTION_FLAGS "rs:a:u:vhlcRAfxqj:1"
+
+// long options that have no single letter equivalent
+enum {
+    OPT_CHUNK_SIZE = 0x100,
+    OPT_FORMAT,
+    OPT_IO_BUFFERS,
+    OPT_RESUME,
+    OPT_INCREMENTAL,
+    OPT_DELETE,
+    OPT_DELETE_ROOT,
+    OPT_VERIFY,
+    OPT_HASH,
+    OPT_TAR,
+    OPT_COMPRESS,
+    OPT_COMPRESS_THREADS,
+    OPT_COMPRESS_INDEX,
+    OPT_STORE,
+    OPT_LINK_DEST,
+    OPT_STAT,
+};
+
 void usage(FILE *outf) {
     fprintf(outf,
             "Usage: %s %s [%s] command cmdargs...\n\n"
@@ -1120,15 +3115,39 @@ void usage(FILE *outf) {
             "    -f, --filesharing                List Only Applications that have file sharing enabled (only applicable when listing applications)\n"
             "    -x, --xml                        Output file/application lists in XML format\n"
             "    -R, --recursive                  List the specified folder recursively\n"
+            "    -1, --names-only                 List paths only, no per-entry stat (with -R one type probe per entry)\n"
+            "        --stat=<COLS>                -1 plus only these stat columns: type, size, blocks, nlink, mtime,\n"
+            "                                     birthtime, link (comma separated)\n"
             "    -q, --quiet                      Don't show the progress bar when applicable (putting/getting/cloning files)\n"
-            "    -c, --clean                      Cleans out folder after exporting/cloning\n\n"
+            "    -c, --clean                      Cleans out folder after exporting/cloning\n"
+            "    -j, --jobs=<N>                   Number of parallel afc connections for clone, listings, sum and large get/put (default: 1)\n"
+            "        --chunk-size=<BYTES|auto>    Transfer request size for get/put/clone/export/cat, ie: 256k, 1m (default: auto)\n"
+            "        --io-buffers=<N>             Buffers in flight between afc and local disk on get/put/clone, 1 to turn it off (default: %d)\n"
+            "        --resume                     Continue partial get/clone/export downloads left by an earlier --resume run, and put/puts uploads\n"
+            "        --incremental                Only copy files that are new or changed since the last clone --incremental\n"
+            "        --delete                     sync-up: remove what is on the device but not in the local folder\n"
+            "        --delete-root                --delete, also when the remote path is the top-level folder\n"
+            "        --verify                     get/put/clone: hash the data in flight and read a sample of the target back\n"
+            "        --hash=<ALGO>                Digest for sum and --verify: blake3 or sha256 (default: blake3)\n"
+            "        --tar=<FILE|->               clone: write one tar stream to FILE or stdout instead of a local folder,\n"
+            "                                     put: upload the members of one from FILE or stdin\n"
+            "        --compress=zstd[:LEVEL]      clone: write every file as <file>.zst, compressed as it arrives (default level: 3)\n"
+            "        --compress-threads=<N>       Compression threads for --compress, apart from -j (default: one per cpu)\n"
+            "        --compress-index             End every .zst with a seek table (zstd seekable format) for random access\n"
+            "        --store=<DIR>                clone: keep each file once in DIR under its --hash digest, hardlinked into the tree\n"
+            "        --link-dest=<DIR>            clone: hardlink files unchanged since the clone in DIR instead of downloading them\n"
+            "        --format=<FMT>               Output format for list/info/documents/-l/-A: text, xml, ndjson, tsv or bplist\n\n"
             
             "  Where \"command\" and \"cmdargs...\" are as follows:\n\n"
             "  New commands:\n\n"
             "    clone  [localpath]               clone app Documents folder into a local folder. (requires appid)\n"
             "    clone  [path] [localpath]        clone directory folder into a local folder. (requires path and localpath)\n"
             "    export [path] [localpath]        export a specific directory to a local one (not recursive)\n"
-            "    documents                        recursive plist formatted list of entire application Documents folder (requires appid)\n\n"
+            "    documents                        recursive plist formatted list of entire application Documents folder (requires appid)\n"
+            "    put -R <localdir> [path]         upload a local folder and everything in it, -R goes before or after put (-j N for parallel uploads)\n"
+            "    put --tar=<FILE|-> [path]        upload the members of a tar archive without extracting it (-j N for parallel uploads)\n"
+            "    sync-up <localdir> <path>        upload new and changed files of a local folder into a remote one (--delete removes extras)\n"
+            "    sum <path> [path2...]            print the digest of remote files, folders recursively (--hash, -j N)\n\n"
             "  Standard afcclient commands:\n\n"
             "    devinfo                          dump device info from AFC server\n"
             "    list <dir> [dir2...]             list remote directory contents\n"
@@ -1142,7 +3161,7 @@ void usage(FILE *outf) {
             "    get <path> [localpath]           download a file (default: current dir)\n"
             "    put <localpath> [path]           upload a file (default: remote top-level dir)\n"
             "    puts <localpath> [localpath2...] upload multiple files to remote top-level dir\n\n"
-            , progname, AFVersionNumber, OPTION_FLAGS);
+            , progname, AFVersionNumber, OPTION_FLAGS, AFC_PIPE_DEFAULT_BUFFERS);
 }
 
 
@@ -1156,10 +3175,28 @@ static struct option longopts[] = {
     { "list",       no_argument,            NULL,   'l' },
     { "clean",      no_argument,            NULL,   'c' },
     { "recursive",  no_argument,            NULL,   'R' },
+    { "names-only", no_argument,            NULL,   '1' },
     { "apps",       no_argument,            NULL,   'A' },
     { "xml",        no_argument,            NULL,   'x' },
     { "filesharing",no_argument,            NULL,   'f' },
     { "quiet",      no_argument,            NULL,   'q' },
+    { "jobs",       required_argument,      NULL,   'j' },
+    { "chunk-size", required_argument,      NULL,   OPT_CHUNK_SIZE },
+    { "format",     required_argument,      NULL,   OPT_FORMAT },
+    { "io-buffers", required_argument,      NULL,   OPT_IO_BUFFERS },
+    { "resume",     no_argument,            NULL,   OPT_RESUME },
+    { "incremental",no_argument,            NULL,   OPT_INCREMENTAL },
+    { "delete",     no_argument,            NULL,   OPT_DELETE },
+    { "delete-root", no_argument,           NULL,   OPT_DELETE_ROOT },
+    { "verify",     no_argument,            NULL,   OPT_VERIFY },
+    { "hash",       required_argument,      NULL,   OPT_HASH },
+    { "tar",        required_argument,      NULL,   OPT_TAR },
+    { "compress",   required_argument,      NULL,   OPT_COMPRESS },
+    { "compress-threads", required_argument, NULL,  OPT_COMPRESS_THREADS },
+    { "compress-index", no_argument,        NULL,   OPT_COMPRESS_INDEX },
+    { "store",      required_argument,      NULL,   OPT_STORE },
+    { "link-dest",  required_argument,      NULL,   OPT_LINK_DEST },
+    { "stat",       required_argument,      NULL,   OPT_STAT },
     { NULL,         0,                      NULL,   0 }
 };
 
@@ -1171,11 +3208,29 @@ int main(int argc, char **argv) {
     udid = NULL;
     appMode = false;
     quiet = false;
+    jobCount = 1;
     char *appid=NULL, *svcname=NULL;;
     hasAppID = false;
     clean = false;
     xml = false;
     fs = false;
+    namesOnly = false;
+    statColumns = 0;
+    resumeTransfers = false;
+    incremental = false;
+    syncDelete = false;
+    syncDeleteRoot = false;
+    verifyTransfers = false;
+    hashAlgo = AFC_HASH_BLAKE3;
+    tarPath = NULL;
+    compressLevel = 0;
+    compressThreads = 0;
+    compressIndex = false;
+    storePath = NULL;
+    cloneStore = NULL;
+    linkDest = NULL;
+    outputFormat = AFC_OUT_TEXT;
+    bool listDevices = false;
     svcname = AFC_SERVICE_NAME;
     int flag;
     while ((flag = getopt_long(argc, argv, OPTION_FLAGS, longopts, NULL)) != -1) {
@@ -1213,8 +3268,9 @@ int main(int argc, char **argv) {
                 return EXIT_SUCCESS;
                 
             case 'l':
-                list_devices(stdout);
-                return EXIT_SUCCESS;
+                // after option parsing so a --format that follows still applies
+                listDevices = true;
+                break;
                 
             case 'c':
                 clean = true;
@@ -1224,8 +3280,13 @@ int main(int argc, char **argv) {
                 recursiveList = true;
                 break;
                 
+            case '1':
+                namesOnly = true;
+                break;
+                
             case 'x':
                 xml = true;
+                outputFormat = AFC_OUT_XML;
                 break;
                 
             case 'f':
@@ -1240,6 +3301,107 @@ int main(int argc, char **argv) {
                 quiet = true;
                 break;
                 
+            case 'j':
+                jobCount = atoi(optarg);
+                if (jobCount < 1 || jobCount > 64) {
+                    fprintf(stderr, "Error: invalid number of jobs: %s (expected 1-64)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_CHUNK_SIZE:
+                if (afc_xfer_parse_size(optarg, &afc_chunk_size) != 0) {
+                    fprintf(stderr, "Error: invalid chunk size: %s (expected auto or 512 bytes to %dm)\n", optarg, AFC_XFER_MAX_CHUNK / (1024 * 1024));
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_IO_BUFFERS:
+                afc_io_buffers = atoi(optarg);
+                if (afc_io_buffers < 1 || afc_io_buffers > AFC_PIPE_MAX_BUFFERS) {
+                    fprintf(stderr, "Error: invalid number of io buffers: %s (expected 1-%d)\n", optarg, AFC_PIPE_MAX_BUFFERS);
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_RESUME:
+                resumeTransfers = true;
+                break;
+                
+            case OPT_INCREMENTAL:
+                incremental = true;
+                break;
+                
+            case OPT_DELETE:
+                syncDelete = true;
+                break;
+            case OPT_DELETE_ROOT:
+                syncDelete = true;
+                syncDeleteRoot = true;
+                break;
+                
+            case OPT_VERIFY:
+                verifyTransfers = true;
+                break;
+                
+            case OPT_HASH:
+                if (afc_hash_parse(optarg, &hashAlgo) != 0) {
+                    fprintf(stderr, "Error: invalid hash: %s (expected blake3 or sha256)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_TAR:
+                tarPath = optarg;
+                break;
+                
+            case OPT_COMPRESS:
+#if !defined(HAVE_ZSTD)
+                fprintf(stderr, "Error: --compress needs libzstd, this afcclient was built without it\n");
+                return EXIT_FAILURE;
+#endif
+                if (afc_zst_parse(optarg, &compressLevel) != 0) {
+                    fprintf(stderr, "Error: invalid compression: %s (expected zstd or zstd:<level>, level 1 to 22 or negative for faster)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_COMPRESS_THREADS:
+                compressThreads = atoi(optarg);
+                if (compressThreads < 1 || compressThreads > AFC_ZST_MAX_THREADS) {
+                    fprintf(stderr, "Error: invalid number of compression threads: %s (expected 1-%d)\n", optarg, AFC_ZST_MAX_THREADS);
+                    return EXIT_FAILURE;
+                }
+                break;
+                
+            case OPT_COMPRESS_INDEX:
+                compressIndex = true;
+                break;
+                
+            case OPT_STORE:
+                storePath = optarg;
+                break;
+                
+            case OPT_LINK_DEST:
+                linkDest = optarg;
+                break;
+                
+            case OPT_STAT:
+                if (afc_entry_parse_columns(optarg, &statColumns) != 0) {
+                    fprintf(stderr, "Error: invalid stat columns: %s (expected type, size, blocks, nlink, mtime, birthtime or link, comma separated)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                namesOnly = true;
+                break;
+                
+            case OPT_FORMAT:
+                if (afc_out_parse_format(optarg, &outputFormat) != 0) {
+                    fprintf(stderr, "Error: invalid format: %s (expected text, xml, ndjson, tsv or bplist)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                xml = (outputFormat == AFC_OUT_XML);
+                break;
+                
             default:
                 usage(stderr);
                 return EXIT_FAILURE;
@@ -1250,6 +3412,11 @@ int main(int argc, char **argv) {
     argc -= optind;
     argv += optind;
     
+    if (listDevices) {
+        list_devices(stdout);
+        return EXIT_SUCCESS;
+    }
+    
     if (argc < 1 && appMode == false) {
         fprintf(stderr, "Missing command argument\n");
         usage(stderr);
@@ -1262,7 +3429,13 @@ int main(int argc, char **argv) {
             idevice_error_t ret = IDEVICE_E_UNKNOWN_ERROR;
             ret = idevice_new(&phone, NULL);
         }
-        idev_list_installed_apps(phone, fs, xml);
+        if (afc_out_is_records(outputFormat)) {
+            afc_out_t out;
+            afc_out_begin(&out, outputFormat, stdout);
+            idev_list_installed_apps(phone, fs, xml, &out);
+            return afc_out_end(&out);
+        }
+        idev_list_installed_apps(phone, fs, xml, NULL);
         return 0;
     }
     
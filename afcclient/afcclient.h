@@ -44,6 +44,7 @@ extern "C" {
 #endif
 
 int dump_afc_list_path(afc_client_t afc, const char *path);
+int xml_afc_path(afc_client_t afc, const char *path, int8_t recursive, FILE *outf);
 LIBGMMD_EXPORT int list_devices(FILE *outf);
     
 LIBGMMD_EXPORT int rm_file(afc_client_t afc, char *filePath);
@@ -53,6 +54,10 @@ LIBGMMD_EXPORT plist_t * afc_list_path(afc_client_t afc, const char *path, int8_
 LIBGMMD_EXPORT int get_afc_path(afc_client_t afc, const char *src, const char *dst);
 LIBGMMD_EXPORT int put_afc_path(afc_client_t afc, const char *src, const char *dst);
 LIBGMMD_EXPORT int clone_afc_path(afc_client_t afc, const char *src, const char *dst);
+LIBGMMD_EXPORT int tar_afc_path(afc_client_t afc, const char *src, const char *path);
+LIBGMMD_EXPORT int sync_up_path(afc_client_t afc, const char *src, const char *dst);
+LIBGMMD_EXPORT int put_tree_path(afc_client_t afc, const char *src, const char *dst);
+LIBGMMD_EXPORT int put_tar_path(afc_client_t afc, const char *src, const char *dst);
 LIBGMMD_EXPORT char * AFVersionNumber;
     
 #ifdef __cplusplus
@@ -0,0 +1,215 @@
+/*
+ * afcentry
+ *
+ * typed file info and the arena its strings live in, see afcentry.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "afcentry.h"
+#include "libidev.h"
+
+#define AFC_ARENA_BLOCK (64 * 1024)
+
+struct afc_arena_block_t {
+    afc_arena_block_t *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static const struct {
+    afc_entry_type_t type;
+    const char *name;
+} afc_entry_types[] = {
+    { AFC_ENTRY_FILE,   "S_IFREG" },
+    { AFC_ENTRY_DIR,    "S_IFDIR" },
+    { AFC_ENTRY_LINK,   "S_IFLNK" },
+    { AFC_ENTRY_CHAR,   "S_IFCHR" },
+    { AFC_ENTRY_BLOCK,  "S_IFBLK" },
+    { AFC_ENTRY_FIFO,   "S_IFIFO" },
+    { AFC_ENTRY_SOCKET, "S_IFSOCK" },
+};
+
+#pragma mark - Arena
+
+void *afc_arena_alloc(afc_arena_t *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+
+    afc_arena_block_t *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        // oversized requests get a block of their own, the current one keeps filling up
+        size_t blocksize = (size > AFC_ARENA_BLOCK) ? size : AFC_ARENA_BLOCK;
+        afc_arena_block_t *fresh = malloc(sizeof(afc_arena_block_t) + blocksize);
+        if (!fresh)
+            return NULL;
+        fresh->used = 0;
+        fresh->size = blocksize;
+        if (block && size > AFC_ARENA_BLOCK) {
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next = block;
+            arena->head = fresh;
+        }
+        block = fresh;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char *afc_arena_strdup(afc_arena_t *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = afc_arena_alloc(arena, len);
+    if (copy)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+void afc_arena_merge(afc_arena_t *dst, afc_arena_t *src) {
+    if (!src->head)
+        return;
+
+    afc_arena_block_t *last = src->head;
+    while (last->next)
+        last = last->next;
+    last->next = dst->head;
+    dst->head = src->head;
+    src->head = NULL;
+}
+
+void afc_arena_reset(afc_arena_t *arena) {
+    afc_arena_block_t *keep = arena->head;
+    if (!keep)
+        return;
+
+    afc_arena_block_t *block = keep->next;
+    while (block) {
+        afc_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+}
+
+void afc_arena_free(afc_arena_t *arena) {
+    afc_arena_block_t *block = arena->head;
+    while (block) {
+        afc_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+#pragma mark - Entries
+
+const char *afc_entry_type_name(afc_entry_type_t type) {
+    size_t i;
+    for (i = 0; i < sizeof(afc_entry_types) / sizeof(afc_entry_types[0]); i++) {
+        if (afc_entry_types[i].type == type)
+            return afc_entry_types[i].name;
+    }
+    return NULL;
+}
+
+afc_entry_type_t afc_entry_type_from_name(const char *name) {
+    size_t i;
+    if (!name)
+        return AFC_ENTRY_UNKNOWN;
+    for (i = 0; i < sizeof(afc_entry_types) / sizeof(afc_entry_types[0]); i++) {
+        if (strcmp(afc_entry_types[i].name, name) == 0)
+            return afc_entry_types[i].type;
+    }
+    return AFC_ENTRY_UNKNOWN;
+}
+
+static const struct {
+    unsigned int column;
+    const char *name;
+} afc_entry_columns[] = {
+    { AFC_ENTRY_HAS_TYPE,      "type" },
+    { AFC_ENTRY_HAS_SIZE,      "size" },
+    { AFC_ENTRY_HAS_BLOCKS,    "blocks" },
+    { AFC_ENTRY_HAS_NLINK,     "nlink" },
+    { AFC_ENTRY_HAS_MTIME,     "mtime" },
+    { AFC_ENTRY_HAS_BIRTHTIME, "birthtime" },
+    { AFC_ENTRY_HAS_LINK,      "link" },
+};
+
+int afc_entry_parse_columns(const char *arg, unsigned int *columns) {
+    const char *cur = arg;
+
+    *columns = 0;
+    while (cur && *cur) {
+        const char *end = strchr(cur, ',');
+        size_t len = (end) ? (size_t)(end - cur) : strlen(cur);
+        size_t i;
+        for (i = 0; i < sizeof(afc_entry_columns) / sizeof(afc_entry_columns[0]); i++) {
+            if (strlen(afc_entry_columns[i].name) == len && strncmp(afc_entry_columns[i].name, cur, len) == 0)
+                break;
+        }
+        if (i == sizeof(afc_entry_columns) / sizeof(afc_entry_columns[0]))
+            return -1;
+        *columns |= afc_entry_columns[i].column;
+        cur = (end) ? end + 1 : NULL;
+    }
+    return (*columns) ? 0 : -1;
+}
+
+int afc_entry_from_info(afc_arena_t *arena, const char *path, char **info, afc_entry_t *entry) {
+    int i;
+
+    memset(entry, 0, sizeof(afc_entry_t));
+    entry->path = afc_arena_strdup(arena, path);
+    if (!entry->path)
+        return EXIT_FAILURE;
+
+    for (i = 0; info[i] && info[i+1]; i += 2) {
+        const char *key = info[i];
+        const char *val = info[i+1];
+
+        if (strcmp(key, "st_size") == 0) {
+            entry->size = strtoull(val, NULL, 10);
+            entry->has |= AFC_ENTRY_HAS_SIZE;
+        } else if (strcmp(key, "st_blocks") == 0) {
+            entry->blocks = strtoull(val, NULL, 10);
+            entry->has |= AFC_ENTRY_HAS_BLOCKS;
+        } else if (strcmp(key, "st_nlink") == 0) {
+            entry->nlink = strtoull(val, NULL, 10);
+            entry->has |= AFC_ENTRY_HAS_NLINK;
+        } else if (strcmp(key, "st_ifmt") == 0) {
+            entry->type = afc_entry_type_from_name(val);
+            entry->has |= AFC_ENTRY_HAS_TYPE;
+        } else if (strcmp(key, "st_mtime") == 0) {
+            entry->mtime = strtoull(val, NULL, 10);
+            entry->has |= AFC_ENTRY_HAS_MTIME;
+        } else if (strcmp(key, "st_birthtime") == 0) {
+            entry->birthtime = strtoull(val, NULL, 10);
+            entry->has |= AFC_ENTRY_HAS_BIRTHTIME;
+        } else if (strcmp(key, "LinkTarget") == 0) {
+            entry->link = afc_arena_strdup(arena, val);
+            entry->has |= AFC_ENTRY_HAS_LINK;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+afc_error_t afc_entry_stat(afc_client_t afc, afc_arena_t *arena, const char *path, afc_entry_t *entry) {
+    char **info = NULL;
+
+    afc_error_t err = afc_get_file_info(afc, path, &info);
+    if (err == AFC_E_SUCCESS && !info)
+        err = AFC_E_UNKNOWN_ERROR;
+    if (err == AFC_E_SUCCESS && afc_entry_from_info(arena, path, info, entry) != EXIT_SUCCESS)
+        err = AFC_E_NO_MEM;
+
+    if (info)
+        idevice_device_list_free(info);
+    return err;
+}
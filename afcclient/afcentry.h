@@ -0,0 +1,95 @@
+/*
+ * afcentry
+ *
+ * the parsed form of an afc_get_file_info reply. listings used to keep every
+ * entry as a plist dict of strings and re-parse it wherever it was used, now
+ * the key/value list is read once into an afc_entry_t and plists are only built
+ * for -x output.
+ *
+ * strings (path, link target) live in an afc_arena_t, a bump allocator that is
+ * freed in one go together with the listing that owns it.
+ */
+
+#ifndef _afcentry_h
+#define _afcentry_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libimobiledevice/afc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum afc_entry_type_t {
+    AFC_ENTRY_UNKNOWN = 0,
+    AFC_ENTRY_FILE,         // S_IFREG
+    AFC_ENTRY_DIR,          // S_IFDIR
+    AFC_ENTRY_LINK,         // S_IFLNK
+    AFC_ENTRY_CHAR,         // S_IFCHR
+    AFC_ENTRY_BLOCK,        // S_IFBLK
+    AFC_ENTRY_FIFO,         // S_IFIFO
+    AFC_ENTRY_SOCKET        // S_IFSOCK
+} afc_entry_type_t;
+
+// which of the numbers the device actually sent, -x and info only show those
+#define AFC_ENTRY_HAS_SIZE      0x01
+#define AFC_ENTRY_HAS_BLOCKS    0x02
+#define AFC_ENTRY_HAS_NLINK     0x04
+#define AFC_ENTRY_HAS_MTIME     0x08
+#define AFC_ENTRY_HAS_BIRTHTIME 0x10
+#define AFC_ENTRY_HAS_TYPE      0x20
+#define AFC_ENTRY_HAS_LINK      0x40
+#define AFC_ENTRY_HAS_ALL       0x7f
+
+typedef struct afc_entry_t {
+    const char *path;
+    const char *link;       // LinkTarget, NULL unless the device sent one
+    afc_entry_type_t type;
+    uint64_t size;
+    uint64_t blocks;
+    uint64_t nlink;
+    uint64_t mtime;         // nanoseconds, as the device reports them
+    uint64_t birthtime;
+    unsigned int has;       // AFC_ENTRY_HAS_*
+    bool unread;            // a folder afc_scan couldn't read, or a path AFC_WALK_UNREAD couldn't list or stat
+} afc_entry_t;
+
+typedef struct afc_arena_block_t afc_arena_block_t;
+
+typedef struct afc_arena_t {
+    afc_arena_block_t *head;
+} afc_arena_t;
+
+void *afc_arena_alloc(afc_arena_t *arena, size_t size);
+
+char *afc_arena_strdup(afc_arena_t *arena, const char *str);
+
+// moves every block of src into dst, src is left empty
+void afc_arena_merge(afc_arena_t *dst, afc_arena_t *src);
+
+// drops everything allocated so far but keeps one block around for reuse
+void afc_arena_reset(afc_arena_t *arena);
+
+void afc_arena_free(afc_arena_t *arena);
+
+// "S_IFDIR" etc, NULL for AFC_ENTRY_UNKNOWN
+const char *afc_entry_type_name(afc_entry_type_t type);
+
+afc_entry_type_t afc_entry_type_from_name(const char *name);
+
+// "size,mtime,..." to AFC_ENTRY_HAS_* bits: type, size, blocks, nlink, mtime, birthtime, link
+int afc_entry_parse_columns(const char *arg, unsigned int *columns);
+
+// fills entry from an afc_get_file_info key/value list, path and link target are copied into arena
+int afc_entry_from_info(afc_arena_t *arena, const char *path, char **info, afc_entry_t *entry);
+
+afc_error_t afc_entry_stat(afc_client_t afc, afc_arena_t *arena, const char *path, afc_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcentry_h
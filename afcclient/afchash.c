@@ -0,0 +1,549 @@
+/*
+ * afchash
+ *
+ * BLAKE3 and SHA-256, see afchash.h
+ *
+ * the BLAKE3 side follows the portable reference implementation: a chunk state
+ * for the chunk being filled, a stack of chaining values for the subtrees that
+ * are complete, merged lazily so the last two can still become the root. whole
+ * subtrees in the middle of an update skip the chunk state and are hashed
+ * recursively, which is where the threads come in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "afchash.h"
+
+#define B3_CHUNK_LEN    1024
+#define B3_BLOCK_LEN    64
+#define B3_CHUNK_START  (1 << 0)
+#define B3_CHUNK_END    (1 << 1)
+#define B3_PARENT       (1 << 2)
+#define B3_ROOT         (1 << 3)
+
+#define AFC_HASH_FILE_BLOCK     (8 * 1024 * 1024)   // local reads, a multiple of the chunk so subtrees stay whole
+
+int afc_hash_threads = 0;
+
+static const uint32_t afc_b3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t afc_b3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+static const uint32_t afc_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t afc_hash_rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t afc_hash_load_le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void afc_hash_store_le(uint8_t *p, uint32_t x) {
+    p[0] = (uint8_t)x;
+    p[1] = (uint8_t)(x >> 8);
+    p[2] = (uint8_t)(x >> 16);
+    p[3] = (uint8_t)(x >> 24);
+}
+
+static inline uint32_t afc_hash_load_be(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void afc_hash_store_be(uint8_t *p, uint32_t x) {
+    p[0] = (uint8_t)(x >> 24);
+    p[1] = (uint8_t)(x >> 16);
+    p[2] = (uint8_t)(x >> 8);
+    p[3] = (uint8_t)x;
+}
+
+static int afc_hash_cpus() {
+    int cpus = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0)
+        cpus = (int)online;
+#endif
+    return cpus;
+}
+
+#pragma mark - BLAKE3
+
+#define B3_G(a, b, c, d, x, y) do { \
+    v[a] += v[b] + (x); v[d] = afc_hash_rotr(v[d] ^ v[a], 16); \
+    v[c] += v[d];       v[b] = afc_hash_rotr(v[b] ^ v[c], 12); \
+    v[a] += v[b] + (y); v[d] = afc_hash_rotr(v[d] ^ v[a], 8);  \
+    v[c] += v[d];       v[b] = afc_hash_rotr(v[b] ^ v[c], 7);  \
+} while (0)
+
+// one block into cv, in place. the root output is the same compression with B3_ROOT set
+static void afc_b3_compress(uint32_t cv[8], const uint8_t block[B3_BLOCK_LEN], uint8_t block_len, uint64_t counter, uint8_t flags) {
+    uint32_t m[16], v[16];
+    int i, r;
+
+    for (i = 0; i < 16; i++)
+        m[i] = afc_hash_load_le(block + i * 4);
+    for (i = 0; i < 8; i++)
+        v[i] = cv[i];
+    v[8] = afc_b3_iv[0];
+    v[9] = afc_b3_iv[1];
+    v[10] = afc_b3_iv[2];
+    v[11] = afc_b3_iv[3];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    for (r = 0; r < 7; r++) {
+        const uint8_t *s = afc_b3_schedule[r];
+        B3_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        B3_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        B3_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        B3_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        B3_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        B3_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        B3_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        B3_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (i = 0; i < 8; i++)
+        cv[i] = v[i] ^ v[i + 8];
+}
+
+// what is left to compress for a chaining value or the root, a chunk's last block or a parent
+typedef struct afc_b3_output_t {
+    uint32_t cv[8];
+    uint8_t block[B3_BLOCK_LEN];
+    uint8_t block_len;
+    uint64_t counter;
+    uint8_t flags;
+} afc_b3_output_t;
+
+static void afc_b3_output_cv(const afc_b3_output_t *output, uint8_t out[32]) {
+    uint32_t cv[8];
+    int i;
+
+    memcpy(cv, output->cv, sizeof(cv));
+    afc_b3_compress(cv, output->block, output->block_len, output->counter, output->flags);
+    for (i = 0; i < 8; i++)
+        afc_hash_store_le(out + i * 4, cv[i]);
+}
+
+static void afc_b3_output_root(const afc_b3_output_t *output, uint8_t out[32]) {
+    uint32_t cv[8];
+    int i;
+
+    memcpy(cv, output->cv, sizeof(cv));
+    afc_b3_compress(cv, output->block, output->block_len, 0, output->flags | B3_ROOT);
+    for (i = 0; i < 8; i++)
+        afc_hash_store_le(out + i * 4, cv[i]);
+}
+
+static void afc_b3_parent(const uint8_t block[B3_BLOCK_LEN], afc_b3_output_t *output) {
+    memcpy(output->cv, afc_b3_iv, sizeof(output->cv));
+    memcpy(output->block, block, B3_BLOCK_LEN);
+    output->block_len = B3_BLOCK_LEN;
+    output->counter = 0;
+    output->flags = B3_PARENT;
+}
+
+static void afc_b3_chunk_init(afc_blake3_chunk_t *chunk, uint64_t counter) {
+    memcpy(chunk->cv, afc_b3_iv, sizeof(chunk->cv));
+    chunk->counter = counter;
+    memset(chunk->buf, 0, sizeof(chunk->buf));
+    chunk->buf_len = 0;
+    chunk->blocks = 0;
+}
+
+static size_t afc_b3_chunk_len(const afc_blake3_chunk_t *chunk) {
+    return (size_t)chunk->blocks * B3_BLOCK_LEN + chunk->buf_len;
+}
+
+static uint8_t afc_b3_chunk_start(const afc_blake3_chunk_t *chunk) {
+    return (chunk->blocks == 0) ? B3_CHUNK_START : 0;
+}
+
+// the last block is always held back in buf, it gets CHUNK_END once it is known to be the last
+static void afc_b3_chunk_update(afc_blake3_chunk_t *chunk, const uint8_t *input, size_t length) {
+    while (length > 0) {
+        if (chunk->buf_len == B3_BLOCK_LEN) {
+            afc_b3_compress(chunk->cv, chunk->buf, B3_BLOCK_LEN, chunk->counter, afc_b3_chunk_start(chunk));
+            chunk->blocks++;
+            chunk->buf_len = 0;
+            memset(chunk->buf, 0, sizeof(chunk->buf));
+        }
+        size_t take = B3_BLOCK_LEN - chunk->buf_len;
+        if (take > length)
+            take = length;
+        memcpy(chunk->buf + chunk->buf_len, input, take);
+        chunk->buf_len += (uint8_t)take;
+        input += take;
+        length -= take;
+    }
+}
+
+static void afc_b3_chunk_output(const afc_blake3_chunk_t *chunk, afc_b3_output_t *output) {
+    memcpy(output->cv, chunk->cv, sizeof(output->cv));
+    memcpy(output->block, chunk->buf, B3_BLOCK_LEN);
+    output->block_len = chunk->buf_len;
+    output->counter = chunk->counter;
+    output->flags = afc_b3_chunk_start(chunk) | B3_CHUNK_END;
+}
+
+typedef struct afc_b3_subtree_t {
+    const uint8_t *input;
+    size_t length;              // a power of two number of chunks
+    uint64_t counter;
+    int threads;
+    uint8_t cv[32];
+} afc_b3_subtree_t;
+
+static void afc_b3_subtree_cv(afc_b3_subtree_t *tree);
+
+static void *afc_b3_subtree_thread(void *arg) {
+    afc_b3_subtree_cv(arg);
+    return NULL;
+}
+
+// chaining value of a complete subtree, the two halves on two threads while there are threads to spare
+static void afc_b3_subtree_cv(afc_b3_subtree_t *tree) {
+    afc_b3_output_t output;
+
+    if (tree->length <= B3_CHUNK_LEN) {
+        afc_blake3_chunk_t chunk;
+        afc_b3_chunk_init(&chunk, tree->counter);
+        afc_b3_chunk_update(&chunk, tree->input, tree->length);
+        afc_b3_chunk_output(&chunk, &output);
+        afc_b3_output_cv(&output, tree->cv);
+        return;
+    }
+
+    size_t half = tree->length / 2;
+    afc_b3_subtree_t left = { tree->input, half, tree->counter, tree->threads / 2, { 0 } };
+    afc_b3_subtree_t right = { tree->input + half, half, tree->counter + half / B3_CHUNK_LEN, tree->threads - tree->threads / 2, { 0 } };
+
+    pthread_t thread;
+    bool split = (tree->threads > 1 && half >= AFC_HASH_PARALLEL_MIN / 2 && pthread_create(&thread, NULL, afc_b3_subtree_thread, &left) == 0);
+    if (!split) {
+        left.threads = right.threads = 1;
+        afc_b3_subtree_cv(&left);
+    }
+    afc_b3_subtree_cv(&right);
+    if (split)
+        pthread_join(thread, NULL);
+
+    uint8_t block[B3_BLOCK_LEN];
+    memcpy(block, left.cv, 32);
+    memcpy(block + 32, right.cv, 32);
+    afc_b3_parent(block, &output);
+    afc_b3_output_cv(&output, tree->cv);
+}
+
+// folds the stack down to one entry per 1 bit of total, the newest one is kept unmerged for the root
+static void afc_b3_merge(afc_hash_t *hash, uint64_t total) {
+    int keep = __builtin_popcountll(total);
+    afc_b3_output_t output;
+
+    while (hash->u.blake3.stack_len > keep) {
+        uint8_t *node = &hash->u.blake3.stack[(hash->u.blake3.stack_len - 2) * 32];
+        afc_b3_parent(node, &output);
+        afc_b3_output_cv(&output, node);
+        hash->u.blake3.stack_len--;
+    }
+}
+
+static void afc_b3_push(afc_hash_t *hash, const uint8_t cv[32], uint64_t counter) {
+    afc_b3_merge(hash, counter);
+    memcpy(&hash->u.blake3.stack[hash->u.blake3.stack_len * 32], cv, 32);
+    hash->u.blake3.stack_len++;
+}
+
+static void afc_b3_update(afc_hash_t *hash, const uint8_t *input, size_t length) {
+    afc_blake3_chunk_t *chunk = &hash->u.blake3.chunk;
+    afc_b3_output_t output;
+    uint8_t cv[32];
+
+    if (afc_b3_chunk_len(chunk) > 0) {
+        size_t take = B3_CHUNK_LEN - afc_b3_chunk_len(chunk);
+        if (take > length)
+            take = length;
+        afc_b3_chunk_update(chunk, input, take);
+        input += take;
+        length -= take;
+        if (length == 0)
+            return;
+        afc_b3_chunk_output(chunk, &output);
+        afc_b3_output_cv(&output, cv);
+        afc_b3_push(hash, cv, chunk->counter);
+        afc_b3_chunk_init(chunk, chunk->counter + 1);
+    }
+
+    // whole subtrees, as large as the input and the position in the tree allow. the last chunk
+    // stays behind in the chunk state, it may turn out to be the root
+    while (length > B3_CHUNK_LEN) {
+        size_t subtree = 1;
+        while (subtree <= length / 2)
+            subtree <<= 1;
+        uint64_t so_far = chunk->counter * B3_CHUNK_LEN;
+        while (((uint64_t)(subtree - 1) & so_far) != 0)
+            subtree /= 2;
+        uint64_t chunks = subtree / B3_CHUNK_LEN;
+
+        if (subtree <= B3_CHUNK_LEN) {
+            afc_b3_subtree_t one = { input, subtree, chunk->counter, 1, { 0 } };
+            afc_b3_subtree_cv(&one);
+            afc_b3_push(hash, one.cv, chunk->counter);
+        } else {
+            // both halves go on the stack, the root may be the parent of exactly these two
+            size_t half = subtree / 2;
+            int threads = (subtree >= AFC_HASH_PARALLEL_MIN) ? hash->threads : 1;
+            afc_b3_subtree_t left = { input, half, chunk->counter, threads / 2, { 0 } };
+            afc_b3_subtree_t right = { input + half, half, chunk->counter + chunks / 2, threads - threads / 2, { 0 } };
+            pthread_t thread;
+            bool split = (threads > 1 && pthread_create(&thread, NULL, afc_b3_subtree_thread, &left) == 0);
+            if (!split) {
+                left.threads = right.threads = threads;
+                afc_b3_subtree_cv(&left);
+            }
+            afc_b3_subtree_cv(&right);
+            if (split)
+                pthread_join(thread, NULL);
+            afc_b3_push(hash, left.cv, left.counter);
+            afc_b3_push(hash, right.cv, right.counter);
+        }
+        chunk->counter += chunks;
+        input += subtree;
+        length -= subtree;
+    }
+
+    if (length > 0) {
+        afc_b3_chunk_update(chunk, input, length);
+        afc_b3_merge(hash, chunk->counter);
+    }
+}
+
+static void afc_b3_final(afc_hash_t *hash, uint8_t out[32]) {
+    afc_blake3_chunk_t *chunk = &hash->u.blake3.chunk;
+    afc_b3_output_t output;
+    size_t remaining;
+
+    if (hash->u.blake3.stack_len == 0) {
+        afc_b3_chunk_output(chunk, &output);
+        afc_b3_output_root(&output, out);
+        return;
+    }
+
+    if (afc_b3_chunk_len(chunk) > 0) {
+        remaining = hash->u.blake3.stack_len;
+        afc_b3_chunk_output(chunk, &output);
+    } else {
+        remaining = hash->u.blake3.stack_len - 2;
+        afc_b3_parent(&hash->u.blake3.stack[remaining * 32], &output);
+    }
+    while (remaining > 0) {
+        uint8_t block[B3_BLOCK_LEN];
+        remaining--;
+        memcpy(block, &hash->u.blake3.stack[remaining * 32], 32);
+        afc_b3_output_cv(&output, block + 32);
+        afc_b3_parent(block, &output);
+    }
+    afc_b3_output_root(&output, out);
+}
+
+#pragma mark - SHA-256
+
+static void afc_sha256_block(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64], a, b, c, d, e, f, g, h;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = afc_hash_load_be(block + i * 4);
+    for (i = 16; i < 64; i++) {
+        uint32_t s0 = afc_hash_rotr(w[i-15], 7) ^ afc_hash_rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = afc_hash_rotr(w[i-2], 17) ^ afc_hash_rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + (afc_hash_rotr(e, 6) ^ afc_hash_rotr(e, 11) ^ afc_hash_rotr(e, 25)) + ((e & f) ^ (~e & g)) + afc_sha256_k[i] + w[i];
+        uint32_t t2 = (afc_hash_rotr(a, 2) ^ afc_hash_rotr(a, 13) ^ afc_hash_rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void afc_sha256_update(afc_hash_t *hash, const uint8_t *input, size_t length) {
+    hash->u.sha256.length += length;
+
+    if (hash->u.sha256.buf_len > 0) {
+        size_t take = 64 - hash->u.sha256.buf_len;
+        if (take > length)
+            take = length;
+        memcpy(hash->u.sha256.buf + hash->u.sha256.buf_len, input, take);
+        hash->u.sha256.buf_len += (uint8_t)take;
+        input += take;
+        length -= take;
+        if (hash->u.sha256.buf_len < 64)
+            return;
+        afc_sha256_block(hash->u.sha256.state, hash->u.sha256.buf);
+        hash->u.sha256.buf_len = 0;
+    }
+    while (length >= 64) {
+        afc_sha256_block(hash->u.sha256.state, input);
+        input += 64;
+        length -= 64;
+    }
+    memcpy(hash->u.sha256.buf, input, length);
+    hash->u.sha256.buf_len = (uint8_t)length;
+}
+
+static void afc_sha256_final(afc_hash_t *hash, uint8_t out[32]) {
+    uint64_t bits = hash->u.sha256.length * 8;
+    uint8_t *buf = hash->u.sha256.buf;
+    size_t used = hash->u.sha256.buf_len;
+    int i;
+
+    buf[used++] = 0x80;
+    if (used > 56) {
+        memset(buf + used, 0, 64 - used);
+        afc_sha256_block(hash->u.sha256.state, buf);
+        used = 0;
+    }
+    memset(buf + used, 0, 56 - used);
+    afc_hash_store_be(buf + 56, (uint32_t)(bits >> 32));
+    afc_hash_store_be(buf + 60, (uint32_t)bits);
+    afc_sha256_block(hash->u.sha256.state, buf);
+
+    for (i = 0; i < 8; i++)
+        afc_hash_store_be(out + i * 4, hash->u.sha256.state[i]);
+}
+
+#pragma mark - Interface
+
+int afc_hash_parse(const char *arg, afc_hash_algo_t *algo) {
+    if (!strcasecmp(arg, "blake3") || !strcasecmp(arg, "b3"))
+        *algo = AFC_HASH_BLAKE3;
+    else if (!strcasecmp(arg, "sha256") || !strcasecmp(arg, "sha-256"))
+        *algo = AFC_HASH_SHA256;
+    else
+        return -1;
+    return 0;
+}
+
+const char *afc_hash_name(afc_hash_algo_t algo) {
+    return (algo == AFC_HASH_SHA256) ? "sha256" : "blake3";
+}
+
+void afc_hash_init(afc_hash_t *hash, afc_hash_algo_t algo) {
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memset(hash, 0, sizeof(afc_hash_t));
+    hash->algo = algo;
+    hash->threads = (afc_hash_threads > 0) ? afc_hash_threads : afc_hash_cpus();
+    if (hash->threads > AFC_HASH_MAX_THREADS)
+        hash->threads = AFC_HASH_MAX_THREADS;
+
+    if (algo == AFC_HASH_SHA256)
+        memcpy(hash->u.sha256.state, sha256_iv, sizeof(sha256_iv));
+    else
+        afc_b3_chunk_init(&hash->u.blake3.chunk, 0);
+}
+
+void afc_hash_update(afc_hash_t *hash, const void *data, size_t length) {
+    if (hash->algo == AFC_HASH_SHA256)
+        afc_sha256_update(hash, data, length);
+    else
+        afc_b3_update(hash, data, length);
+}
+
+void afc_hash_final(afc_hash_t *hash, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    uint8_t digest[AFC_HASH_DIGEST_SIZE];
+    int i;
+
+    if (hash->algo == AFC_HASH_SHA256)
+        afc_sha256_final(hash, digest);
+    else
+        afc_b3_final(hash, digest);
+
+    for (i = 0; i < AFC_HASH_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    hex[AFC_HASH_DIGEST_SIZE * 2] = '\0';
+}
+
+int afc_hash_local(afc_hash_t *hash, afc_local_t *local, uint64_t start, uint64_t end) {
+    char *buf = malloc(AFC_HASH_FILE_BLOCK);
+    if (!buf)
+        return EXIT_FAILURE;
+
+    int ret = EXIT_SUCCESS;
+    while (start < end) {
+        size_t want = (end - start < AFC_HASH_FILE_BLOCK) ? (size_t)(end - start) : AFC_HASH_FILE_BLOCK;
+        size_t got = 0;
+        if (afc_local_read_at(local, buf, want, start, &got) != EXIT_SUCCESS || got == 0) {
+            if (got == 0)
+                errno = EIO;    // the file got shorter
+            ret = EXIT_FAILURE;
+            break;
+        }
+        afc_hash_update(hash, buf, got);
+        start += got;
+    }
+    free(buf);
+    return ret;
+}
+
+int afc_hash_file(const char *path, afc_hash_algo_t algo, char *hex, uint64_t *size) {
+    afc_local_t local;
+    afc_hash_t hash;
+    uint64_t length = 0;
+
+    if (afc_local_open(&local, path, &length) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    afc_hash_init(&hash, algo);
+    int ret = afc_hash_local(&hash, &local, 0, length);
+    int saved = errno;
+    afc_local_close(&local);
+    errno = saved;
+
+    if (ret == EXIT_SUCCESS) {
+        afc_hash_final(&hash, hex);
+        if (size)
+            *size = length;
+    }
+    return ret;
+}
@@ -0,0 +1,90 @@
+/*
+ * afchash
+ *
+ * digests for sum and --verify, BLAKE3 (the default) and SHA-256 (for checking
+ * against sha256sum on the other end). both are written out here in plain C,
+ * no library to link and the same code on every platform this builds on.
+ *
+ * BLAKE3 hashes 1k chunks into a binary tree, so a long run of input can be
+ * split into subtrees that are hashed side by side. an update of at least
+ * AFC_HASH_PARALLEL_MIN bytes is spread over up to afc_hash_threads threads
+ * this way, the digest is the same however many took part. on a transfer that
+ * means one 4m read at a time, on a local file the whole file in large blocks.
+ * SHA-256 is one long chain and always runs on the calling thread.
+ */
+
+#ifndef _afchash_h
+#define _afchash_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "afclocal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_HASH_DIGEST_SIZE    32                  // both algorithms give 256 bits
+#define AFC_HASH_HEX_SIZE       (AFC_HASH_DIGEST_SIZE * 2 + 1)
+#define AFC_HASH_PARALLEL_MIN   (1024 * 1024)       // smaller updates stay on the calling thread
+#define AFC_HASH_MAX_THREADS    16
+
+typedef enum {
+    AFC_HASH_BLAKE3 = 0,
+    AFC_HASH_SHA256
+} afc_hash_algo_t;
+
+#define AFC_BLAKE3_MAX_DEPTH    54
+
+typedef struct afc_blake3_chunk_t {
+    uint32_t cv[8];
+    uint64_t counter;
+    uint8_t buf[64];
+    uint8_t buf_len;
+    uint8_t blocks;             // blocks compressed so far
+} afc_blake3_chunk_t;
+
+typedef struct afc_hash_t {
+    afc_hash_algo_t algo;
+    int threads;
+    union {
+        struct {
+            afc_blake3_chunk_t chunk;
+            uint8_t stack_len;
+            uint8_t stack[(AFC_BLAKE3_MAX_DEPTH + 1) * 32];    // chaining values waiting for a sibling
+        } blake3;
+        struct {
+            uint32_t state[8];
+            uint64_t length;
+            uint8_t buf[64];
+            uint8_t buf_len;
+        } sha256;
+    } u;
+} afc_hash_t;
+
+// 0 means one per cpu, capped at AFC_HASH_MAX_THREADS
+extern int afc_hash_threads;
+
+int afc_hash_parse(const char *arg, afc_hash_algo_t *algo);
+
+const char *afc_hash_name(afc_hash_algo_t algo);
+
+void afc_hash_init(afc_hash_t *hash, afc_hash_algo_t algo);
+
+void afc_hash_update(afc_hash_t *hash, const void *data, size_t length);
+
+// digest as lowercase hex, hex has to hold AFC_HASH_HEX_SIZE
+void afc_hash_final(afc_hash_t *hash, char *hex);
+
+// feeds bytes start to end of local into hash with pread, the offset of local is left alone. errno is set on failure
+int afc_hash_local(afc_hash_t *hash, afc_local_t *local, uint64_t start, uint64_t end);
+
+// hex digest and size of the local file at path. errno is set on failure
+int afc_hash_file(const char *path, afc_hash_algo_t algo, char *hex, uint64_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afchash_h
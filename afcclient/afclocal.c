@@ -0,0 +1,475 @@
+/*
+ * afclocal
+ *
+ * local ends of downloads and uploads, see afclocal.h
+ *
+ * windows has no pread, pwrite or fallocate, there the file is read or written
+ * in order with read() / write() and nothing is reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "afclocal.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <direct.h>
+#include <sys/utime.h>
+#endif
+
+/*
+
+ windows opens files in text mode unless told otherwise, which corrupts anything binary.
+ plists are still written as text there so they read back the same way they always did.
+
+ */
+
+static int afc_local_flags(const char *path, int flags) {
+#if defined(_WIN32)
+    const char *ext = strrchr(path, '.');
+    if (ext && (strcmp(ext, ".plist") == 0 || strcmp(ext, ".PLIST") == 0))
+        flags |= O_TEXT;
+    else
+        flags |= O_BINARY;
+#else
+    (void)path;
+#endif
+    return flags;
+}
+
+// best effort, a filesystem that can't reserve space still gets the file written normally
+static uint64_t afc_local_reserve(int fd, uint64_t size) {
+#if defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+            return 0;
+    }
+    return 0;   // F_PREALLOCATE leaves the file size alone, nothing to trim later
+#elif defined(_WIN32)
+    return 0;
+#else
+    return (posix_fallocate(fd, 0, (off_t)size) == 0) ? size : 0;
+#endif
+}
+
+/*
+
+ a resumed file has to keep its real length, that is where the next run picks up if this one is
+ cut short too. so only what can reserve space past the end without moving it is used here.
+
+ */
+
+static void afc_local_reserve_beyond(int fd, uint64_t offset, uint64_t size) {
+#if defined(__APPLE__)
+    fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)(size - offset), 0 };
+    fcntl(fd, F_PREALLOCATE, &store);
+#elif defined(FALLOC_FL_KEEP_SIZE)
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)(size - offset));
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+#endif
+}
+
+/*
+
+ clone --link-dest leaves files hardlinked to the earlier clone and clone --store to read only
+ objects in the store, truncating one of those in place would rewrite the earlier clone or the
+ object as well (or fail on the 0444 mode). a file with more than one link is unlinked first, so
+ the write lands in a fresh inode and the other names keep what they had.
+
+ */
+
+static int afc_local_unshare(const char *path) {
+#if defined(_WIN32)
+    (void)path;
+#else
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1 && unlink(path) != 0)
+        return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+int afc_local_create(afc_local_t *local, const char *path, uint64_t size) {
+    memset(local, 0, sizeof(afc_local_t));
+
+    if (afc_local_unshare(path) != EXIT_SUCCESS) {
+        local->fd = -1;
+        return EXIT_FAILURE;
+    }
+    local->fd = open(path, afc_local_flags(path, O_WRONLY | O_CREAT | O_TRUNC), 0666);
+    if (local->fd < 0)
+        return EXIT_FAILURE;
+
+    if (size > 0)
+        local->reserved = afc_local_reserve(local->fd, size);
+    return EXIT_SUCCESS;
+}
+
+int afc_local_append(afc_local_t *local, const char *path, uint64_t size) {
+    memset(local, 0, sizeof(afc_local_t));
+
+    // a shared file can't be appended to either, it is started over instead
+    if (afc_local_unshare(path) != EXIT_SUCCESS) {
+        local->fd = -1;
+        return EXIT_FAILURE;
+    }
+    // read as well, the tail check compares what is already there
+    local->fd = open(path, afc_local_flags(path, O_RDWR | O_CREAT), 0666);
+    if (local->fd < 0)
+        return EXIT_FAILURE;
+
+    off_t end = lseek(local->fd, 0, SEEK_END);
+    if (end < 0) {
+        int saved = errno;
+        close(local->fd);
+        local->fd = -1;
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    local->offset = (uint64_t)end;
+
+    if (size > local->offset)
+        afc_local_reserve_beyond(local->fd, local->offset, size);
+    return EXIT_SUCCESS;
+}
+
+int afc_local_truncate(afc_local_t *local, uint64_t length) {
+#if defined(_WIN32)
+    if (_chsize_s(local->fd, (__int64)length) != 0 || _lseeki64(local->fd, (__int64)length, SEEK_SET) < 0)
+        return EXIT_FAILURE;
+#else
+    if (ftruncate(local->fd, (off_t)length) != 0)
+        return EXIT_FAILURE;
+#endif
+    local->offset = length;
+    return EXIT_SUCCESS;
+}
+
+int afc_local_compress(afc_local_t *local, afc_zst_pool_t *pool) {
+    local->zst = afc_zst_open(pool, local->fd);
+    if (!local->zst) {
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_local_write(afc_local_t *local, const char *buf, size_t length) {
+    if (local->zst) {
+        if (afc_zst_write(local->zst, buf, length) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        local->offset += length;
+        return EXIT_SUCCESS;
+    }
+    while (length > 0) {
+#if defined(_WIN32)
+        ssize_t written = write(local->fd, buf, (unsigned int)length);
+#else
+        ssize_t written = pwrite(local->fd, buf, length, (off_t)local->offset);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        if (written == 0) {
+            errno = EIO;
+            return EXIT_FAILURE;
+        }
+        buf += written;
+        length -= written;
+        local->offset += written;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_local_open(afc_local_t *local, const char *path, uint64_t *size) {
+    struct stat st;
+    int flags = O_RDONLY;
+#if defined(_WIN32)
+    flags |= O_BINARY;
+#endif
+
+    memset(local, 0, sizeof(afc_local_t));
+    local->fd = open(path, flags);
+    if (local->fd < 0)
+        return EXIT_FAILURE;
+
+    if (fstat(local->fd, &st) != 0) {
+        int saved = errno;
+        close(local->fd);
+        local->fd = -1;
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    *size = (uint64_t)st.st_size;
+
+    // only a hint, the read-ahead window is what makes the big sequential reads cheap
+#if defined(__APPLE__)
+    fcntl(local->fd, F_RDAHEAD, 1);
+#elif !defined(_WIN32)
+    posix_fadvise(local->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return EXIT_SUCCESS;
+}
+
+int afc_local_seek(afc_local_t *local, uint64_t offset) {
+#if defined(_WIN32)
+    if (_lseeki64(local->fd, (__int64)offset, SEEK_SET) < 0)
+        return EXIT_FAILURE;
+#endif
+    local->offset = offset;
+    return EXIT_SUCCESS;
+}
+
+int afc_local_read(afc_local_t *local, char *buf, size_t length, size_t *got) {
+    *got = 0;
+    while (*got < length) {
+#if defined(_WIN32)
+        ssize_t bytes = read(local->fd, buf + *got, (unsigned int)(length - *got));
+#else
+        ssize_t bytes = pread(local->fd, buf + *got, length - *got, (off_t)local->offset);
+#endif
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        if (bytes == 0)
+            break;
+        *got += bytes;
+        local->offset += bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_local_read_at(afc_local_t *local, char *buf, size_t length, uint64_t at, size_t *got) {
+    *got = 0;
+#if defined(_WIN32)
+    // read() moves the one file position the writes go through as well, put it back after
+    if (_lseeki64(local->fd, (__int64)at, SEEK_SET) < 0)
+        return EXIT_FAILURE;
+#endif
+    while (*got < length) {
+#if defined(_WIN32)
+        ssize_t bytes = read(local->fd, buf + *got, (unsigned int)(length - *got));
+#else
+        ssize_t bytes = pread(local->fd, buf + *got, length - *got, (off_t)(at + *got));
+#endif
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        if (bytes == 0)
+            break;
+        *got += bytes;
+    }
+#if defined(_WIN32)
+    if (_lseeki64(local->fd, (__int64)local->offset, SEEK_SET) < 0)
+        return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}
+
+int afc_local_close(afc_local_t *local) {
+    int ret = EXIT_SUCCESS;
+    if (local->fd < 0)
+        return ret;
+
+    // the last frames and the seek table still have to go out
+    if (local->zst && afc_zst_finish(local->zst) != EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+    local->zst = NULL;
+
+#if !defined(_WIN32)
+    // the file changed on the device since it was listed, don't leave the reserved tail behind
+    if (local->reserved > local->offset && ftruncate(local->fd, (off_t)local->offset) != 0)
+        ret = EXIT_FAILURE;
+#endif
+    if (close(local->fd) != 0)
+        ret = EXIT_FAILURE;
+    local->fd = -1;
+    return ret;
+}
+
+int afc_local_set_mtime(const char *path, uint64_t mtime) {
+#if defined(_WIN32)
+    struct __utimbuf64 times = { (__time64_t)(mtime / 1000000000ULL), (__time64_t)(mtime / 1000000000ULL) };
+    return (_utime64(path, &times) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = (time_t)(mtime / 1000000000ULL);
+    times[1].tv_nsec = (long)(mtime % 1000000000ULL);
+    return (utimensat(AT_FDCWD, path, times, 0) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
+
+#pragma mark - Folders
+
+static uint64_t afc_local_hash(const char *str, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;    // FNV-1a
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// the slot of path[0..len) in the set, empty if it isn't in there
+static const char **afc_local_dirs_slot(afc_local_dirs_t *dirs, const char *path, size_t len) {
+    size_t mask = dirs->capacity - 1;
+    size_t i = (size_t)afc_local_hash(path, len) & mask;
+    while (dirs->slots[i] && (strncmp(dirs->slots[i], path, len) != 0 || dirs->slots[i][len] != '\0'))
+        i = (i + 1) & mask;
+    return &dirs->slots[i];
+}
+
+static int afc_local_dirs_grow(afc_local_dirs_t *dirs) {
+    size_t i, old = dirs->capacity;
+    const char **slots = dirs->slots;
+
+    dirs->capacity = (old) ? old * 2 : 1024;
+    dirs->slots = calloc(dirs->capacity, sizeof(char *));
+    if (!dirs->slots) {
+        dirs->slots = slots;
+        dirs->capacity = old;
+        errno = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < old; i++) {
+        if (slots[i])
+            *afc_local_dirs_slot(dirs, slots[i], strlen(slots[i])) = slots[i];
+    }
+    free(slots);
+    return EXIT_SUCCESS;
+}
+
+static int afc_local_mkdir(afc_local_dirs_t *dirs, const char *rel) {
+#if defined(_WIN32)
+    char full[PATH_MAX];
+    if (snprintf(full, sizeof(full), "%s/%s", dirs->root, rel) >= (int)sizeof(full)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return _mkdir(full);
+#else
+    return mkdirat(dirs->fd, rel, 0777);
+#endif
+}
+
+int afc_local_dirs_open(afc_local_dirs_t *dirs, const char *root) {
+    char partial[PATH_MAX];
+    size_t i, len = strlen(root);
+
+    memset(dirs, 0, sizeof(afc_local_dirs_t));
+    dirs->fd = -1;
+    dirs->root = root;
+    if (len >= sizeof(partial)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+
+    // the root's own parents, the one place a full path is still walked
+    for (i = 1; i <= len; i++) {
+        if (root[i] != '/' && root[i] != '\0')
+            continue;
+        memcpy(partial, root, i);
+        partial[i] = '\0';
+#if defined(_WIN32)
+        if (_mkdir(partial) != 0 && errno != EEXIST && errno != EACCES && i == len)
+#else
+        if (mkdir(partial, 0777) != 0 && errno != EEXIST && i == len)
+#endif
+            return EXIT_FAILURE;
+    }
+
+#if !defined(_WIN32)
+    dirs->fd = open(root, O_RDONLY | O_DIRECTORY);
+    if (dirs->fd < 0)
+        return EXIT_FAILURE;
+#endif
+    if (afc_local_dirs_grow(dirs) != EXIT_SUCCESS) {
+        int saved = errno;
+        afc_local_dirs_close(dirs);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_local_mkdirs(afc_local_dirs_t *dirs, const char *rel) {
+    char partial[PATH_MAX];
+    size_t i, len;
+
+    while (*rel == '/')
+        rel++;
+    len = strlen(rel);
+    while (len > 0 && rel[len-1] == '/')
+        len--;
+    if (len == 0)
+        return EXIT_SUCCESS;
+    if (len >= sizeof(partial)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    if (*afc_local_dirs_slot(dirs, rel, len))
+        return EXIT_SUCCESS;
+
+    // the deepest folder isn't known yet, its parents may be
+    memcpy(partial, rel, len);
+    partial[len] = '\0';
+    for (i = 1; i <= len; i++) {
+        if (partial[i] != '/' && partial[i] != '\0')
+            continue;
+        if (i < len && partial[i+1] == '/')
+            continue;   // "a//b", the next component starts further on
+
+        partial[i] = '\0';
+        const char **slot = afc_local_dirs_slot(dirs, partial, i);
+        if (!*slot) {
+            if (afc_local_mkdir(dirs, partial) != 0 && errno != EEXIST) {
+                partial[i] = (i < len) ? '/' : '\0';
+                return EXIT_FAILURE;
+            }
+            if ((dirs->count + 1) * 2 > dirs->capacity) {
+                if (afc_local_dirs_grow(dirs) != EXIT_SUCCESS)
+                    return EXIT_FAILURE;
+                slot = afc_local_dirs_slot(dirs, partial, i);
+            }
+            *slot = afc_arena_strdup(&dirs->arena, partial);
+            if (!*slot) {
+                errno = ENOMEM;
+                return EXIT_FAILURE;
+            }
+            dirs->count++;
+        }
+        if (i < len)
+            partial[i] = '/';
+    }
+    return EXIT_SUCCESS;
+}
+
+void afc_local_dirs_close(afc_local_dirs_t *dirs) {
+    if (dirs->fd >= 0)
+        close(dirs->fd);
+    free(dirs->slots);
+    afc_arena_free(&dirs->arena);
+    memset(dirs, 0, sizeof(afc_local_dirs_t));
+    dirs->fd = -1;
+}
@@ -0,0 +1,99 @@
+/*
+ * afclocal
+ *
+ * the local end of a transfer. files used to go through stdio, one extra copy
+ * of every chunk into the FILE buffer, 8k at a time. downloads write the afc
+ * read buffer straight out with pwrite at the running offset and, when the size
+ * is known up front, reserve the whole file first so the filesystem can lay it
+ * out in one go. uploads read large blocks with pread after telling the kernel
+ * the file will be read front to back.
+ *
+ * afc_local_dirs_t is the folder side of a clone, an in-process mkdir -p below
+ * the destination that remembers what it already made.
+ */
+
+#ifndef _afclocal_h
+#define _afclocal_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "afcentry.h"
+#include "afczst.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct afc_local_t {
+    int fd;
+    uint64_t offset;        // bytes written or read so far, where the next one goes
+    uint64_t reserved;      // preallocated size, trimmed back on close if the file came up short
+    afc_zst_t *zst;         // clone --compress, writes go through it and offset counts the original bytes
+} afc_local_t;
+
+// creates or truncates path, size > 0 preallocates that much. a path with other hardlinks is
+// unlinked first instead of truncated. errno is set on failure
+int afc_local_create(afc_local_t *local, const char *path, uint64_t size);
+
+// opens path for --resume without truncating it, the offset starts at its current length. size > 0
+// reserves that much without changing the file size, a path with other hardlinks starts over
+// empty. errno is set on failure
+int afc_local_append(afc_local_t *local, const char *path, uint64_t size);
+
+// cuts the file down (or extends it) to length and moves the offset there
+int afc_local_truncate(afc_local_t *local, uint64_t length);
+
+// a file made with afc_local_create and size 0 that keeps its data zstd compressed from here on
+int afc_local_compress(afc_local_t *local, afc_zst_pool_t *pool);
+
+// writes all of buf at the current offset, retrying short writes
+int afc_local_write(afc_local_t *local, const char *buf, size_t length);
+
+// opens path for reading and reports its size. errno is set on failure
+int afc_local_open(afc_local_t *local, const char *path, uint64_t *size);
+
+// moves the offset of a file opened with afc_local_open, for put --resume
+int afc_local_seek(afc_local_t *local, uint64_t offset);
+
+// reads up to length bytes at the current offset, short only at the end of the file (*got == 0 there)
+int afc_local_read(afc_local_t *local, char *buf, size_t length, size_t *got);
+
+// reads up to length bytes at offset at, the running offset is left alone
+int afc_local_read_at(afc_local_t *local, char *buf, size_t length, uint64_t at, size_t *got);
+
+int afc_local_close(afc_local_t *local);
+
+// gives a finished download the st_mtime (in nanoseconds) its source has on the device
+int afc_local_set_mtime(const char *path, uint64_t mtime);
+
+/*
+
+ folders below root are created with mkdirat() relative to an open fd of root, so no path is
+ resolved from the top again, and every folder made or found is kept in a hash set. each one
+ costs one system call the first time and none after, however many files go into it.
+
+ */
+
+typedef struct afc_local_dirs_t {
+    int fd;                 // root, -1 on windows where paths are joined instead
+    const char *root;
+    const char **slots;     // open addressing set of relative paths, owned by arena
+    size_t capacity;
+    size_t count;
+    afc_arena_t arena;
+} afc_local_dirs_t;
+
+// creates root and its parents if needed and opens it. errno is set on failure
+int afc_local_dirs_open(afc_local_dirs_t *dirs, const char *root);
+
+// mkdir -p of rel below root, leading slashes are ignored. errno is set on failure
+int afc_local_mkdirs(afc_local_dirs_t *dirs, const char *rel);
+
+void afc_local_dirs_close(afc_local_dirs_t *dirs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afclocal_h
@@ -0,0 +1,185 @@
+/*
+ * afcmanifest
+ *
+ * manifest of an incremental run, see afcmanifest.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "afcmanifest.h"
+#include "afcwalk.h"
+
+#define AFC_MANIFEST_HEADER "afcmanifest 1\n"
+#define AFC_SUMS_HEADER     "afcsums 1 %s\n"
+
+void afc_manifest_init(afc_manifest_t *manifest) {
+    memset(manifest, 0, sizeof(afc_manifest_t));
+    manifest->sorted = true;
+}
+
+int afc_manifest_add(afc_manifest_t *manifest, const char *path, uint64_t size, uint64_t mtime) {
+    if (strchr(path, '\n'))
+        return EXIT_SUCCESS;
+
+    if (manifest->count == manifest->capacity) {
+        size_t capacity = (manifest->capacity) ? manifest->capacity * 2 : 256;
+        afc_manifest_entry_t *entries = realloc(manifest->entries, capacity * sizeof(afc_manifest_entry_t));
+        if (!entries)
+            return EXIT_FAILURE;
+        manifest->entries = entries;
+        manifest->capacity = capacity;
+    }
+
+    afc_manifest_entry_t *entry = &manifest->entries[manifest->count];
+    entry->path = afc_arena_strdup(&manifest->arena, path);
+    if (!entry->path)
+        return EXIT_FAILURE;
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->seen = false;
+    entry->digest = NULL;
+
+    if (manifest->count > 0 && afc_walk_path_compare(manifest->entries[manifest->count - 1].path, path) >= 0)
+        manifest->sorted = false;
+    manifest->count++;
+    return EXIT_SUCCESS;
+}
+
+static int afc_manifest_read(afc_manifest_t *manifest, const char *path, const char *header, bool sums) {
+    char line[PATH_MAX + 128];
+
+    FILE *in = fopen(path, "r");
+    if (!in)
+        return EXIT_SUCCESS;
+
+    int ret = EXIT_SUCCESS;
+    if (!fgets(line, sizeof(line), in) || strcmp(line, header) != 0) {
+        fprintf(stderr, "Warning: ignoring %s, not a %s this version can read\n", path, (sums) ? "sums file" : "manifest");
+        fclose(in);
+        return ret;
+    }
+
+    while (ret == EXIT_SUCCESS && fgets(line, sizeof(line), in)) {
+        char *end = NULL, *name = NULL;
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n')
+            continue;   // cut off by an interrupted write, or longer than any path
+        line[len - 1] = '\0';
+
+        if (sums) {
+            char *tab = strchr(line, '\t');
+            if (!tab || tab - line != AFC_HASH_HEX_SIZE - 1)
+                continue;
+            *tab = '\0';
+            uint64_t size = strtoull(tab + 1, &name, 10);
+            if (*name != '\t')
+                continue;
+            ret = afc_manifest_add_sum(manifest, name + 1, size, line);
+            continue;
+        }
+
+        uint64_t size = strtoull(line, &end, 10);
+        if (*end != '\t')
+            continue;
+        uint64_t mtime = strtoull(end + 1, &name, 10);
+        if (*name != '\t')
+            continue;
+        ret = afc_manifest_add(manifest, name + 1, size, mtime);
+    }
+    fclose(in);
+    return ret;
+}
+
+int afc_manifest_load(afc_manifest_t *manifest, const char *path) {
+    return afc_manifest_read(manifest, path, AFC_MANIFEST_HEADER, false);
+}
+
+int afc_manifest_load_sums(afc_manifest_t *manifest, const char *path, afc_hash_algo_t algo) {
+    char header[64];
+    snprintf(header, sizeof(header), AFC_SUMS_HEADER, afc_hash_name(algo));
+    return afc_manifest_read(manifest, path, header, true);
+}
+
+int afc_manifest_add_sum(afc_manifest_t *manifest, const char *path, uint64_t size, const char *digest) {
+    if (strchr(path, '\n'))
+        return EXIT_SUCCESS;
+    const char *copy = afc_arena_strdup(&manifest->arena, digest);
+    if (!copy || afc_manifest_add(manifest, path, size, 0) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    manifest->entries[manifest->count - 1].digest = copy;
+    return EXIT_SUCCESS;
+}
+
+static int afc_manifest_compare(const void *a, const void *b) {
+    return afc_walk_path_compare(((const afc_manifest_entry_t *)a)->path, ((const afc_manifest_entry_t *)b)->path);
+}
+
+static void afc_manifest_sort(afc_manifest_t *manifest) {
+    if (!manifest->sorted) {
+        qsort(manifest->entries, manifest->count, sizeof(afc_manifest_entry_t), afc_manifest_compare);
+        manifest->sorted = true;
+    }
+}
+
+afc_manifest_entry_t *afc_manifest_find(afc_manifest_t *manifest, const char *path) {
+    afc_manifest_entry_t key = { .path = path };
+
+    if (manifest->count == 0)
+        return NULL;
+    afc_manifest_sort(manifest);
+    return bsearch(&key, manifest->entries, manifest->count, sizeof(afc_manifest_entry_t), afc_manifest_compare);
+}
+
+static int afc_manifest_write(afc_manifest_t *manifest, const char *path, const char *header, bool sums) {
+    char tmp[PATH_MAX];
+    size_t i;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return EXIT_FAILURE;
+
+    FILE *out = fopen(tmp, "w");
+    if (!out)
+        return EXIT_FAILURE;
+
+    afc_manifest_sort(manifest);
+    fputs(header, out);
+    for (i = 0; i < manifest->count; i++) {
+        const afc_manifest_entry_t *entry = &manifest->entries[i];
+        if (sums)
+            fprintf(out, "%s\t%llu\t%s\n", (entry->digest) ? entry->digest : "", (unsigned long long)entry->size, entry->path);
+        else
+            fprintf(out, "%llu\t%llu\t%s\n", (unsigned long long)entry->size, (unsigned long long)entry->mtime, entry->path);
+    }
+
+    if (fclose(out) != 0) {
+        remove(tmp);
+        return EXIT_FAILURE;
+    }
+#if defined(_WIN32)
+    remove(path);   // rename() won't replace an existing file there
+#endif
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_manifest_save(afc_manifest_t *manifest, const char *path) {
+    return afc_manifest_write(manifest, path, AFC_MANIFEST_HEADER, false);
+}
+
+int afc_manifest_save_sums(afc_manifest_t *manifest, const char *path, afc_hash_algo_t algo) {
+    char header[64];
+    snprintf(header, sizeof(header), AFC_SUMS_HEADER, afc_hash_name(algo));
+    return afc_manifest_write(manifest, path, header, true);
+}
+
+void afc_manifest_free(afc_manifest_t *manifest) {
+    free(manifest->entries);
+    afc_arena_free(&manifest->arena);
+    memset(manifest, 0, sizeof(afc_manifest_t));
+}
@@ -0,0 +1,78 @@
+/*
+ * afcmanifest
+ *
+ * what an incremental run remembers about the files it copied: the path, and
+ * the st_size and st_mtime the source had when it was copied. the next run
+ * compares each entry of its walk against this instead of moving the file
+ * again, and whatever is in the manifest but no longer in the walk was
+ * deleted at the source since.
+ *
+ * kept as a plain text file at the top of the destination, one
+ * "size<tab>mtime<tab>path" line per file. it is written to a temporary file
+ * and renamed over the old one, so an interrupted run leaves the previous
+ * manifest intact and at worst copies some files again.
+ *
+ * clone --verify keeps a second one next to it, .afcclient-sums, with the
+ * digest of every file in the tree in place of the mtime:
+ * "digest<tab>size<tab>path" under a header that names the algorithm.
+ */
+
+#ifndef _afcmanifest_h
+#define _afcmanifest_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "afcentry.h"
+#include "afchash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_MANIFEST_NAME   ".afcclient-manifest"
+#define AFC_SUMS_NAME       ".afcclient-sums"
+
+typedef struct afc_manifest_entry_t {
+    const char *path;
+    uint64_t size;
+    uint64_t mtime;         // nanoseconds, as the device reports them
+    bool seen;              // set by the caller once the walk has come across it
+    const char *digest;     // hex, sums only
+} afc_manifest_entry_t;
+
+typedef struct afc_manifest_t {
+    afc_manifest_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    bool sorted;
+    afc_arena_t arena;
+} afc_manifest_t;
+
+void afc_manifest_init(afc_manifest_t *manifest);
+
+// reads path into an empty manifest, a missing file is an empty manifest and not an error
+int afc_manifest_load(afc_manifest_t *manifest, const char *path);
+
+// paths with a newline can't be written out, they are left out and always copied again
+int afc_manifest_add(afc_manifest_t *manifest, const char *path, uint64_t size, uint64_t mtime);
+
+afc_manifest_entry_t *afc_manifest_find(afc_manifest_t *manifest, const char *path);
+
+int afc_manifest_save(afc_manifest_t *manifest, const char *path);
+
+// the same for a sums file, one with digests of another algorithm loads empty
+int afc_manifest_load_sums(afc_manifest_t *manifest, const char *path, afc_hash_algo_t algo);
+
+int afc_manifest_add_sum(afc_manifest_t *manifest, const char *path, uint64_t size, const char *digest);
+
+int afc_manifest_save_sums(afc_manifest_t *manifest, const char *path, afc_hash_algo_t algo);
+
+void afc_manifest_free(afc_manifest_t *manifest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcmanifest_h
@@ -0,0 +1,351 @@
+/*
+ * afcout
+ *
+ * ndjson / tsv / bplist record writers, see afcout.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "afcout.h"
+
+static const struct {
+    afc_out_format_t format;
+    const char *name;
+} afc_out_formats[] = {
+    { AFC_OUT_TEXT,   "text" },
+    { AFC_OUT_XML,    "xml" },
+    { AFC_OUT_NDJSON, "ndjson" },
+    { AFC_OUT_TSV,    "tsv" },
+    { AFC_OUT_BPLIST, "bplist" },
+};
+
+int afc_out_parse_format(const char *arg, afc_out_format_t *format) {
+    size_t i;
+    for (i = 0; i < sizeof(afc_out_formats) / sizeof(afc_out_formats[0]); i++) {
+        if (strcmp(arg, afc_out_formats[i].name) == 0) {
+            *format = afc_out_formats[i].format;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+bool afc_out_is_records(afc_out_format_t format) {
+    return format == AFC_OUT_NDJSON || format == AFC_OUT_TSV || format == AFC_OUT_BPLIST;
+}
+
+#pragma mark - Escaping
+
+static bool afc_out_append(char **buf, size_t *len, size_t *cap, const char *data, size_t size) {
+    if (*len + size + 1 > *cap) {
+        size_t grown = (*cap) ? *cap * 2 : 256;
+        while (grown < *len + size + 1)
+            grown *= 2;
+        char *tmp = realloc(*buf, grown);
+        if (!tmp)
+            return false;
+        *buf = tmp;
+        *cap = grown;
+    }
+    memcpy(*buf + *len, data, size);
+    *len += size;
+    (*buf)[*len] = '\0';
+    return true;
+}
+
+static void afc_out_tsv_escaped(afc_out_t *out, const char *str) {
+    const char *start = str;
+    const char *cur;
+
+    for (cur = str; *cur; cur++) {
+        const char *rep = NULL;
+        switch (*cur) {
+            case '\t':
+                rep = "\\t";
+                break;
+            case '\n':
+                rep = "\\n";
+                break;
+            case '\r':
+                rep = "\\r";
+                break;
+            case '\\':
+                rep = "\\\\";
+                break;
+            default:
+                continue;
+        }
+        afc_out_append(&out->row, &out->rowlen, &out->rowcap, start, cur - start);
+        afc_out_append(&out->row, &out->rowlen, &out->rowcap, rep, 2);
+        start = cur + 1;
+    }
+    afc_out_append(&out->row, &out->rowlen, &out->rowcap, start, cur - start);
+}
+
+// length of the well formed utf-8 sequence at s, 0 when it isn't one
+static size_t afc_out_utf8_length(const unsigned char *s) {
+    unsigned char lo = 0x80, hi = 0xbf;
+    size_t len, i;
+
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        len = 2;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        len = 3;
+        if (s[0] == 0xe0)
+            lo = 0xa0;      // overlong
+        else if (s[0] == 0xed)
+            hi = 0x9f;      // utf-16 surrogates
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        len = 4;
+        if (s[0] == 0xf0)
+            lo = 0x90;      // overlong
+        else if (s[0] == 0xf4)
+            hi = 0x8f;      // above U+10FFFF
+    } else {
+        return 0;
+    }
+    if (s[1] < lo || s[1] > hi)
+        return 0;
+    for (i = 2; i < len; i++) {
+        if (s[i] < 0x80 || s[i] > 0xbf)
+            return 0;
+    }
+    return len;
+}
+
+// device names are bytes, not necessarily utf-8, anything that isn't becomes U+FFFD so every line stays valid json
+static void afc_out_json_escaped(FILE *fp, const char *str) {
+    const unsigned char *start = (const unsigned char *)str;
+    const unsigned char *cur = start;
+
+    fputc('"', fp);
+    while (*cur) {
+        if (*cur >= 0x80) {
+            size_t len = afc_out_utf8_length(cur);
+            if (len) {
+                cur += len;
+                continue;
+            }
+        } else if (*cur >= 0x20 && *cur != '"' && *cur != '\\') {
+            cur++;
+            continue;
+        }
+
+        fwrite(start, 1, cur - start, fp);
+        switch (*cur) {
+            case '"':
+                fputs("\\\"", fp);
+                break;
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+            case '\n':
+                fputs("\\n", fp);
+                break;
+            case '\r':
+                fputs("\\r", fp);
+                break;
+            case '\t':
+                fputs("\\t", fp);
+                break;
+            default:
+                if (*cur >= 0x80)
+                    fputs("\\ufffd", fp);
+                else
+                    fprintf(fp, "\\u%04x", *cur);
+                break;
+        }
+        start = ++cur;
+    }
+    fwrite(start, 1, cur - start, fp);
+    fputc('"', fp);
+}
+
+#pragma mark - Records
+
+void afc_out_begin(afc_out_t *out, afc_out_format_t format, FILE *fp) {
+    memset(out, 0, sizeof(afc_out_t));
+    out->format = format;
+    out->out = fp;
+    if (format == AFC_OUT_BPLIST)
+        out->array = plist_new_array();
+}
+
+void afc_out_record_begin(afc_out_t *out) {
+    out->fields = 0;
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            fputc('{', out->out);
+            break;
+        case AFC_OUT_TSV:
+            out->rowlen = 0;
+            break;
+        case AFC_OUT_BPLIST:
+            out->dict = plist_new_dict();
+            break;
+        default:
+            break;
+    }
+}
+
+// everything up to the value: separators, the key, and the tsv header on the first record
+static void afc_out_key(afc_out_t *out, const char *key) {
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            if (out->fields)
+                fputc(',', out->out);
+            afc_out_json_escaped(out->out, key);
+            fputc(':', out->out);
+            break;
+        case AFC_OUT_TSV:
+            if (out->fields)
+                afc_out_append(&out->row, &out->rowlen, &out->rowcap, "\t", 1);
+            if (out->records == 0) {
+                if (out->fields)
+                    afc_out_append(&out->header, &out->headerlen, &out->headercap, "\t", 1);
+                afc_out_append(&out->header, &out->headerlen, &out->headercap, key, strlen(key));
+            }
+            break;
+        default:
+            break;
+    }
+    out->fields++;
+}
+
+void afc_out_string(afc_out_t *out, const char *key, const char *val) {
+    afc_out_key(out, key);
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            if (val)
+                afc_out_json_escaped(out->out, val);
+            else
+                fputs("null", out->out);
+            break;
+        case AFC_OUT_TSV:
+            if (val)
+                afc_out_tsv_escaped(out, val);
+            break;
+        case AFC_OUT_BPLIST:
+            if (val)
+                plist_dict_set_item(out->dict, key, plist_new_string(val));
+            break;
+        default:
+            break;
+    }
+}
+
+void afc_out_uint(afc_out_t *out, const char *key, uint64_t val) {
+    char num[32];
+    int len = snprintf(num, sizeof(num), "%" PRIu64, val);
+
+    afc_out_key(out, key);
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            fwrite(num, 1, len, out->out);
+            break;
+        case AFC_OUT_TSV:
+            afc_out_append(&out->row, &out->rowlen, &out->rowcap, num, len);
+            break;
+        case AFC_OUT_BPLIST:
+            plist_dict_set_item(out->dict, key, plist_new_uint(val));
+            break;
+        default:
+            break;
+    }
+}
+
+void afc_out_bool(afc_out_t *out, const char *key, bool val) {
+    afc_out_key(out, key);
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            fputs((val) ? "true" : "false", out->out);
+            break;
+        case AFC_OUT_TSV:
+            afc_out_append(&out->row, &out->rowlen, &out->rowcap, (val) ? "1" : "0", 1);
+            break;
+        case AFC_OUT_BPLIST:
+            plist_dict_set_item(out->dict, key, plist_new_bool(val));
+            break;
+        default:
+            break;
+    }
+}
+
+void afc_out_record_end(afc_out_t *out) {
+    switch (out->format) {
+        case AFC_OUT_NDJSON:
+            fputs("}\n", out->out);
+            break;
+        case AFC_OUT_TSV:
+            if (out->records == 0 && out->header) {
+                fwrite(out->header, 1, out->headerlen, out->out);
+                fputc('\n', out->out);
+                free(out->header);
+                out->header = NULL;
+            }
+            if (out->row)
+                fwrite(out->row, 1, out->rowlen, out->out);
+            fputc('\n', out->out);
+            break;
+        case AFC_OUT_BPLIST:
+            plist_array_append_item(out->array, out->dict);
+            out->dict = NULL;
+            break;
+        default:
+            break;
+    }
+    out->records++;
+}
+
+void afc_out_entry(afc_out_t *out, const afc_entry_t *entry) {
+    afc_out_columns(out, entry, AFC_ENTRY_HAS_ALL);
+}
+
+void afc_out_columns(afc_out_t *out, const afc_entry_t *entry, unsigned int columns) {
+    afc_out_record_begin(out);
+    afc_out_string(out, "path", entry->path);
+    if (columns & AFC_ENTRY_HAS_TYPE)
+        afc_out_string(out, "st_ifmt", afc_entry_type_name(entry->type));
+    if (columns & AFC_ENTRY_HAS_SIZE)
+        afc_out_uint(out, "st_size", entry->size);
+    if (columns & AFC_ENTRY_HAS_BLOCKS)
+        afc_out_uint(out, "st_blocks", entry->blocks);
+    if (columns & AFC_ENTRY_HAS_NLINK)
+        afc_out_uint(out, "st_nlink", entry->nlink);
+    if (columns & AFC_ENTRY_HAS_MTIME)
+        afc_out_uint(out, "st_mtime", entry->mtime);
+    if (columns & AFC_ENTRY_HAS_BIRTHTIME)
+        afc_out_uint(out, "st_birthtime", entry->birthtime);
+    if (columns & AFC_ENTRY_HAS_LINK)
+        afc_out_string(out, "LinkTarget", entry->link);
+    afc_out_record_end(out);
+}
+
+void afc_out_name(afc_out_t *out, const char *path) {
+    afc_out_record_begin(out);
+    afc_out_string(out, "path", path);
+    afc_out_record_end(out);
+}
+
+int afc_out_end(afc_out_t *out) {
+    int ret = EXIT_SUCCESS;
+
+    if (out->format == AFC_OUT_BPLIST && out->array) {
+        char *bin = NULL;
+        uint32_t length = 0;
+        plist_to_bin(out->array, &bin, &length);
+        if (bin && fwrite(bin, 1, length, out->out) != length)
+            ret = EXIT_FAILURE;
+        free(bin);
+        plist_free(out->array);
+        out->array = NULL;
+    }
+    free(out->row);
+    free(out->header);
+    out->row = NULL;
+    out->header = NULL;
+    fflush(out->out);
+    return ret;
+}
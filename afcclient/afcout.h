@@ -0,0 +1,87 @@
+/*
+ * afcout
+ *
+ * record output for --format=ndjson|tsv|bplist. a record is a flat set of
+ * key/value fields (strings, unsigned integers, bools) written the moment it
+ * is finished:
+ *
+ *   ndjson   one JSON object per line
+ *   tsv      a header line taken from the first record's keys, then one row
+ *            per record. tab, newline, CR and backslash are escaped as \t \n \r \\
+ *   bplist   a binary plist array of dicts. the format has its offset table at
+ *            the end, so this one is collected and written by afc_out_end
+ *
+ * times are raw nanoseconds as the device reports them, not formatted dates.
+ */
+
+#ifndef _afcout_h
+#define _afcout_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "plist/plist.h"
+#include "afcentry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum afc_out_format_t {
+    AFC_OUT_TEXT = 0,       // the regular human readable output
+    AFC_OUT_XML,            // same as -x
+    AFC_OUT_NDJSON,
+    AFC_OUT_TSV,
+    AFC_OUT_BPLIST
+} afc_out_format_t;
+
+typedef struct afc_out_t {
+    afc_out_format_t format;
+    FILE *out;
+    size_t records;
+    size_t fields;          // in the current record
+    char *row;              // tsv: the row being built
+    size_t rowlen;
+    size_t rowcap;
+    char *header;           // tsv: column names, only until the first row is out
+    size_t headerlen;
+    size_t headercap;
+    plist_t array;          // bplist
+    plist_t dict;           // bplist: the current record
+} afc_out_t;
+
+int afc_out_parse_format(const char *arg, afc_out_format_t *format);
+
+// ndjson, tsv and bplist are written through afc_out, text and xml keep their own printers
+bool afc_out_is_records(afc_out_format_t format);
+
+void afc_out_begin(afc_out_t *out, afc_out_format_t format, FILE *fp);
+
+void afc_out_record_begin(afc_out_t *out);
+
+// NULL is written as null (ndjson), an empty column (tsv) or left out (bplist)
+void afc_out_string(afc_out_t *out, const char *key, const char *val);
+
+void afc_out_uint(afc_out_t *out, const char *key, uint64_t val);
+
+void afc_out_bool(afc_out_t *out, const char *key, bool val);
+
+void afc_out_record_end(afc_out_t *out);
+
+// one listing entry, always the same columns so tsv stays rectangular
+void afc_out_entry(afc_out_t *out, const afc_entry_t *entry);
+
+// the path and the AFC_ENTRY_HAS_* columns asked for, -1 --stat. the same set for every record
+void afc_out_columns(afc_out_t *out, const afc_entry_t *entry, unsigned int columns);
+
+// --names-only, a record with just the path column
+void afc_out_name(afc_out_t *out, const char *path);
+
+int afc_out_end(afc_out_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcout_h
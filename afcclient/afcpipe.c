@@ -0,0 +1,334 @@
+/*
+ * afcpipe
+ *
+ * reader/writer pipelines for get and put, see afcpipe.h
+ *
+ * each ring holds as many slots as there are buffers, so a push never finds it
+ * full and only the popping side ever has to wait. the consumer spins a little
+ * and then parks on a condition variable; the producer only takes the lock to
+ * wake it when it announced that it is parked. both sides use sequentially
+ * consistent atomics for tail and waiting, which is what keeps a wakeup from
+ * slipping in between the consumer's last check and its wait.
+ *
+ * a buffer with length 0 tells the consumer the producer is done. a consumer
+ * that fails keeps recycling buffers until it sees it, so the producer never
+ * blocks on a side that went away. on put the afc writer is the consumer and
+ * it raises stop so the read-ahead thread winds down instead of reading the
+ * rest of the file for nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "afcpipe.h"
+#include "libidev.h"
+
+#define AFC_PIPE_SPINS 64   // empty ring checks before parking
+
+int afc_io_buffers = AFC_PIPE_DEFAULT_BUFFERS;
+
+typedef struct afc_pipe_buf_t {
+    char *data;
+    uint32_t size;
+    uint32_t length;            // bytes read into it, 0 ends the copy
+} afc_pipe_buf_t;
+
+typedef struct afc_pipe_ring_t {
+    afc_pipe_buf_t **slots;
+    size_t mask;
+    atomic_size_t head;         // only moved by the consumer
+    atomic_size_t tail;         // only moved by the producer
+    atomic_int waiting;         // consumer is parked on cond
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} afc_pipe_ring_t;
+
+typedef struct afc_pipe_t {
+    afc_pipe_ring_t full;       // producer -> consumer
+    afc_pipe_ring_t empty;      // consumer -> producer
+    afc_pipe_buf_t *bufs;
+    int count;
+    afc_local_t *local;
+    afc_hash_t *hash;           // hashed on the local side, next to the disk io
+    pthread_t thread;           // the local side
+    atomic_ullong written;      // get: bytes the writer thread has put on disk
+    atomic_int error;           // errno of the first failed local read or write
+    atomic_int stop;            // put: the afc side gave up
+} afc_pipe_t;
+
+#pragma mark - Rings
+
+static int afc_pipe_ring_init(afc_pipe_ring_t *ring, int count) {
+    size_t size = 1;
+    while (size < (size_t)count)
+        size <<= 1;
+
+    memset(ring, 0, sizeof(afc_pipe_ring_t));
+    ring->slots = calloc(size, sizeof(afc_pipe_buf_t *));
+    if (!ring->slots)
+        return EXIT_FAILURE;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->waiting, 0);
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+    return EXIT_SUCCESS;
+}
+
+static void afc_pipe_ring_destroy(afc_pipe_ring_t *ring) {
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+    free(ring->slots);
+}
+
+static void afc_pipe_ring_push(afc_pipe_ring_t *ring, afc_pipe_buf_t *buf) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring->slots[tail & ring->mask] = buf;
+    atomic_store(&ring->tail, tail + 1);
+
+    if (atomic_load(&ring->waiting)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_signal(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+static afc_pipe_buf_t *afc_pipe_ring_pop(afc_pipe_ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    int spins = 0;
+
+    while (atomic_load(&ring->tail) == head) {
+        if (++spins < AFC_PIPE_SPINS)
+            continue;
+
+        pthread_mutex_lock(&ring->lock);
+        atomic_store(&ring->waiting, 1);
+        while (atomic_load(&ring->tail) == head)
+            pthread_cond_wait(&ring->cond, &ring->lock);
+        atomic_store(&ring->waiting, 0);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    afc_pipe_buf_t *buf = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return buf;
+}
+
+#pragma mark - Setup
+
+static int afc_pipe_start(afc_pipe_t *pipe, afc_local_t *local, afc_hash_t *hash, void *(*fn)(void *)) {
+    int i;
+
+    memset(pipe, 0, sizeof(afc_pipe_t));
+    pipe->count = afc_io_buffers;
+    pipe->local = local;
+    pipe->hash = hash;
+    atomic_init(&pipe->written, local->offset);     // a resumed download starts part way in
+    atomic_init(&pipe->error, 0);
+    atomic_init(&pipe->stop, 0);
+
+    pipe->bufs = calloc(pipe->count, sizeof(afc_pipe_buf_t));
+    if (!pipe->bufs)
+        return EXIT_FAILURE;
+    if (afc_pipe_ring_init(&pipe->full, pipe->count) != EXIT_SUCCESS) {
+        free(pipe->bufs);
+        return EXIT_FAILURE;
+    }
+    if (afc_pipe_ring_init(&pipe->empty, pipe->count) != EXIT_SUCCESS) {
+        afc_pipe_ring_destroy(&pipe->full);
+        free(pipe->bufs);
+        return EXIT_FAILURE;
+    }
+    if (pthread_create(&pipe->thread, NULL, fn, pipe) != 0) {
+        afc_pipe_ring_destroy(&pipe->empty);
+        afc_pipe_ring_destroy(&pipe->full);
+        free(pipe->bufs);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < pipe->count; i++)
+        afc_pipe_ring_push(&pipe->empty, &pipe->bufs[i]);
+
+    if (idev_verbose)
+        fprintf(stderr, "[debug] pipelined copy with %d buffers\n", pipe->count);
+    return EXIT_SUCCESS;
+}
+
+// the end marker has to be on its way already, this waits for the local side and cleans up
+static void afc_pipe_finish(afc_pipe_t *pipe, int *local_error) {
+    int i;
+
+    pthread_join(pipe->thread, NULL);
+    *local_error = atomic_load(&pipe->error);
+
+    for (i = 0; i < pipe->count; i++) {
+        if (pipe->bufs[i].data)
+            afc_xfer_buffer_free(pipe->bufs[i].data);
+    }
+    free(pipe->bufs);
+    afc_pipe_ring_destroy(&pipe->empty);
+    afc_pipe_ring_destroy(&pipe->full);
+}
+
+#pragma mark - Download
+
+static void *afc_pipe_writer(void *arg) {
+    afc_pipe_t *pipe = arg;
+    afc_pipe_buf_t *buf;
+
+    while ((buf = afc_pipe_ring_pop(&pipe->full))->length > 0) {
+        if (atomic_load(&pipe->error) == 0) {
+            if (afc_local_write(pipe->local, buf->data, buf->length) == EXIT_SUCCESS) {
+                if (pipe->hash)
+                    afc_hash_update(pipe->hash, buf->data, buf->length);
+                atomic_fetch_add(&pipe->written, buf->length);
+            } else
+                atomic_store(&pipe->error, (errno) ? errno : EIO);
+        }
+        afc_pipe_ring_push(&pipe->empty, buf);
+    }
+    return NULL;
+}
+
+// one thread, one buffer: what download_afc_file used to do by itself
+static afc_error_t afc_pipe_copy_serial(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error) {
+    afc_error_t err;
+    uint32_t bytes_read = 0;
+
+    while ((err = afc_xfer_read(afc, handle, xfer, &bytes_read)) == AFC_E_SUCCESS && bytes_read > 0) {
+        if (afc_local_write(local, xfer->buf, bytes_read) != EXIT_SUCCESS) {
+            *local_error = (errno) ? errno : EIO;
+            break;
+        }
+        if (xfer->hash)
+            afc_hash_update(xfer->hash, xfer->buf, bytes_read);
+        if (progress)
+            progress(local->offset, ctx);
+    }
+    return err;
+}
+
+afc_error_t afc_pipe_copy(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error) {
+    afc_pipe_t pipe;
+
+    *local_error = 0;
+    if (afc_io_buffers < 2 || xfer->mode == AFC_XFER_SINGLE || afc_pipe_start(&pipe, local, xfer->hash, afc_pipe_writer) != EXIT_SUCCESS)
+        return afc_pipe_copy_serial(afc, handle, xfer, local, progress, ctx, local_error);
+
+    afc_error_t err = AFC_E_SUCCESS;
+    afc_pipe_buf_t *buf;
+    for (;;) {
+        buf = afc_pipe_ring_pop(&pipe.empty);
+        if (atomic_load(&pipe.error) != 0)
+            break;
+
+        uint32_t bytes_read = 0;
+        if (!afc_xfer_buffer_grow(&buf->data, &buf->size, afc_xfer_next_size(xfer))) {
+            err = AFC_E_NO_MEM;
+            break;
+        }
+        err = afc_xfer_read_into(afc, handle, xfer, buf->data, &bytes_read);
+        if (err != AFC_E_SUCCESS || bytes_read == 0)
+            break;
+
+        buf->length = bytes_read;
+        afc_pipe_ring_push(&pipe.full, buf);
+        if (progress)
+            progress(atomic_load(&pipe.written), ctx);
+    }
+
+    // the buffer still in hand carries the end marker
+    buf->length = 0;
+    afc_pipe_ring_push(&pipe.full, buf);
+    afc_pipe_finish(&pipe, local_error);
+
+    if (progress)
+        progress(atomic_load(&pipe.written), ctx);
+    return err;
+}
+
+#pragma mark - Upload
+
+static void *afc_pipe_reader(void *arg) {
+    afc_pipe_t *pipe = arg;
+    uint32_t length;
+
+    do {
+        afc_pipe_buf_t *buf = afc_pipe_ring_pop(&pipe->empty);
+        size_t got = 0;
+
+        if (!atomic_load(&pipe->stop) && atomic_load(&pipe->error) == 0) {
+            if (!afc_xfer_buffer_grow(&buf->data, &buf->size, AFC_PIPE_UPLOAD_BLOCK))
+                atomic_store(&pipe->error, ENOMEM);
+            else if (afc_local_read(pipe->local, buf->data, AFC_PIPE_UPLOAD_BLOCK, &got) != EXIT_SUCCESS)
+                atomic_store(&pipe->error, (errno) ? errno : EIO);
+            else if (pipe->hash)
+                afc_hash_update(pipe->hash, buf->data, got);
+        }
+
+        // a failed read sends what it has as the end marker, the afc side stops there
+        length = (atomic_load(&pipe->error) == 0) ? (uint32_t)got : 0;
+        buf->length = length;
+        afc_pipe_ring_push(&pipe->full, buf);
+    } while (length > 0);
+
+    return NULL;
+}
+
+static afc_error_t afc_pipe_upload_serial(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error) {
+    afc_error_t err = AFC_E_SUCCESS;
+    uint32_t bufsize = 0;
+    char *buf;
+
+    while ((buf = afc_xfer_write_buffer(xfer, &bufsize)) != NULL) {
+        size_t got = 0;
+        uint32_t written = 0;
+
+        if (afc_local_read(local, buf, bufsize, &got) != EXIT_SUCCESS) {
+            *local_error = (errno) ? errno : EIO;
+            break;
+        }
+        if (got == 0)
+            break;
+        if (xfer->hash)
+            afc_hash_update(xfer->hash, buf, got);
+
+        err = afc_xfer_write(afc, handle, xfer, buf, (uint32_t)got, &written);
+        if (err != AFC_E_SUCCESS)
+            break;
+        if (progress)
+            progress(xfer->offset, ctx);
+    }
+    if (!buf)
+        err = AFC_E_NO_MEM;
+    return err;
+}
+
+afc_error_t afc_pipe_upload(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error) {
+    afc_pipe_t pipe;
+
+    *local_error = 0;
+    if (afc_io_buffers < 2 || xfer->mode == AFC_XFER_SINGLE || afc_pipe_start(&pipe, local, xfer->hash, afc_pipe_reader) != EXIT_SUCCESS)
+        return afc_pipe_upload_serial(afc, handle, xfer, local, progress, ctx, local_error);
+
+    afc_error_t err = AFC_E_SUCCESS;
+    afc_pipe_buf_t *buf;
+    while ((buf = afc_pipe_ring_pop(&pipe.full))->length > 0) {
+        if (err == AFC_E_SUCCESS) {
+            uint32_t written = 0;
+            err = afc_xfer_write(afc, handle, xfer, buf->data, buf->length, &written);
+            if (err != AFC_E_SUCCESS)
+                atomic_store(&pipe.stop, 1);
+            else if (progress)
+                progress(xfer->offset, ctx);
+        }
+        afc_pipe_ring_push(&pipe.empty, buf);
+    }
+    afc_pipe_finish(&pipe, local_error);
+    return err;
+}
@@ -0,0 +1,56 @@
+/*
+ * afcpipe
+ *
+ * the copy loops of get and put, split in two. the calling thread keeps the
+ * afc requests going while a second thread does the local side, writing
+ * downloaded buffers to disk or reading the next blocks of an upload ahead of
+ * time, so the usb link and the local disk work at the same time instead of
+ * taking turns. on a slow local side (a network share, a busy disk) a file
+ * then takes about as long as the slower of the two instead of their sum.
+ *
+ * buffers go back and forth over two single producer / single consumer rings,
+ * filled ones one way and empty ones back. with only one buffer, or a file
+ * that fits in a single request, there is nothing to overlap and the copy runs
+ * on the calling thread alone.
+ */
+
+#ifndef _afcpipe_h
+#define _afcpipe_h
+
+#include <stdint.h>
+
+#include "libimobiledevice/afc.h"
+#include "afcxfer.h"
+#include "afclocal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_PIPE_DEFAULT_BUFFERS    4
+#define AFC_PIPE_MAX_BUFFERS        64
+#define AFC_PIPE_UPLOAD_BLOCK       AFC_XFER_MAX_CHUNK  // local read size on put, never less than one request
+
+// --io-buffers, a download buffer grows to the transfer chunk size, an upload buffer is one AFC_PIPE_UPLOAD_BLOCK
+extern int afc_io_buffers;
+
+// called on the calling thread with the bytes moved so far
+typedef void (*afc_pipe_progress_fn)(uint64_t done, void *ctx);
+
+/*
+
+ copies the open afc file behind handle into local until the end of the file. returns the
+ afc read error, a failed local write stops the copy and leaves its errno in local_error
+ (0 when the local side was fine). progress may be NULL.
+
+ */
+afc_error_t afc_pipe_copy(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error);
+
+// the other way around, local is read to its end and written to handle. bytes sent end up in xfer->offset
+afc_error_t afc_pipe_upload(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, afc_local_t *local, afc_pipe_progress_fn progress, void *ctx, int *local_error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcpipe_h
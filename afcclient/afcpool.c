@@ -0,0 +1,196 @@
+/*
+ * afcpool
+ *
+ * worker threads with one afc connection each, see afcpool.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "afcpool.h"
+#include "libidev.h"
+
+typedef struct afc_pool_job_t {
+    afc_pool_job_fn fn;
+    void *arg;
+    struct afc_pool_job_t *next;
+} afc_pool_job_t;
+
+typedef struct afc_pool_worker_t {
+    afc_pool_t *pool;
+    idev_afc_connection_t con;
+    pthread_t thread;
+    bool started;
+} afc_pool_worker_t;
+
+struct afc_pool_t {
+    int count;
+    afc_pool_worker_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // a job was queued or the pool is shutting down
+    pthread_cond_t idle;        // the last outstanding job finished
+    pthread_cond_t room;        // a queued job was picked up
+    afc_pool_job_t *head;
+    afc_pool_job_t *tail;
+    int outstanding;            // queued + running
+    int queued;
+    int depth;                  // most jobs queued at once, 0 for no limit
+    int failed;
+    bool shutdown;
+};
+
+static void *afc_pool_worker_main(void *arg) {
+    afc_pool_worker_t *worker = arg;
+    afc_pool_t *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->shutdown)
+            pthread_cond_wait(&pool->work, &pool->lock);
+
+        if (!pool->head)
+            break;
+
+        afc_pool_job_t *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pool->queued--;
+        pthread_cond_signal(&pool->room);
+        pthread_mutex_unlock(&pool->lock);
+
+        int ret = job->fn(worker->con.afc, job->arg);
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (ret != EXIT_SUCCESS)
+            pool->failed++;
+        if (--pool->outstanding == 0)
+            pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+afc_pool_t *afc_pool_new(int workers) {
+    if (workers < 1)
+        return NULL;
+
+    afc_pool_t *pool = calloc(1, sizeof(afc_pool_t));
+    if (!pool)
+        return NULL;
+
+    pool->workers = calloc(workers, sizeof(afc_pool_worker_t));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pthread_cond_init(&pool->room, NULL);
+
+    // connections first, lockdownd is not ours to share once the threads are running
+    int i;
+    for (i = 0; i < workers; i++) {
+        if (idev_afc_connection_open(&pool->workers[pool->count].con) != EXIT_SUCCESS)
+            break;
+        pool->workers[pool->count].pool = pool;
+        pool->count++;
+    }
+
+    if (pool->count < workers)
+        fprintf(stderr, "Warning: only %d of %d afc connections could be opened\n", pool->count, workers);
+
+    int started = 0;
+    for (i = 0; i < pool->count; i++) {
+        afc_pool_worker_t *worker = &pool->workers[i];
+        if (pthread_create(&worker->thread, NULL, afc_pool_worker_main, worker) == 0) {
+            worker->started = true;
+            started++;
+        }
+    }
+
+    if (started == 0) {
+        afc_pool_free(pool);
+        return NULL;
+    }
+
+    if (idev_verbose)
+        fprintf(stderr, "[debug] started %d afc workers\n", started);
+
+    return pool;
+}
+
+int afc_pool_size(afc_pool_t *pool) {
+    return (pool) ? pool->count : 0;
+}
+
+int afc_pool_submit(afc_pool_t *pool, afc_pool_job_fn fn, void *arg) {
+    afc_pool_job_t *job = calloc(1, sizeof(afc_pool_job_t));
+    if (!job)
+        return EXIT_FAILURE;
+
+    job->fn = fn;
+    job->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->depth > 0 && pool->queued >= pool->depth)
+        pthread_cond_wait(&pool->room, &pool->lock);
+    if (pool->tail)
+        pool->tail->next = job;
+    else
+        pool->head = job;
+    pool->tail = job;
+    pool->queued++;
+    pool->outstanding++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    return EXIT_SUCCESS;
+}
+
+void afc_pool_set_depth(afc_pool_t *pool, int depth) {
+    pthread_mutex_lock(&pool->lock);
+    pool->depth = (depth > 0) ? depth : 0;
+    pthread_cond_broadcast(&pool->room);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int afc_pool_wait(afc_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->outstanding > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    int failed = pool->failed;
+    pool->failed = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    return failed;
+}
+
+void afc_pool_free(afc_pool_t *pool) {
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    int i;
+    for (i = 0; i < pool->count; i++) {
+        if (pool->workers[i].started)
+            pthread_join(pool->workers[i].thread, NULL);
+        idev_afc_connection_close(&pool->workers[i].con);
+    }
+
+    pthread_cond_destroy(&pool->room);
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,52 @@
+/*
+ * afcpool
+ *
+ * a fixed set of worker threads, each owning its own afc connection opened on
+ * the lockdown session of the running command (see idev_afc_connection_open),
+ * pulling jobs from one shared queue.
+ *
+ * afc clients are not safe to share between threads, so a job only ever gets
+ * the connection of the worker that runs it.
+ */
+
+#ifndef _afcpool_h
+#define _afcpool_h
+
+#include "libimobiledevice/afc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct afc_pool_t afc_pool_t;
+
+// a unit of work, returns EXIT_SUCCESS or EXIT_FAILURE
+typedef int (*afc_pool_job_fn)(afc_client_t afc, void *arg);
+
+// opens up to workers connections and starts one thread per connection, NULL if none could be opened
+afc_pool_t *afc_pool_new(int workers);
+
+int afc_pool_size(afc_pool_t *pool);
+
+int afc_pool_submit(afc_pool_t *pool, afc_pool_job_fn fn, void *arg);
+
+/*
+
+ caps the jobs waiting for a worker, afc_pool_submit then blocks until one is picked up. lets
+ a producer that finds work faster than it gets done (a walk feeding transfers) run ahead by
+ at most depth jobs instead of queueing everything. 0, the default, is no limit.
+
+ */
+void afc_pool_set_depth(afc_pool_t *pool, int depth);
+
+// blocks until every submitted job has run, returns how many of them failed
+int afc_pool_wait(afc_pool_t *pool);
+
+// waits for outstanding jobs, stops the threads and closes their connections
+void afc_pool_free(afc_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcpool_h
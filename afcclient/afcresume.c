@@ -0,0 +1,99 @@
+/*
+ * afcresume
+ *
+ * resume sidecars and the tail check, see afcresume.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "afcresume.h"
+#include "afcclient.h"
+#include "libidev.h"
+
+static int afc_resume_path(const char *path, char *sidecar, size_t len) {
+    int n = snprintf(sidecar, len, "%s%s", path, AFC_RESUME_SUFFIX);
+    return (n > 0 && (size_t)n < len) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int afc_resume_load(const char *path, uint64_t *size, uint64_t *mtime) {
+    char sidecar[PATH_MAX];
+    unsigned long long s = 0, m = 0;
+    int ret = EXIT_FAILURE;
+
+    if (afc_resume_path(path, sidecar, sizeof(sidecar)) != EXIT_SUCCESS)
+        return ret;
+
+    FILE *in = fopen(sidecar, "r");
+    if (!in)
+        return ret;
+    if (fscanf(in, "afcpart 1\nst_size %llu\nst_mtime %llu\n", &s, &m) == 2) {
+        *size = s;
+        *mtime = m;
+        ret = EXIT_SUCCESS;
+    }
+    fclose(in);
+    return ret;
+}
+
+int afc_resume_save(const char *path, uint64_t size, uint64_t mtime) {
+    char sidecar[PATH_MAX];
+
+    if (afc_resume_path(path, sidecar, sizeof(sidecar)) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    FILE *out = fopen(sidecar, "w");
+    if (!out)
+        return EXIT_FAILURE;
+    fprintf(out, "afcpart 1\nst_size %llu\nst_mtime %llu\n", (unsigned long long)size, (unsigned long long)mtime);
+    return (fclose(out) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void afc_resume_clear(const char *path) {
+    char sidecar[PATH_MAX];
+
+    if (afc_resume_path(path, sidecar, sizeof(sidecar)) == EXIT_SUCCESS)
+        remove(sidecar);
+}
+
+afc_error_t afc_resume_check_tail(afc_client_t afc, uint64_t handle, afc_local_t *local, uint64_t offset, bool *match) {
+    uint32_t length = (offset < AFC_RESUME_CHECK) ? (uint32_t)offset : AFC_RESUME_CHECK;
+    uint64_t start = offset - length;
+    uint32_t have = 0;
+    size_t got = 0;
+
+    *match = false;
+    char *remote = malloc(length ? length : 1);
+    char *mine = malloc(length ? length : 1);
+    if (!remote || !mine) {
+        free(remote);
+        free(mine);
+        return AFC_E_NO_MEM;
+    }
+
+    afc_error_t err = afc_file_seek(afc, handle, (int64_t)start, SEEK_SET);
+    while (err == AFC_E_SUCCESS && have < length) {
+        uint32_t bytes = 0;
+        err = afc_file_read(afc, handle, remote + have, length - have, &bytes);
+        if (err == AFC_E_SUCCESS && bytes == 0)
+            break;
+        have += bytes;
+    }
+
+    if (err == AFC_E_SUCCESS && have == length && afc_local_read_at(local, mine, length, start, &got) == EXIT_SUCCESS && got == length)
+        *match = (memcmp(remote, mine, length) == 0);
+
+    if (idev_verbose)
+        fprintf(stderr, "[debug] resume check of %u bytes before %llu: %s\n", length, (unsigned long long)offset, (*match) ? "match" : "mismatch");
+
+    // a short read leaves the position short of offset, put it where the transfer goes on
+    if (err == AFC_E_SUCCESS && have != length)
+        err = afc_file_seek(afc, handle, (int64_t)offset, SEEK_SET);
+
+    free(remote);
+    free(mine);
+    return err;
+}
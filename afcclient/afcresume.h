@@ -0,0 +1,54 @@
+/*
+ * afcresume
+ *
+ * what --resume needs to pick an interrupted transfer back up instead of
+ * starting over.
+ *
+ * a download keeps a small sidecar next to the partial file, <file>.afcpart,
+ * with the st_size and st_mtime the remote file had when it started. a later
+ * run only appends to the partial file when the remote one still has both, so
+ * a file that changed on the device in between is fetched again from scratch.
+ * the sidecar is written before the first byte and removed once the file is
+ * complete.
+ *
+ * before appending, the last block of what is already there is read from both
+ * ends and compared, which catches a partial file that was cut off in the
+ * middle of a write or touched by something else.
+ */
+
+#ifndef _afcresume_h
+#define _afcresume_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libimobiledevice/afc.h"
+#include "afclocal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_RESUME_SUFFIX   ".afcpart"
+#define AFC_RESUME_CHECK    (64 * 1024)     // bytes compared at the end of the existing prefix
+
+int afc_resume_load(const char *path, uint64_t *size, uint64_t *mtime);
+
+int afc_resume_save(const char *path, uint64_t size, uint64_t mtime);
+
+void afc_resume_clear(const char *path);
+
+/*
+
+ compares the AFC_RESUME_CHECK bytes before offset in the remote file behind handle with the
+ same range of local, *match says whether they agree. the handle is left at offset either way
+ so the transfer can go on from there.
+
+ */
+afc_error_t afc_resume_check_tail(afc_client_t afc, uint64_t handle, afc_local_t *local, uint64_t offset, bool *match);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcresume_h
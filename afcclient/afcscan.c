@@ -0,0 +1,333 @@
+/*
+ * afcscan
+ *
+ * local folder walk, see afcscan.h
+ *
+ * folders waiting to be read sit on one shared queue, AFC_SCAN_THREADS workers
+ * take them off, read them and put the folders they find back on. pending
+ * counts queued + being read, the scan is done when it drops to zero. every
+ * worker fills its own entry array and arena, they are concatenated and sorted
+ * once at the end like afc_walk does.
+ *
+ * folders are opened with openat() relative to the root and their entries
+ * stat'ed with fstatat() relative to the open folder, so no full path is ever
+ * built or looked up again from the top. windows has neither, there the full
+ * path is put together for opendir() and stat().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "afcscan.h"
+#include "libidev.h"
+
+typedef struct afc_scan_dir_t {
+    const char *rel;                // "" for the root, otherwise owned by the arena of the worker that found it
+    struct afc_scan_dir_t *next;
+} afc_scan_dir_t;
+
+typedef struct afc_scan_t afc_scan_t;
+
+typedef struct afc_scan_worker_t {
+    afc_scan_t *scan;
+    pthread_t thread;
+    afc_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    afc_arena_t arena;
+} afc_scan_worker_t;
+
+struct afc_scan_t {
+    const char *root;
+    int rootfd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    afc_scan_dir_t *head;
+    afc_scan_dir_t *tail;
+    int pending;
+    bool failed;                    // out of memory somewhere, the result would be incomplete
+    int error;                      // errno of the root when even that couldn't be read
+    afc_scan_dir_t *unread;         // folders that couldn't be read, marked in the tree at the end
+    afc_scan_worker_t workers[AFC_SCAN_THREADS];
+};
+
+uint64_t afc_scan_mtime(const struct stat *st) {
+#if defined(__APPLE__)
+    return (uint64_t)st->st_mtimespec.tv_sec * 1000000000ULL + (uint64_t)st->st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return (uint64_t)st->st_mtime * 1000000000ULL;
+#else
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + (uint64_t)st->st_mtim.tv_nsec;
+#endif
+}
+
+#pragma mark - Local file system
+
+static DIR *afc_scan_opendir(afc_scan_t *scan, const char *rel) {
+#if defined(_WIN32)
+    char full[PATH_MAX];
+    if (snprintf(full, sizeof(full), "%s%s%s", scan->root, (*rel) ? "/" : "", rel) >= (int)sizeof(full)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return opendir(full);
+#else
+    int fd = openat(scan->rootfd, (*rel) ? rel : ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return NULL;
+    DIR *dir = fdopendir(fd);
+    if (!dir)
+        close(fd);
+    return dir;
+#endif
+}
+
+// a symlink to a regular file is that file, anything else behind a link is left alone
+static int afc_scan_stat(afc_scan_t *scan, DIR *dir, const char *rel, const char *name, struct stat *st) {
+#if defined(_WIN32)
+    (void)dir;
+    char full[PATH_MAX];
+    if (snprintf(full, sizeof(full), "%s/%s%s%s", scan->root, rel, (*rel) ? "/" : "", name) >= (int)sizeof(full))
+        return -1;
+    return stat(full, st);
+#else
+    (void)scan;
+    (void)rel;
+    if (fstatat(dirfd(dir), name, st, AT_SYMLINK_NOFOLLOW) != 0)
+        return -1;
+    if (S_ISLNK(st->st_mode) && (fstatat(dirfd(dir), name, st, 0) != 0 || !S_ISREG(st->st_mode)))
+        return -1;
+    return 0;
+#endif
+}
+
+#pragma mark - Workers
+
+static afc_entry_t *afc_scan_add(afc_scan_worker_t *worker, const char *rel, const char *name, afc_entry_type_t type, const struct stat *st) {
+    if (worker->count == worker->capacity) {
+        size_t capacity = (worker->capacity) ? worker->capacity * 2 : 256;
+        afc_entry_t *entries = realloc(worker->entries, capacity * sizeof(afc_entry_t));
+        if (!entries)
+            return NULL;
+        worker->entries = entries;
+        worker->capacity = capacity;
+    }
+
+    size_t rlen = strlen(rel), nlen = strlen(name);
+    char *path = afc_arena_alloc(&worker->arena, rlen + nlen + 2);
+    if (!path)
+        return NULL;
+    if (rlen) {
+        memcpy(path, rel, rlen);
+        path[rlen++] = '/';
+    }
+    memcpy(path + rlen, name, nlen + 1);
+
+    afc_entry_t *entry = &worker->entries[worker->count++];
+    memset(entry, 0, sizeof(afc_entry_t));
+    entry->path = path;
+    entry->type = type;
+    entry->size = (type == AFC_ENTRY_FILE) ? (uint64_t)st->st_size : 0;
+    entry->nlink = (uint64_t)st->st_nlink;
+    entry->mtime = afc_scan_mtime(st);
+    return entry;
+}
+
+static bool afc_scan_push(afc_scan_t *scan, const char *rel) {
+    afc_scan_dir_t *item = malloc(sizeof(afc_scan_dir_t));
+    if (!item)
+        return false;
+    item->rel = rel;
+    item->next = NULL;
+
+    pthread_mutex_lock(&scan->lock);
+    if (scan->tail)
+        scan->tail->next = item;
+    else
+        scan->head = item;
+    scan->tail = item;
+    scan->pending++;
+    pthread_cond_signal(&scan->cond);
+    pthread_mutex_unlock(&scan->lock);
+    return true;
+}
+
+// rel is remembered and its entry gets unread set once the tree is sorted
+static bool afc_scan_unread(afc_scan_t *scan, const char *rel, int error) {
+    afc_scan_dir_t *item = NULL;
+
+    if (*rel && !(item = malloc(sizeof(afc_scan_dir_t))))
+        return false;
+    pthread_mutex_lock(&scan->lock);
+    if (item) {
+        item->rel = rel;
+        item->next = scan->unread;
+        scan->unread = item;
+    } else {
+        scan->error = error;
+    }
+    pthread_mutex_unlock(&scan->lock);
+    return true;
+}
+
+static bool afc_scan_read(afc_scan_worker_t *worker, const char *rel) {
+    afc_scan_t *scan = worker->scan;
+    struct dirent *de;
+
+    DIR *dir = afc_scan_opendir(scan, rel);
+    if (!dir) {
+        int error = errno;
+        fprintf(stderr, "Error: could not read %s/%s: %s\n", scan->root, rel, strerror(error));
+        return afc_scan_unread(scan, rel, error);
+    }
+
+    bool ok = true;
+    while (ok && (de = readdir(dir))) {
+        struct stat st;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+        if (afc_scan_stat(scan, dir, rel, de->d_name, &st) != 0) {
+            if (idev_verbose)
+                fprintf(stderr, "[debug] skipping %s/%s%s%s\n", scan->root, rel, (*rel) ? "/" : "", de->d_name);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            afc_entry_t *entry = afc_scan_add(worker, rel, de->d_name, AFC_ENTRY_DIR, &st);
+            ok = (entry && afc_scan_push(scan, entry->path));
+        } else if (S_ISREG(st.st_mode)) {
+            ok = (afc_scan_add(worker, rel, de->d_name, AFC_ENTRY_FILE, &st) != NULL);
+        } else if (idev_verbose) {
+            fprintf(stderr, "[debug] not a file or folder, skipping %s/%s%s%s\n", scan->root, rel, (*rel) ? "/" : "", de->d_name);
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+static void *afc_scan_worker(void *arg) {
+    afc_scan_worker_t *worker = arg;
+    afc_scan_t *scan = worker->scan;
+
+    pthread_mutex_lock(&scan->lock);
+    for (;;) {
+        while (!scan->head && scan->pending > 0)
+            pthread_cond_wait(&scan->cond, &scan->lock);
+        if (!scan->head)
+            break;
+
+        afc_scan_dir_t *item = scan->head;
+        scan->head = item->next;
+        if (!scan->head)
+            scan->tail = NULL;
+        pthread_mutex_unlock(&scan->lock);
+
+        bool ok = afc_scan_read(worker, item->rel);
+        free(item);
+
+        pthread_mutex_lock(&scan->lock);
+        if (!ok)
+            scan->failed = true;
+        if (--scan->pending == 0)
+            pthread_cond_broadcast(&scan->cond);
+    }
+    pthread_mutex_unlock(&scan->lock);
+    return NULL;
+}
+
+#pragma mark - Scan
+
+static int afc_scan_compare(const void *a, const void *b) {
+    return afc_walk_path_compare(((const afc_entry_t *)a)->path, ((const afc_entry_t *)b)->path);
+}
+
+int afc_scan(const char *root, afc_tree_t *tree) {
+    afc_scan_t scan;
+    int i, started = 0;
+    size_t total = 0;
+
+    memset(tree, 0, sizeof(afc_tree_t));
+    memset(&scan, 0, sizeof(afc_scan_t));
+    scan.root = root;
+#if defined(_WIN32)
+    DIR *probe = opendir(root);
+    if (!probe)
+        return EXIT_FAILURE;
+    closedir(probe);
+#else
+    scan.rootfd = open(root, O_RDONLY | O_DIRECTORY);
+    if (scan.rootfd < 0)
+        return EXIT_FAILURE;
+#endif
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.cond, NULL);
+
+    int ret = afc_scan_push(&scan, "") ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (i = 0; ret == EXIT_SUCCESS && i < AFC_SCAN_THREADS; i++) {
+        scan.workers[i].scan = &scan;
+        if (pthread_create(&scan.workers[i].thread, NULL, afc_scan_worker, &scan.workers[i]) != 0)
+            break;
+        started++;
+    }
+    if (ret == EXIT_SUCCESS && started == 0)
+        afc_scan_worker(&scan.workers[0]);  // no threads to be had, scan on this one
+    for (i = 0; i < started; i++)
+        pthread_join(scan.workers[i].thread, NULL);
+
+    if (ret == EXIT_SUCCESS && scan.error) {
+        errno = scan.error;
+        ret = EXIT_FAILURE;
+    } else if (ret == EXIT_SUCCESS && scan.failed) {
+        errno = ENOMEM;
+        ret = EXIT_FAILURE;
+    }
+    for (i = 0; i < AFC_SCAN_THREADS; i++)
+        total += scan.workers[i].count;
+    if (ret == EXIT_SUCCESS && total > 0 && !(tree->entries = malloc(total * sizeof(afc_entry_t)))) {
+        errno = ENOMEM;
+        ret = EXIT_FAILURE;
+    }
+
+    for (i = 0; i < AFC_SCAN_THREADS; i++) {
+        afc_scan_worker_t *worker = &scan.workers[i];
+        if (ret == EXIT_SUCCESS && worker->count) {
+            memcpy(tree->entries + tree->count, worker->entries, worker->count * sizeof(afc_entry_t));
+            tree->count += worker->count;
+        }
+        afc_arena_merge(&tree->arena, &worker->arena);
+        free(worker->entries);
+    }
+
+    pthread_cond_destroy(&scan.cond);
+    pthread_mutex_destroy(&scan.lock);
+#if !defined(_WIN32)
+    close(scan.rootfd);
+#endif
+
+    if (ret == EXIT_SUCCESS)
+        qsort(tree->entries, tree->count, sizeof(afc_entry_t), afc_scan_compare);
+    while (scan.unread) {
+        afc_scan_dir_t *item = scan.unread;
+        afc_entry_t key = { .path = item->rel };
+        afc_entry_t *entry = (ret == EXIT_SUCCESS) ? bsearch(&key, tree->entries, tree->count, sizeof(afc_entry_t), afc_scan_compare) : NULL;
+        if (entry)
+            entry->unread = true;
+        scan.unread = item->next;
+        free(item);
+    }
+
+    if (ret != EXIT_SUCCESS) {
+        int saved = errno;
+        afc_tree_free(tree);
+        errno = saved;
+    }
+    return ret;
+}
@@ -0,0 +1,47 @@
+/*
+ * afcscan
+ *
+ * the local half of a recursive upload. walks a local folder into the same
+ * afc_tree_t an afc_walk gives for the device, sizes and mtimes in the units
+ * the device reports them in and sorted in the same order, so the two sides
+ * can be compared entry by entry.
+ *
+ * folders are read by a few threads at once, on a tree of many small folders
+ * the time goes into waiting on the disk for each one rather than into cpu.
+ *
+ * only folders and regular files are picked up. a symlink to a file counts as
+ * that file, a symlink to a folder is not followed, which also keeps a link
+ * back up the tree from turning the scan into a loop.
+ */
+
+#ifndef _afcscan_h
+#define _afcscan_h
+
+#include <sys/stat.h>
+
+#include "afcwalk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_SCAN_THREADS    4
+
+/*
+
+ scans everything below root into tree, paths relative to root and without a leading slash.
+ a folder that can't be read is reported and kept with unread set, so a caller comparing trees
+ can tell its contents apart from an empty folder. returns EXIT_FAILURE when root itself can't
+ be read, with errno set.
+
+ */
+int afc_scan(const char *root, afc_tree_t *tree);
+
+// st_mtime in nanoseconds, the way the device reports it
+uint64_t afc_scan_mtime(const struct stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcscan_h
@@ -0,0 +1,275 @@
+/*
+ * afcsegment
+ *
+ * segmented transfers, see afcsegment.h
+ *
+ * every range is one pool job. a job only ever touches its own range of the
+ * local file, with pwrite through a copy of the afc_local_t on a download and
+ * pread on an upload, so they don't get in each other's way. what is shared,
+ * the byte count for progress and the stop flag, sits behind one lock that is
+ * taken once per chunk.
+ *
+ * upload ranges all open their handle before any of them writes. a device that
+ * only takes one writer per file answers the second open with OBJECT_BUSY, and
+ * then nothing has been written yet and the caller can go on with one stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "afcsegment.h"
+#include "afcxfer.h"
+#include "afcpool.h"
+#include "libidev.h"
+
+typedef struct afc_segment_t {
+    const char *path;           // the file on the device
+    afc_local_t *local;
+    afc_file_mode_t mode;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // uploads, every range has tried to open its handle
+    int count;
+    int opened;
+    uint64_t total;             // bytes moved by all ranges together
+    bool stop;                  // a range failed, the others give up at their next chunk
+    bool busy;                  // the device refused one of the upload handles with OBJECT_BUSY
+    afc_pipe_progress_fn progress;
+    void *ctx;
+} afc_segment_t;
+
+typedef struct afc_segment_range_t {
+    afc_segment_t *segment;
+    uint64_t start;
+    uint64_t end;
+    uint64_t done;              // bytes of this range written, from its start
+    afc_error_t err;
+    int local_error;
+} afc_segment_range_t;
+
+static double afc_segment_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int afc_segment_count(uint64_t size, int connections) {
+#if defined(_WIN32)
+    // afc_local_write is a plain write() at the file position there, not a pwrite
+    (void)size;
+    (void)connections;
+    return 1;
+#else
+    if (connections < 2 || size < AFC_SEGMENT_MIN_FILE)
+        return 1;
+    uint64_t most = size / AFC_SEGMENT_MIN_RANGE;
+    return ((uint64_t)connections > most) ? (int)most : connections;
+#endif
+}
+
+// counts a chunk into the total, false when another range has failed in the meantime
+static bool afc_segment_moved(afc_segment_t *segment, uint32_t bytes) {
+    pthread_mutex_lock(&segment->lock);
+    segment->total += bytes;
+    if (segment->progress)
+        segment->progress(segment->total, segment->ctx);
+    bool go = !segment->stop;
+    pthread_mutex_unlock(&segment->lock);
+    return go;
+}
+
+static void afc_segment_fail(afc_segment_t *segment) {
+    pthread_mutex_lock(&segment->lock);
+    segment->stop = true;
+    pthread_cond_broadcast(&segment->ready);
+    pthread_mutex_unlock(&segment->lock);
+}
+
+// waits until every range has opened its handle, false if one of them couldn't
+static bool afc_segment_opened(afc_segment_t *segment, afc_error_t err) {
+    pthread_mutex_lock(&segment->lock);
+    segment->opened++;
+    if (err != AFC_E_SUCCESS) {
+        segment->stop = true;
+        segment->busy = segment->busy || err == AFC_E_OBJECT_BUSY;
+    }
+    pthread_cond_broadcast(&segment->ready);
+    while (!segment->stop && segment->opened < segment->count)
+        pthread_cond_wait(&segment->ready, &segment->lock);
+    bool go = !segment->stop;
+    pthread_mutex_unlock(&segment->lock);
+    return go;
+}
+
+static afc_error_t afc_segment_get(afc_client_t afc, uint64_t handle, afc_segment_range_t *range, afc_xfer_t *xfer) {
+    afc_segment_t *segment = range->segment;
+    afc_local_t out = { .fd = segment->local->fd, .offset = range->start };
+    afc_error_t err = AFC_E_SUCCESS;
+    bool go = true;
+
+    while (go && xfer->offset < range->end) {
+        uint32_t bytes = 0;
+        err = afc_xfer_read(afc, handle, xfer, &bytes);
+        if (err == AFC_E_SUCCESS && bytes == 0)
+            err = AFC_E_END_OF_DATA;   // the file got shorter since it was stat'ed
+        if (err != AFC_E_SUCCESS)
+            break;
+        if (afc_local_write(&out, xfer->buf, bytes) != EXIT_SUCCESS) {
+            range->local_error = errno;
+            break;
+        }
+        range->done = out.offset - range->start;
+        go = afc_segment_moved(segment, bytes);
+    }
+    return err;
+}
+
+static afc_error_t afc_segment_put(afc_client_t afc, uint64_t handle, afc_segment_range_t *range, afc_xfer_t *xfer) {
+    afc_segment_t *segment = range->segment;
+    afc_error_t err = AFC_E_SUCCESS;
+    bool go = true;
+
+    while (go && xfer->offset < range->end) {
+        uint32_t want = 0, written = 0;
+        size_t got = 0;
+        char *buf = afc_xfer_write_buffer(xfer, &want);
+        if (!buf) {
+            err = AFC_E_NO_MEM;
+            break;
+        }
+        if (afc_local_read_at(segment->local, buf, want, xfer->offset, &got) != EXIT_SUCCESS || got == 0) {
+            range->local_error = (got == 0) ? EIO : errno;   // 0 is the local file getting shorter
+            break;
+        }
+        err = afc_xfer_write(afc, handle, xfer, buf, (uint32_t)got, &written);
+        range->done = xfer->offset - range->start;
+        if (err != AFC_E_SUCCESS)
+            break;
+        go = afc_segment_moved(segment, written);
+    }
+    return err;
+}
+
+static int afc_segment_run(afc_client_t afc, void *arg) {
+    afc_segment_range_t *range = arg;
+    afc_segment_t *segment = range->segment;
+    bool upload = (segment->mode != AFC_FOPEN_RDONLY);
+    uint64_t handle = 0;
+
+    afc_error_t err = afc_file_open(afc, segment->path, segment->mode, &handle);
+    // another range that couldn't open is the error, this one just stays empty
+    bool go = (!upload || afc_segment_opened(segment, err));
+    if (err == AFC_E_SUCCESS && go && range->start > 0)
+        err = afc_file_seek(afc, handle, (int64_t)range->start, SEEK_SET);
+
+    if (err == AFC_E_SUCCESS && go) {
+        afc_xfer_t xfer;
+        // expected is the end of the range, the request sizing only ever looks at what is left of it
+        afc_xfer_init(&xfer, range->end);
+        xfer.offset = range->start;
+        xfer.limit = range->end;
+        err = (upload) ? afc_segment_put(afc, handle, range, &xfer) : afc_segment_get(afc, handle, range, &xfer);
+        if (idev_verbose)
+            fprintf(stderr, "[debug] range %llu-%llu of %s: %llu bytes\n", (unsigned long long)range->start, (unsigned long long)range->end, segment->path, (unsigned long long)range->done);
+        afc_xfer_free(&xfer);
+    }
+    if (handle)
+        afc_file_close(afc, handle);
+
+    range->err = err;
+    if (err != AFC_E_SUCCESS || range->local_error) {
+        afc_segment_fail(segment);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static afc_error_t afc_segment_transfer(afc_segment_t *segment, uint64_t size, int connections, int *local_error, int *used, double *seconds) {
+    afc_local_t *local = segment->local;
+    afc_error_t err = AFC_E_SUCCESS;
+    int i;
+
+    *local_error = 0;
+    *used = 0;
+    *seconds = 0;
+
+    double start = afc_segment_now();
+    afc_pool_t *pool = afc_pool_new(afc_segment_count(size, connections));
+    if (!pool)
+        return AFC_E_SERVICE_NOT_CONNECTED;
+    segment->count = afc_pool_size(pool);
+
+    afc_segment_range_t *ranges = calloc(segment->count, sizeof(afc_segment_range_t));
+    if (!ranges) {
+        afc_pool_free(pool);
+        return AFC_E_NO_MEM;
+    }
+    pthread_mutex_init(&segment->lock, NULL);
+    pthread_cond_init(&segment->ready, NULL);
+
+    uint64_t each = size / segment->count;
+    for (i = 0; i < segment->count; i++) {
+        ranges[i].segment = segment;
+        ranges[i].start = each * i;
+        ranges[i].end = (i == segment->count - 1) ? size : each * (i + 1);
+        if (afc_pool_submit(pool, afc_segment_run, &ranges[i]) != EXIT_SUCCESS) {
+            ranges[i].err = AFC_E_NO_MEM;
+            afc_segment_fail(segment);
+        }
+    }
+    afc_pool_wait(pool);
+    afc_pool_free(pool);
+
+    // the first error in file order, and the piece before the first range that came up short
+    local->offset = 0;
+    bool whole = true;
+    for (i = 0; i < segment->count; i++) {
+        if (err == AFC_E_SUCCESS && *local_error == 0) {
+            err = ranges[i].err;
+            *local_error = ranges[i].local_error;
+        }
+        if (whole)
+            local->offset = ranges[i].start + ranges[i].done;
+        whole = whole && ranges[i].start + ranges[i].done == ranges[i].end;
+    }
+
+    if (segment->busy) {
+        err = AFC_E_OBJECT_BUSY;
+        *local_error = 0;
+    } else {
+        *used = segment->count;
+    }
+    *seconds = afc_segment_now() - start;
+    pthread_cond_destroy(&segment->ready);
+    pthread_mutex_destroy(&segment->lock);
+    free(ranges);
+    return err;
+}
+
+afc_error_t afc_segment_download(const char *src, afc_local_t *local, uint64_t size, int connections, afc_pipe_progress_fn progress, void *ctx, int *local_error, int *used, double *seconds) {
+    afc_segment_t segment;
+
+    memset(&segment, 0, sizeof(afc_segment_t));
+    segment.path = src;
+    segment.local = local;
+    segment.mode = AFC_FOPEN_RDONLY;
+    segment.progress = progress;
+    segment.ctx = ctx;
+    return afc_segment_transfer(&segment, size, connections, local_error, used, seconds);
+}
+
+afc_error_t afc_segment_upload(const char *dst, afc_local_t *local, uint64_t size, int connections, afc_pipe_progress_fn progress, void *ctx, int *local_error, int *used, double *seconds) {
+    afc_segment_t segment;
+
+    memset(&segment, 0, sizeof(afc_segment_t));
+    segment.path = dst;
+    segment.local = local;
+    segment.mode = AFC_FOPEN_RW;
+    segment.progress = progress;
+    segment.ctx = ctx;
+    return afc_segment_transfer(&segment, size, connections, local_error, used, seconds);
+}
@@ -0,0 +1,69 @@
+/*
+ * afcsegment
+ *
+ * one large file pulled over several connections at once. a single handle
+ * reads one request after the other, on a multi GB file it is the round trip
+ * of every request that sets the pace rather than the link. here the file is
+ * cut into as many contiguous ranges as there are connections, every range
+ * gets its own read handle on its own connection (an afc_pool worker), seeks
+ * to its start and pwrites what it reads straight into place in the local
+ * file, which was reserved at full size before.
+ *
+ * uploads work the same way the other way around: the remote file is sized
+ * with afc_file_truncate first and every range writes through its own
+ * AFC_FOPEN_RW handle.
+ *
+ * the ranges fill in side by side, so an interrupted run leaves holes rather
+ * than a clean prefix. --resume relies on that prefix and keeps to a single
+ * handle.
+ */
+
+#ifndef _afcsegment_h
+#define _afcsegment_h
+
+#include <stdint.h>
+
+#include "libimobiledevice/afc.h"
+#include "afclocal.h"
+#include "afcpipe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_SEGMENT_MIN_FILE    (64 * 1024 * 1024)  // smaller files go through one handle
+#define AFC_SEGMENT_MIN_RANGE   (16 * 1024 * 1024)  // no range is cut smaller than this
+
+// how many ranges a file of size is split into with up to connections connections, 1 means don't
+int afc_segment_count(uint64_t size, int connections);
+
+/*
+
+ copies src, size bytes long, into local (created with afc_local_create and that size) over
+ up to connections new connections. like afc_pipe_copy it returns the first afc error and
+ leaves the errno of a failed local write in local_error, either one stops every range.
+ local->offset ends up at the number of bytes that arrived in one piece from the start.
+ used and seconds get the number of connections it ran on and how long the copy took, used
+ stays 0 when not a single connection could be opened and nothing was tried.
+ progress may be NULL, it is called with the total so far from any of the workers, one
+ at a time.
+
+ */
+afc_error_t afc_segment_download(const char *src, afc_local_t *local, uint64_t size, int connections, afc_pipe_progress_fn progress, void *ctx, int *local_error, int *used, double *seconds);
+
+/*
+
+ afc_segment_download the other way around: local (opened with afc_local_open) goes to dst,
+ which has to exist and already be size bytes long. local is only read with pread, local->offset
+ ends up at the bytes that got across in one piece from the start. a device that refuses more
+ than one writer on a file fails the opens before anything is written, that returns
+ AFC_E_OBJECT_BUSY with used at 0 and dst untouched.
+
+ */
+afc_error_t afc_segment_upload(const char *dst, afc_local_t *local, uint64_t size, int connections, afc_pipe_progress_fn progress, void *ctx, int *local_error, int *used, double *seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcsegment_h
@@ -0,0 +1,631 @@
+/*
+ * afcsim
+ *
+ * stand-in for the parts of libimobiledevice that afcclient uses, backed by a
+ * local directory instead of a device, so transfers can be checked for
+ * byte-exactness and timed without any hardware attached. `make sim` links it
+ * in place of libimobiledevice as afcclient-sim, nothing else changes.
+ *
+ * every afc request sleeps for the configured latency, payload bytes also wait
+ * their turn on one link shared by all connections, which is roughly how usbmux
+ * behaves: more connections hide round trips but don't make the cable faster.
+ *
+ *   AFCSIM_ROOT=<dir>          directory served as the AFC root (default ".")
+ *   AFCSIM_APPS=<dir>          house_arrest containers live in <dir>/<appid>
+ *   AFCSIM_LATENCY_US=<n>      round trip latency added to every AFC request
+ *   AFCSIM_BANDWIDTH=<n>       bytes/sec shared by all connections (0 = unlimited)
+ *   AFCSIM_MAX_PACKET=<n>      reads/writes above n bytes fail with TOO_MUCH_DATA
+ *   AFCSIM_SINGLE_WRITER=1     a second writer on the same path gets OBJECT_BUSY
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define _XOPEN_SOURCE 700
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "libimobiledevice/libimobiledevice.h"
+#include "libimobiledevice/lockdown.h"
+#include "libimobiledevice/afc.h"
+#include "libimobiledevice/house_arrest.h"
+#include "libimobiledevice/installation_proxy.h"
+#include "plist/plist.h"
+
+#define SIM_MAX_HANDLES 64
+
+struct idevice_private { int unused; };
+struct idevice_connection_private { int unused; };
+struct lockdownd_client_private { int unused; };
+struct house_arrest_client_private { char *appid; };
+struct instproxy_client_private { int unused; };
+
+typedef struct sim_handle_t {
+    int fd;
+    bool writer;
+    char *path;
+} sim_handle_t;
+
+struct afc_client_private {
+    char *root;
+    sim_handle_t handles[SIM_MAX_HANDLES];
+};
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static double sim_link_free_at = 0;
+
+static long sim_env(const char *name, long def) {
+    char *v = getenv(name);
+    return (v && *v) ? atol(v) : def;
+}
+
+static double sim_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// every request pays the round trip latency, payload bytes queue up on one shared link
+static void sim_wire(size_t bytes) {
+    long latency = sim_env("AFCSIM_LATENCY_US", 0);
+    long bandwidth = sim_env("AFCSIM_BANDWIDTH", 0);
+    double until = sim_now();
+    if (bandwidth > 0 && bytes > 0) {
+        pthread_mutex_lock(&sim_lock);
+        double start = sim_link_free_at > until ? sim_link_free_at : until;
+        sim_link_free_at = start + (double)bytes / bandwidth;
+        until = sim_link_free_at;
+        pthread_mutex_unlock(&sim_lock);
+    }
+    until += latency / 1e6;
+    double wait = until - sim_now();
+    if (wait > 0)
+        usleep((useconds_t)(wait * 1e6));
+}
+
+static afc_error_t sim_errno(int e) {
+    switch (e) {
+        case ENOENT: case ENOTDIR: return AFC_E_OBJECT_NOT_FOUND;
+        case EEXIST: return AFC_E_OBJECT_EXISTS;
+        case EISDIR: return AFC_E_OBJECT_IS_DIR;
+        case EACCES: case EPERM: return AFC_E_PERM_DENIED;
+        case ENOTEMPTY: return AFC_E_DIR_NOT_EMPTY;
+        case ENOSPC: return AFC_E_NO_SPACE_LEFT;
+        default: return AFC_E_IO_ERROR;
+    }
+}
+
+static char *sim_path(afc_client_t client, const char *path) {
+    char *full = NULL;
+    while (*path == '/')
+        path++;
+    if (asprintf(&full, "%s/%s", client->root, path) < 0)
+        return NULL;
+    return full;
+}
+
+static uint64_t sim_nanoseconds(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static char **sim_list_append(char **list, int *count, const char *s) {
+    list = realloc(list, (*count + 2) * sizeof(char *));
+    list[(*count)++] = strdup(s);
+    list[*count] = NULL;
+    return list;
+}
+
+#pragma mark - idevice / lockdownd
+
+idevice_error_t idevice_new(idevice_t *device, const char *udid) {
+    *device = calloc(1, sizeof(struct idevice_private));
+    return IDEVICE_E_SUCCESS;
+}
+
+idevice_error_t idevice_new_with_options(idevice_t *device, const char *udid, enum idevice_options options) {
+    return idevice_new(device, udid);
+}
+
+idevice_error_t idevice_free(idevice_t device) {
+    free(device);
+    return IDEVICE_E_SUCCESS;
+}
+
+void idevice_set_debug_level(int level) {}
+
+idevice_error_t idevice_get_device_list(char ***devices, int *count) {
+    char **list = calloc(2, sizeof(char *));
+    list[0] = strdup("00000000000000000000000000000000000afc5e");
+    *devices = list;
+    *count = 1;
+    return IDEVICE_E_SUCCESS;
+}
+
+idevice_error_t idevice_device_list_free(char **devices) {
+    if (devices) {
+        int i;
+        for (i = 0; devices[i]; i++)
+            free(devices[i]);
+        free(devices);
+    }
+    return IDEVICE_E_SUCCESS;
+}
+
+idevice_error_t idevice_connect(idevice_t device, uint16_t port, idevice_connection_t *connection) {
+    *connection = calloc(1, sizeof(struct idevice_connection_private));
+    return IDEVICE_E_SUCCESS;
+}
+
+idevice_error_t idevice_disconnect(idevice_connection_t connection) {
+    free(connection);
+    return IDEVICE_E_SUCCESS;
+}
+
+lockdownd_error_t lockdownd_client_new(idevice_t device, lockdownd_client_t *client, const char *label) {
+    *client = calloc(1, sizeof(struct lockdownd_client_private));
+    return LOCKDOWN_E_SUCCESS;
+}
+
+lockdownd_error_t lockdownd_client_new_with_handshake(idevice_t device, lockdownd_client_t *client, const char *label) {
+    return lockdownd_client_new(device, client, label);
+}
+
+lockdownd_error_t lockdownd_client_free(lockdownd_client_t client) {
+    free(client);
+    return LOCKDOWN_E_SUCCESS;
+}
+
+lockdownd_error_t lockdownd_start_service(lockdownd_client_t client, const char *identifier, lockdownd_service_descriptor_t *service) {
+    lockdownd_service_descriptor_t svc = calloc(1, sizeof(struct lockdownd_service_descriptor));
+    svc->port = 1;
+    svc->identifier = strdup(identifier);
+    *service = svc;
+    return LOCKDOWN_E_SUCCESS;
+}
+
+lockdownd_error_t lockdownd_service_descriptor_free(lockdownd_service_descriptor_t service) {
+    if (service) {
+        free(service->identifier);
+        free(service);
+    }
+    return LOCKDOWN_E_SUCCESS;
+}
+
+lockdownd_error_t lockdownd_get_value(lockdownd_client_t client, const char *domain, const char *key, plist_t *value) {
+    plist_t dict = plist_new_dict();
+    plist_dict_set_item(dict, "ProductType", plist_new_string("iPhone10,6"));
+    plist_dict_set_item(dict, "ProductVersion", plist_new_string("16.7"));
+    plist_dict_set_item(dict, "BuildVersion", plist_new_string("20H19"));
+    plist_dict_set_item(dict, "DeviceName", plist_new_string("afcsim"));
+    plist_dict_set_item(dict, "DeviceClass", plist_new_string("iPhone"));
+    plist_dict_set_item(dict, "HardwareModel", plist_new_string("D221AP"));
+    plist_dict_set_item(dict, "HardwarePlatform", plist_new_string("t8015"));
+    plist_dict_set_item(dict, "UniqueDeviceID", plist_new_string("00000000000000000000000000000000000afc5e"));
+    plist_dict_set_item(dict, "UniqueChipID", plist_new_uint(1234));
+    plist_dict_set_item(dict, "PasswordProtected", plist_new_bool(0));
+    *value = dict;
+    return LOCKDOWN_E_SUCCESS;
+}
+
+#pragma mark - installation_proxy / house_arrest
+
+plist_t instproxy_client_options_new(void) {
+    return plist_new_dict();
+}
+
+instproxy_error_t instproxy_client_new(idevice_t device, lockdownd_service_descriptor_t service, instproxy_client_t *client) {
+    *client = calloc(1, sizeof(struct instproxy_client_private));
+    return INSTPROXY_E_SUCCESS;
+}
+
+instproxy_error_t instproxy_client_free(instproxy_client_t client) {
+    free(client);
+    return INSTPROXY_E_SUCCESS;
+}
+
+instproxy_error_t instproxy_browse(instproxy_client_t client, plist_t client_options, plist_t *result) {
+    plist_t apps = plist_new_array();
+    plist_t app = plist_new_dict();
+    plist_dict_set_item(app, "ApplicationType", plist_new_string("User"));
+    plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string("com.example.sim"));
+    plist_dict_set_item(app, "CFBundleDisplayName", plist_new_string("Sim"));
+    plist_dict_set_item(app, "UIFileSharingEnabled", plist_new_bool(1));
+    plist_array_append_item(apps, app);
+    *result = apps;
+    return INSTPROXY_E_SUCCESS;
+}
+
+house_arrest_error_t house_arrest_client_new(idevice_t device, lockdownd_service_descriptor_t service, house_arrest_client_t *client) {
+    *client = calloc(1, sizeof(struct house_arrest_client_private));
+    return HOUSE_ARREST_E_SUCCESS;
+}
+
+house_arrest_error_t house_arrest_client_free(house_arrest_client_t client) {
+    if (client) {
+        free(client->appid);
+        free(client);
+    }
+    return HOUSE_ARREST_E_SUCCESS;
+}
+
+house_arrest_error_t house_arrest_send_command(house_arrest_client_t client, const char *command, const char *appid) {
+    free(client->appid);
+    client->appid = strdup(appid);
+    return HOUSE_ARREST_E_SUCCESS;
+}
+
+house_arrest_error_t house_arrest_get_result(house_arrest_client_t client, plist_t *dict) {
+    *dict = plist_new_dict();
+    plist_dict_set_item(*dict, "Status", plist_new_string("Complete"));
+    return HOUSE_ARREST_E_SUCCESS;
+}
+
+#pragma mark - afc
+
+static afc_client_t sim_client_new(const char *root) {
+    afc_client_t client = calloc(1, sizeof(struct afc_client_private));
+    int i;
+    client->root = strdup(root);
+    for (i = 0; i < SIM_MAX_HANDLES; i++)
+        client->handles[i].fd = -1;
+    return client;
+}
+
+afc_error_t afc_client_new(idevice_t device, lockdownd_service_descriptor_t service, afc_client_t *client) {
+    char *root = getenv("AFCSIM_ROOT");
+    *client = sim_client_new(root ? root : ".");
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_client_new_from_house_arrest_client(house_arrest_client_t ha, afc_client_t *client) {
+    char *apps = getenv("AFCSIM_APPS");
+    char *root = NULL;
+    if (apps && ha->appid) {
+        if (asprintf(&root, "%s/%s", apps, ha->appid) < 0)
+            return AFC_E_NO_MEM;
+    } else {
+        root = strdup(getenv("AFCSIM_ROOT") ? getenv("AFCSIM_ROOT") : ".");
+    }
+    *client = sim_client_new(root);
+    free(root);
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_client_free(afc_client_t client) {
+    if (client) {
+        int i;
+        for (i = 0; i < SIM_MAX_HANDLES; i++) {
+            if (client->handles[i].fd >= 0)
+                close(client->handles[i].fd);
+            free(client->handles[i].path);
+        }
+        free(client->root);
+        free(client);
+    }
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_get_device_info(afc_client_t client, char ***device_information) {
+    int count = 0;
+    char **list = NULL;
+    sim_wire(0);
+    list = sim_list_append(list, &count, "Model");
+    list = sim_list_append(list, &count, "afcsim");
+    list = sim_list_append(list, &count, "FSBlockSize");
+    list = sim_list_append(list, &count, "4096");
+    *device_information = list;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_dictionary_free(char **dictionary) {
+    idevice_device_list_free(dictionary);
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_read_directory(afc_client_t client, const char *path, char ***directory_information) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    DIR *dir = opendir(full);
+    free(full);
+    if (!dir)
+        return (errno == ENOTDIR) ? AFC_E_READ_ERROR : sim_errno(errno);
+    int count = 0;
+    char **list = NULL;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+        list = sim_list_append(list, &count, ent->d_name);
+    closedir(dir);
+    *directory_information = list;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_get_file_info(afc_client_t client, const char *path, char ***file_information) {
+    sim_wire(0);
+    struct stat st;
+    char *full = sim_path(client, path);
+    if (lstat(full, &st) != 0) {
+        free(full);
+        return sim_errno(errno);
+    }
+    int count = 0;
+    char **list = NULL;
+    char num[32];
+    const char *fmt = S_ISDIR(st.st_mode) ? "S_IFDIR" : S_ISLNK(st.st_mode) ? "S_IFLNK" : "S_IFREG";
+    snprintf(num, sizeof(num), "%lld", (long long)st.st_size);
+    list = sim_list_append(list, &count, "st_size");
+    list = sim_list_append(list, &count, num);
+    snprintf(num, sizeof(num), "%lld", (long long)st.st_blocks);
+    list = sim_list_append(list, &count, "st_blocks");
+    list = sim_list_append(list, &count, num);
+    snprintf(num, sizeof(num), "%lld", (long long)st.st_nlink);
+    list = sim_list_append(list, &count, "st_nlink");
+    list = sim_list_append(list, &count, num);
+    list = sim_list_append(list, &count, "st_ifmt");
+    list = sim_list_append(list, &count, fmt);
+#if defined(__APPLE__)
+    uint64_t mtime = sim_nanoseconds(&st.st_mtimespec), birthtime = sim_nanoseconds(&st.st_birthtimespec);
+#else
+    uint64_t mtime = sim_nanoseconds(&st.st_mtim), birthtime = sim_nanoseconds(&st.st_ctim);
+#endif
+    snprintf(num, sizeof(num), "%llu", (unsigned long long)mtime);
+    list = sim_list_append(list, &count, "st_mtime");
+    list = sim_list_append(list, &count, num);
+    snprintf(num, sizeof(num), "%llu", (unsigned long long)birthtime);
+    list = sim_list_append(list, &count, "st_birthtime");
+    list = sim_list_append(list, &count, num);
+    if (S_ISLNK(st.st_mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(full, target, sizeof(target) - 1);
+        target[len > 0 ? len : 0] = '\0';
+        list = sim_list_append(list, &count, "LinkTarget");
+        list = sim_list_append(list, &count, target);
+    }
+    free(full);
+    *file_information = list;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_open(afc_client_t client, const char *filename, afc_file_mode_t file_mode, uint64_t *handle) {
+    static const int flags[] = {
+        0,
+        O_RDONLY,
+        O_RDWR | O_CREAT,
+        O_WRONLY | O_CREAT | O_TRUNC,
+        O_RDWR | O_CREAT | O_TRUNC,
+        O_WRONLY | O_APPEND | O_CREAT,
+        O_RDWR | O_APPEND | O_CREAT
+    };
+    sim_wire(0);
+    if (file_mode < AFC_FOPEN_RDONLY || file_mode > AFC_FOPEN_RDAPPEND)
+        return AFC_E_INVALID_ARG;
+    bool writer = (file_mode != AFC_FOPEN_RDONLY);
+    char *full = sim_path(client, filename);
+    if (writer && sim_env("AFCSIM_SINGLE_WRITER", 0)) {
+        // only checks this connection's handles plus a global marker file
+        char *marker = NULL;
+        if (asprintf(&marker, "%s.afcsim-writer", full) >= 0) {
+            int mfd = open(marker, O_CREAT | O_EXCL | O_WRONLY, 0644);
+            if (mfd < 0) {
+                free(marker);
+                free(full);
+                return AFC_E_OBJECT_BUSY;
+            }
+            close(mfd);
+            free(marker);
+        }
+    }
+    int fd = open(full, flags[file_mode], 0644);
+    if (fd < 0) {
+        afc_error_t err = sim_errno(errno);
+        free(full);
+        return err;
+    }
+    struct stat st;
+    int i;
+    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        close(fd);
+        free(full);
+        return AFC_E_OBJECT_IS_DIR;
+    }
+    pthread_mutex_lock(&sim_lock);
+    for (i = 0; i < SIM_MAX_HANDLES; i++) {
+        if (client->handles[i].fd < 0) {
+            client->handles[i].fd = fd;
+            client->handles[i].writer = writer;
+            client->handles[i].path = full;
+            pthread_mutex_unlock(&sim_lock);
+            *handle = i + 1;
+            return AFC_E_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+    close(fd);
+    free(full);
+    return AFC_E_NO_RESOURCES;
+}
+
+static sim_handle_t *sim_handle(afc_client_t client, uint64_t handle) {
+    if (handle < 1 || handle > SIM_MAX_HANDLES || client->handles[handle - 1].fd < 0)
+        return NULL;
+    return &client->handles[handle - 1];
+}
+
+afc_error_t afc_file_close(afc_client_t client, uint64_t handle) {
+    sim_wire(0);
+    sim_handle_t *h = sim_handle(client, handle);
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    if (h->writer && sim_env("AFCSIM_SINGLE_WRITER", 0)) {
+        char *marker = NULL;
+        if (asprintf(&marker, "%s.afcsim-writer", h->path) >= 0) {
+            unlink(marker);
+            free(marker);
+        }
+    }
+    close(h->fd);
+    free(h->path);
+    h->path = NULL;
+    h->fd = -1;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_lock(afc_client_t client, uint64_t handle, afc_lock_op_t operation) {
+    sim_wire(0);
+    return sim_handle(client, handle) ? AFC_E_SUCCESS : AFC_E_INVALID_ARG;
+}
+
+afc_error_t afc_file_read(afc_client_t client, uint64_t handle, char *data, uint32_t length, uint32_t *bytes_read) {
+    sim_handle_t *h = sim_handle(client, handle);
+    *bytes_read = 0;
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    long max = sim_env("AFCSIM_MAX_PACKET", 0);
+    if (max > 0 && length > (uint32_t)max) {
+        sim_wire(0);
+        return AFC_E_TOO_MUCH_DATA;
+    }
+    ssize_t got = read(h->fd, data, length);
+    if (got < 0) {
+        sim_wire(0);
+        return sim_errno(errno);
+    }
+    sim_wire((size_t)got);
+    *bytes_read = (uint32_t)got;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_write(afc_client_t client, uint64_t handle, const char *data, uint32_t length, uint32_t *bytes_written) {
+    sim_handle_t *h = sim_handle(client, handle);
+    *bytes_written = 0;
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    long max = sim_env("AFCSIM_MAX_PACKET", 0);
+    if (max > 0 && length > (uint32_t)max) {
+        sim_wire(0);
+        return AFC_E_TOO_MUCH_DATA;
+    }
+    sim_wire(length);
+    uint32_t done = 0;
+    while (done < length) {
+        ssize_t put = write(h->fd, data + done, length - done);
+        if (put < 0) {
+            *bytes_written = done;
+            return sim_errno(errno);
+        }
+        done += (uint32_t)put;
+    }
+    *bytes_written = done;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_seek(afc_client_t client, uint64_t handle, int64_t offset, int whence) {
+    sim_wire(0);
+    sim_handle_t *h = sim_handle(client, handle);
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    return (lseek(h->fd, offset, whence) < 0) ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_tell(afc_client_t client, uint64_t handle, uint64_t *position) {
+    sim_wire(0);
+    sim_handle_t *h = sim_handle(client, handle);
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    off_t pos = lseek(h->fd, 0, SEEK_CUR);
+    if (pos < 0)
+        return sim_errno(errno);
+    *position = (uint64_t)pos;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_file_truncate(afc_client_t client, uint64_t handle, uint64_t newsize) {
+    sim_wire(0);
+    sim_handle_t *h = sim_handle(client, handle);
+    if (!h)
+        return AFC_E_INVALID_ARG;
+    return (ftruncate(h->fd, (off_t)newsize) != 0) ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_remove_path(afc_client_t client, const char *path) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    int rc = remove(full);
+    free(full);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_rename_path(afc_client_t client, const char *from, const char *to) {
+    sim_wire(0);
+    char *f = sim_path(client, from), *t = sim_path(client, to);
+    int rc = rename(f, t);
+    free(f);
+    free(t);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_make_directory(afc_client_t client, const char *path) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    int rc = mkdir(full, 0755);
+    free(full);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_truncate(afc_client_t client, const char *path, uint64_t newsize) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    int rc = truncate(full, (off_t)newsize);
+    free(full);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_make_link(afc_client_t client, afc_link_type_t linktype, const char *target, const char *linkname) {
+    sim_wire(0);
+    char *l = sim_path(client, linkname);
+    int rc;
+    if (linktype == AFC_SYMLINK) {
+        rc = symlink(target, l);
+    } else {
+        char *t = sim_path(client, target);
+        rc = link(t, l);
+        free(t);
+    }
+    free(l);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+afc_error_t afc_set_file_time(afc_client_t client, const char *path, uint64_t mtime) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    struct timespec ts[2];
+    ts[0].tv_sec = ts[1].tv_sec = (time_t)(mtime / 1000000000ULL);
+    ts[0].tv_nsec = ts[1].tv_nsec = (long)(mtime % 1000000000ULL);
+    int rc = utimensat(AT_FDCWD, full, ts, AT_SYMLINK_NOFOLLOW);
+    free(full);
+    return rc ? sim_errno(errno) : AFC_E_SUCCESS;
+}
+
+static int sim_remove_one(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+afc_error_t afc_remove_path_and_contents(afc_client_t client, const char *path) {
+    sim_wire(0);
+    char *full = sim_path(client, path);
+    int rc = nftw(full, sim_remove_one, 16, FTW_DEPTH | FTW_PHYS);
+    afc_error_t err = rc ? sim_errno(errno) : AFC_E_SUCCESS;
+    free(full);
+    return err;
+}
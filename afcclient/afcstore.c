@@ -0,0 +1,255 @@
+/*
+ * afcstore
+ *
+ * content addressed objects for clone --store, see afcstore.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <direct.h>
+#endif
+
+#include "afcstore.h"
+
+#define AFC_STORE_COPY_BLOCK    (1024 * 1024)
+
+static int afc_store_mkdir(const char *path) {
+#if defined(_WIN32)
+    int rc = _mkdir(path);
+#else
+    int rc = mkdir(path, 0777);
+#endif
+    return (rc == 0 || errno == EEXIST) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int afc_store_link(const char *from, const char *to) {
+#if defined(_WIN32)
+    (void)from;
+    (void)to;
+    errno = ENOSYS;
+    return -1;
+#else
+    return link(from, to);
+#endif
+}
+
+int afc_store_open(afc_store_t *store, const char *root, afc_hash_algo_t algo) {
+    char path[PATH_MAX];
+
+    memset(store, 0, sizeof(afc_store_t));
+#if defined(_WIN32)
+    errno = ENOSYS;
+    return EXIT_FAILURE;
+#endif
+    store->root = strdup(root);
+    if (!store->root)
+        return EXIT_FAILURE;
+    store->algo = algo;
+
+    snprintf(path, PATH_MAX, "%s/%s", root, afc_hash_name(algo));
+    if (afc_store_mkdir(root) != EXIT_SUCCESS || afc_store_mkdir(path) != EXIT_SUCCESS)
+        goto fail;
+    snprintf(path, PATH_MAX, "%s/%s", root, AFC_STORE_TEMP);
+    if (afc_store_mkdir(path) != EXIT_SUCCESS)
+        goto fail;
+
+    pthread_mutex_init(&store->lock, NULL);
+    return EXIT_SUCCESS;
+
+fail:
+    {
+        int saved = errno;
+        free(store->root);
+        store->root = NULL;
+        errno = saved;
+    }
+    return EXIT_FAILURE;
+}
+
+void afc_store_close(afc_store_t *store) {
+    if (!store->root)
+        return;
+    pthread_mutex_destroy(&store->lock);
+    free(store->root);
+    store->root = NULL;
+}
+
+int afc_store_temp(afc_store_t *store, char *path, size_t size) {
+    pthread_mutex_lock(&store->lock);
+    unsigned long long n = ++store->temps;
+    pthread_mutex_unlock(&store->lock);
+
+    if ((size_t)snprintf(path, size, "%s/%s/%ld-%llu", store->root, AFC_STORE_TEMP, (long)getpid(), n) >= size) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// the object path of hex, its two letter folder is made on the way
+static int afc_store_object(afc_store_t *store, const char *hex, char *path) {
+    snprintf(path, PATH_MAX, "%s/%s/%.2s", store->root, afc_hash_name(store->algo), hex);
+    if (afc_store_mkdir(path) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    snprintf(path, PATH_MAX, "%s/%s/%.2s/%s", store->root, afc_hash_name(store->algo), hex, hex + 2);
+    return EXIT_SUCCESS;
+}
+
+static int afc_store_write(int fd, const char *data, size_t length) {
+    while (length > 0) {
+#if defined(_WIN32)
+        ssize_t written = write(fd, data, (unsigned int)length);
+#else
+        ssize_t written = write(fd, data, length);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        if (written == 0) {
+            errno = EIO;
+            return EXIT_FAILURE;
+        }
+        data += written;
+        length -= written;
+    }
+    return EXIT_SUCCESS;
+}
+
+// a plain copy of the object in the tree, for when it can't be linked there
+static int afc_store_copy(const char *object, const char *dst) {
+    int in = open(object, O_RDONLY);
+    if (in < 0)
+        return EXIT_FAILURE;
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0) {
+        int saved = errno;
+        close(in);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+
+    int ret = EXIT_SUCCESS;
+    char *buf = malloc(AFC_STORE_COPY_BLOCK);
+    ssize_t got = 0;
+    if (!buf)
+        ret = EXIT_FAILURE;
+    while (ret == EXIT_SUCCESS && (got = read(in, buf, AFC_STORE_COPY_BLOCK)) != 0) {
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 || afc_store_write(out, buf, (size_t)got) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+    }
+    int saved = errno;
+    free(buf);
+    close(in);
+    if (close(out) != 0 && ret == EXIT_SUCCESS)
+        ret = EXIT_FAILURE;
+    else
+        errno = saved;
+    return ret;
+}
+
+// dst becomes a link to object, whatever was at dst before is replaced
+static int afc_store_place(afc_store_t *store, const char *object, const char *dst) {
+    if (unlink(dst) != 0 && errno != ENOENT)
+        return EXIT_FAILURE;
+    if (afc_store_link(object, dst) == 0)
+        return EXIT_SUCCESS;
+    if (errno != EXDEV && errno != EMLINK)
+        return EXIT_FAILURE;
+
+    pthread_mutex_lock(&store->lock);
+    bool warn = (errno == EXDEV && !store->warned);
+    if (warn)
+        store->warned = true;
+    store->copied++;
+    pthread_mutex_unlock(&store->lock);
+    if (warn)
+        fprintf(stderr, "Warning: %s is on another filesystem than the clone, files are copied instead of linked\n", store->root);
+    return afc_store_copy(object, dst);
+}
+
+// temp, complete and read only, becomes the object unless another clone got there first
+static int afc_store_add(afc_store_t *store, const char *temp, const char *object, uint64_t size) {
+    chmod(temp, 0444);
+    bool added = (afc_store_link(temp, object) == 0);
+    int saved = errno;
+    unlink(temp);
+    if (!added && saved != EEXIST) {
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_lock(&store->lock);
+    if (added) {
+        store->added++;
+        store->added_bytes += size;
+    } else {
+        store->linked++;
+        store->linked_bytes += size;
+    }
+    pthread_mutex_unlock(&store->lock);
+    return EXIT_SUCCESS;
+}
+
+int afc_store_commit(afc_store_t *store, const char *temp, const char *hex, const char *dst, uint64_t size) {
+    char object[PATH_MAX];
+
+    if (afc_store_object(store, hex, object) != EXIT_SUCCESS) {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    if (afc_store_add(store, temp, object, size) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    return afc_store_place(store, object, dst);
+}
+
+int afc_store_commit_buffer(afc_store_t *store, const char *data, size_t length, const char *hex, const char *dst) {
+    char object[PATH_MAX], temp[PATH_MAX];
+    struct stat st;
+
+    if (afc_store_object(store, hex, object) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    // known content costs no write at all
+    if (stat(object, &st) == 0) {
+        pthread_mutex_lock(&store->lock);
+        store->linked++;
+        store->linked_bytes += length;
+        pthread_mutex_unlock(&store->lock);
+        return afc_store_place(store, object, dst);
+    }
+
+    if (afc_store_temp(store, temp, PATH_MAX) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    int ret = afc_store_write(fd, data, length);
+    int saved = errno;
+    if (close(fd) != 0 && ret == EXIT_SUCCESS) {
+        saved = errno;
+        ret = EXIT_FAILURE;
+    }
+    if (ret != EXIT_SUCCESS) {
+        unlink(temp);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    if (afc_store_add(store, temp, object, length) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    return afc_store_place(store, object, dst);
+}
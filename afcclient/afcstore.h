@@ -0,0 +1,70 @@
+/*
+ * afcstore
+ *
+ * clone --store=<dir>, a content addressed store that any number of clones
+ * share. each file lives in it once, under its digest, and every tree that
+ * has it gets a hardlink instead of a copy. cloning the same apps from many
+ * devices then takes disk space for what differs between them, not for each
+ * device again.
+ *
+ * the layout is <dir>/<algo>/<2 hex>/<rest of the hex>, the algorithm of
+ * --hash in the path so BLAKE3 and SHA-256 objects never mix. new data is
+ * written to <dir>/tmp first and linked into place, link() won't replace an
+ * object that is already there, so clones running side by side into the same
+ * store each keep the first copy and drop their own. objects are made read
+ * only, a change through one tree would show up in every other.
+ *
+ * hardlinks need the store and the destination on one filesystem. where they
+ * are not (EXDEV), or an object has as many links as the filesystem allows
+ * (EMLINK), the file is copied into the tree instead. windows has no link(),
+ * there afc_store_open fails with ENOSYS.
+ */
+
+#ifndef _afcstore_h
+#define _afcstore_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "afchash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_STORE_TEMP      "tmp"
+
+typedef struct afc_store_t {
+    char *root;
+    afc_hash_algo_t algo;
+    pthread_mutex_t lock;   // the counts, clone workers commit side by side
+    uint64_t temps;         // temp names handed out, with the pid they are unique across clones
+    int added;              // objects this run put in the store
+    int linked;             // files that were in it already
+    int copied;             // files that had to be copied into the tree, see above
+    uint64_t added_bytes;
+    uint64_t linked_bytes;
+    bool warned;            // the EXDEV warning is given once
+} afc_store_t;
+
+// creates root, its algo folder and the temp folder. errno is set on failure
+int afc_store_open(afc_store_t *store, const char *root, afc_hash_algo_t algo);
+
+void afc_store_close(afc_store_t *store);
+
+// a new path below the temp folder for a download that is hashed on the way in
+int afc_store_temp(afc_store_t *store, char *path, size_t size);
+
+// temp has the digest hex: it becomes the object unless there is one already, then dst is linked to the object. temp is gone afterwards either way
+int afc_store_commit(afc_store_t *store, const char *temp, const char *hex, const char *dst, uint64_t size);
+
+// the same for a file read into memory, which is only written when the store doesn't have it yet
+int afc_store_commit_buffer(afc_store_t *store, const char *data, size_t length, const char *hex, const char *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcstore_h
@@ -0,0 +1,661 @@
+/*
+ * afctar
+ *
+ * ustar/pax writer and reader, see afctar.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#endif
+
+#include "afctar.h"
+
+#define AFC_TAR_NAME_LEN    100
+#define AFC_TAR_PREFIX_LEN  155
+#define AFC_TAR_MAX_SIZE    077777777777ULL     // 11 octal digits
+
+typedef struct afc_tar_header_t {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} afc_tar_header_t;
+
+#pragma mark - writer
+
+int afc_tar_create(afc_tar_t *tar, const char *path) {
+    memset(tar, 0, sizeof(afc_tar_t));
+
+    tar->buf = malloc(AFC_TAR_BUFFER);
+    if (!tar->buf)
+        return EXIT_FAILURE;
+
+    if (!strcmp(path, "-")) {
+        tar->fd = fileno(stdout);
+#if defined(_WIN32)
+        _setmode(tar->fd, _O_BINARY);
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(_WIN32)
+    flags |= O_BINARY;
+#endif
+    tar->fd = open(path, flags, 0666);
+    if (tar->fd < 0) {
+        int saved = errno;
+        free(tar->buf);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    tar->close = true;
+    return EXIT_SUCCESS;
+}
+
+static void afc_tar_flush(afc_tar_t *tar) {
+    size_t done = 0;
+
+    while (tar->error == 0 && done < tar->used) {
+        ssize_t n = write(tar->fd, tar->buf + done, tar->used - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            tar->error = (n < 0) ? errno : EIO;
+        else
+            done += (size_t)n;
+    }
+    tar->used = 0;
+}
+
+// everything goes through here, data == NULL writes zeros
+static void afc_tar_put(afc_tar_t *tar, const char *data, size_t length) {
+    while (tar->error == 0 && length > 0) {
+        if (tar->used == AFC_TAR_BUFFER)
+            afc_tar_flush(tar);
+        size_t take = AFC_TAR_BUFFER - tar->used;
+        if (take > length)
+            take = length;
+        if (data) {
+            memcpy(tar->buf + tar->used, data, take);
+            data += take;
+        } else {
+            memset(tar->buf + tar->used, 0, take);
+        }
+        tar->used += take;
+        length -= take;
+    }
+}
+
+static void afc_tar_octal(char *field, size_t width, uint64_t value) {
+    snprintf(field, width, "%0*llo", (int)(width - 1), (unsigned long long)value);
+}
+
+// name into name/prefix the ustar way, false when it needs a pax path instead
+static bool afc_tar_split(afc_tar_header_t *header, const char *name) {
+    size_t len = strlen(name);
+
+    if (len <= AFC_TAR_NAME_LEN) {
+        memcpy(header->name, name, len);
+        return true;
+    }
+
+    // the last slash that leaves both halves short enough, the slash itself is dropped
+    const char *slash = name + len;
+    while (slash > name) {
+        slash--;
+        if (*slash != '/')
+            continue;
+        size_t prefix = (size_t)(slash - name);
+        size_t rest = len - prefix - 1;
+        if (rest == 0)
+            continue;   // the trailing slash of a folder
+        if (rest > AFC_TAR_NAME_LEN)
+            return false;
+        if (prefix <= AFC_TAR_PREFIX_LEN) {
+            memcpy(header->prefix, name, prefix);
+            memcpy(header->name, slash + 1, rest);
+            return true;
+        }
+    }
+    return false;
+}
+
+// appends one "length key=value\n" record at *used, the length counts its own digits too
+static void afc_tar_pax_record(char *out, size_t size, size_t *used, const char *key, const char *value) {
+    size_t body = strlen(key) + strlen(value) + 3;     // space, '=' and newline
+    size_t total = body + 1;
+    while ((size_t)snprintf(NULL, 0, "%zu", total) != total - body)
+        total++;
+
+    // too long is noticed by the caller from *used, nothing is written past size
+    if (*used + total < size)
+        snprintf(out + *used, size - *used, "%zu %s=%s\n", total, key, value);
+    *used += total;
+}
+
+static void afc_tar_header(afc_tar_t *tar, afc_tar_header_t *header, char type, uint32_t mode, uint64_t size, uint64_t mtime) {
+    unsigned int sum = 0;
+    size_t i;
+
+    afc_tar_octal(header->mode, sizeof(header->mode), mode);
+    afc_tar_octal(header->uid, sizeof(header->uid), 0);
+    afc_tar_octal(header->gid, sizeof(header->gid), 0);
+    afc_tar_octal(header->size, sizeof(header->size), size);
+    afc_tar_octal(header->mtime, sizeof(header->mtime), mtime / 1000000000ULL);
+    header->typeflag = type;
+    memcpy(header->magic, "ustar", 6);
+    memcpy(header->version, "00", 2);
+
+    memset(header->chksum, ' ', sizeof(header->chksum));
+    for (i = 0; i < sizeof(afc_tar_header_t); i++)
+        sum += ((unsigned char *)header)[i];
+    snprintf(header->chksum, sizeof(header->chksum), "%06o", sum);
+    header->chksum[7] = ' ';
+
+    afc_tar_put(tar, (const char *)header, sizeof(afc_tar_header_t));
+}
+
+static int afc_tar_entry(afc_tar_t *tar, const char *name, char type, uint32_t mode, uint64_t size, uint64_t mtime, const char *target) {
+    afc_tar_header_t header;
+    char records[3 * (64 + 4096)];
+    size_t used = 0;
+
+    if (tar->remaining > 0 || tar->pad > 0)
+        afc_tar_end_file(tar);
+    while (*name == '/')
+        name++;
+
+    memset(&header, 0, sizeof(header));
+    if (!afc_tar_split(&header, name)) {
+        afc_tar_pax_record(records, sizeof(records), &used, "path", name);
+        snprintf(header.name, sizeof(header.name), "%.*s", AFC_TAR_NAME_LEN - 1, name);
+    }
+    if (target) {
+        if (strlen(target) <= AFC_TAR_NAME_LEN)
+            memcpy(header.linkname, target, strlen(target));
+        else
+            afc_tar_pax_record(records, sizeof(records), &used, "linkpath", target);
+    }
+    if (size > AFC_TAR_MAX_SIZE) {
+        char value[32];
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)size);
+        afc_tar_pax_record(records, sizeof(records), &used, "size", value);
+    }
+    if (used >= sizeof(records)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+
+    if (used > 0) {
+        afc_tar_header_t pax;
+        memset(&pax, 0, sizeof(pax));
+        snprintf(pax.name, sizeof(pax.name), "PaxHeaders/%.*s", AFC_TAR_NAME_LEN - 12, header.name);
+        afc_tar_header(tar, &pax, 'x', 0644, used, mtime);
+        afc_tar_put(tar, records, used);
+        afc_tar_put(tar, NULL, (AFC_TAR_BLOCK - used % AFC_TAR_BLOCK) % AFC_TAR_BLOCK);
+    }
+    afc_tar_header(tar, &header, type, mode, (size > AFC_TAR_MAX_SIZE) ? 0 : size, mtime);
+
+    if (tar->error) {
+        errno = tar->error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int afc_tar_add_dir(afc_tar_t *tar, const char *name, uint64_t mtime) {
+    char dir[4096 + 2];
+    size_t len = strlen(name);
+
+    // a folder is told apart by the trailing slash as much as by its type
+    if (len + 2 > sizeof(dir)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    memcpy(dir, name, len);
+    if (len == 0 || name[len - 1] != '/')
+        dir[len++] = '/';
+    dir[len] = '\0';
+    return afc_tar_entry(tar, dir, '5', 0755, 0, mtime, NULL);
+}
+
+int afc_tar_add_symlink(afc_tar_t *tar, const char *name, const char *target, uint64_t mtime) {
+    return afc_tar_entry(tar, name, '2', 0777, 0, mtime, target);
+}
+
+int afc_tar_begin_file(afc_tar_t *tar, const char *name, uint64_t size, uint64_t mtime) {
+    if (afc_tar_entry(tar, name, '0', 0644, size, mtime, NULL) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    tar->remaining = size;
+    tar->pad = (AFC_TAR_BLOCK - size % AFC_TAR_BLOCK) % AFC_TAR_BLOCK;
+    return EXIT_SUCCESS;
+}
+
+int afc_tar_write(afc_tar_t *tar, const char *data, size_t length) {
+    if (length > tar->remaining)
+        length = (size_t)tar->remaining;
+    afc_tar_put(tar, data, length);
+    tar->remaining -= length;
+
+    if (tar->error) {
+        errno = tar->error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+uint64_t afc_tar_end_file(afc_tar_t *tar) {
+    uint64_t missing = tar->remaining;
+
+    afc_tar_put(tar, NULL, (size_t)(tar->remaining + tar->pad));
+    tar->remaining = 0;
+    tar->pad = 0;
+    return missing;
+}
+
+int afc_tar_close(afc_tar_t *tar) {
+    if (tar->remaining > 0 || tar->pad > 0)
+        afc_tar_end_file(tar);
+    afc_tar_put(tar, NULL, 2 * AFC_TAR_BLOCK);
+    afc_tar_flush(tar);
+
+    int error = tar->error;
+    if (tar->close && close(tar->fd) != 0 && error == 0)
+        error = errno;
+    free(tar->buf);
+    tar->buf = NULL;
+
+    if (error) {
+        errno = error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#pragma mark - reader
+
+int afc_untar_open(afc_untar_t *untar, const char *path) {
+    memset(untar, 0, sizeof(afc_untar_t));
+
+    untar->buf = malloc(AFC_TAR_BUFFER);
+    if (!untar->buf)
+        return EXIT_FAILURE;
+
+    if (!strcmp(path, "-")) {
+        untar->fd = fileno(stdin);
+#if defined(_WIN32)
+        _setmode(untar->fd, _O_BINARY);
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    int flags = O_RDONLY;
+#if defined(_WIN32)
+    flags |= O_BINARY;
+#endif
+    untar->fd = open(path, flags);
+    if (untar->fd < 0) {
+        int saved = errno;
+        free(untar->buf);
+        errno = saved;
+        return EXIT_FAILURE;
+    }
+    untar->close = true;
+    return EXIT_SUCCESS;
+}
+
+// at least want bytes from pos on in the buffer unless the archive ends first, returns what is there
+static size_t afc_untar_fill(afc_untar_t *untar, size_t want) {
+    if (untar->len - untar->pos >= want)
+        return untar->len - untar->pos;
+
+    // what is left moves to the front, reads are as large as the buffer allows
+    memmove(untar->buf, untar->buf + untar->pos, untar->len - untar->pos);
+    untar->len -= untar->pos;
+    untar->pos = 0;
+    while (untar->len < want) {
+        ssize_t n = read(untar->fd, untar->buf + untar->len, AFC_TAR_BUFFER - untar->len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n == 0)
+                errno = 0;
+            break;
+        }
+        untar->len += (size_t)n;
+    }
+    return untar->len;
+}
+
+static void afc_untar_consume(afc_untar_t *untar, size_t length) {
+    untar->pos += length;
+    untar->offset += length;
+}
+
+// drops length bytes of the archive, EXIT_FAILURE when it ends before that
+static int afc_untar_skip(afc_untar_t *untar, uint64_t length) {
+    while (length > 0) {
+        size_t avail = afc_untar_fill(untar, 1);
+        if (avail == 0) {
+            if (errno == 0)
+                errno = EINVAL;
+            return EXIT_FAILURE;
+        }
+        size_t take = (avail < length) ? avail : (size_t)length;
+        afc_untar_consume(untar, take);
+        length -= take;
+    }
+    return EXIT_SUCCESS;
+}
+
+// octal, or base-256 when the top bit of the first byte is set (GNU tar, sizes of 8g and up)
+static int afc_untar_number(const char *field, size_t width, uint64_t *value) {
+    const unsigned char *p = (const unsigned char *)field;
+    size_t i = 0;
+
+    *value = 0;
+    if (p[0] & 0x80) {
+        if (p[0] != 0x80)
+            return EXIT_FAILURE;    // negative, or more than 64 bits
+        for (i = 1; i < width; i++) {
+            if (*value >> 56)
+                return EXIT_FAILURE;
+            *value = (*value << 8) | p[i];
+        }
+        return EXIT_SUCCESS;
+    }
+    while (i < width && p[i] == ' ')
+        i++;
+    for (; i < width && p[i] >= '0' && p[i] <= '7'; i++)
+        *value = (*value << 3) | (uint64_t)(p[i] - '0');
+    return (i == width || p[i] == ' ' || p[i] == '\0') ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool afc_untar_checksum(const afc_tar_header_t *header) {
+    const unsigned char *u = (const unsigned char *)header;
+    const signed char *s = (const signed char *)header;
+    uint64_t stored;
+    long usum = 0, ssum = 0;
+    size_t i;
+
+    if (afc_untar_number(header->chksum, sizeof(header->chksum), &stored) != EXIT_SUCCESS)
+        return false;
+    for (i = 0; i < sizeof(afc_tar_header_t); i++) {
+        bool chksum = (i >= offsetof(afc_tar_header_t, chksum) && i < offsetof(afc_tar_header_t, chksum) + sizeof(header->chksum));
+        usum += (chksum) ? ' ' : u[i];
+        ssum += (chksum) ? ' ' : s[i];
+    }
+    // some old writers summed signed chars
+    return (uint64_t)usum == stored || (uint64_t)ssum == stored;
+}
+
+static void afc_untar_field(char *out, const char *field, size_t width) {
+    size_t len = strnlen(field, width);
+    memcpy(out, field, len);
+    out[len] = '\0';
+}
+
+// seconds with an optional fraction, as pax writes mtime
+static uint64_t afc_untar_pax_time(const char *value) {
+    uint64_t seconds = strtoull(value, NULL, 10);
+    uint64_t nanos = 0, scale = 100000000ULL;
+    const char *dot = strchr(value, '.');
+
+    if (*value == '-')
+        return 0;
+    for (dot = (dot) ? dot + 1 : NULL; dot && *dot >= '0' && *dot <= '9' && scale > 0; dot++, scale /= 10)
+        nanos += (uint64_t)(*dot - '0') * scale;
+    return seconds * 1000000000ULL + nanos;
+}
+
+typedef struct afc_untar_pending_t {
+    bool name, link, size, mtime;
+    uint64_t sizeValue, mtimeValue;
+} afc_untar_pending_t;
+
+// the "length key=value\n" records of a pax header, only what afc has a use for is kept
+static int afc_untar_pax(afc_untar_t *untar, char *records, size_t length, afc_untar_pending_t *pending) {
+    size_t at = 0;
+
+    while (at < length) {
+        char *end = NULL;
+        unsigned long long len = strtoull(records + at, &end, 10);
+        if (end == records + at || *end != ' ' || len == 0 || len > length - at || records[at + len - 1] != '\n')
+            return EXIT_FAILURE;
+        char *key = end + 1;
+        char *eq = memchr(key, '=', (size_t)(records + at + len - 1 - key));
+        if (!eq)
+            return EXIT_FAILURE;
+        *eq = '\0';
+        records[at + len - 1] = '\0';
+        char *value = eq + 1;
+        size_t valueLen = strlen(value);
+
+        if (!strcmp(key, "path") || !strcmp(key, "linkpath")) {
+            bool path = (key[0] == 'p');
+            if (valueLen >= AFC_TAR_PATH_MAX) {
+                errno = ENAMETOOLONG;
+                return EXIT_FAILURE;
+            }
+            memcpy((path) ? untar->name : untar->link, value, valueLen + 1);
+            if (path)
+                pending->name = true;
+            else
+                pending->link = true;
+        } else if (!strcmp(key, "size")) {
+            pending->size = true;
+            pending->sizeValue = strtoull(value, NULL, 10);
+        } else if (!strcmp(key, "mtime")) {
+            pending->mtime = true;
+            pending->mtimeValue = afc_untar_pax_time(value);
+        }
+        at += len;
+    }
+    return EXIT_SUCCESS;
+}
+
+// the data of a pax or GNU long name record, NUL terminated
+static char *afc_untar_record(afc_untar_t *untar, uint64_t size) {
+    if (size > AFC_TAR_BUFFER) {
+        errno = EINVAL;
+        return NULL;
+    }
+    char *data = malloc((size_t)size + 1);
+    if (!data)
+        return NULL;
+
+    size_t done = 0;
+    while (done < size) {
+        size_t avail = afc_untar_fill(untar, 1);
+        if (avail == 0) {
+            free(data);
+            if (errno == 0)
+                errno = EINVAL;
+            return NULL;
+        }
+        size_t take = (avail < size - done) ? avail : (size_t)(size - done);
+        memcpy(data + done, untar->buf + untar->pos, take);
+        afc_untar_consume(untar, take);
+        done += take;
+    }
+    data[size] = '\0';
+    if (afc_untar_skip(untar, (AFC_TAR_BLOCK - size % AFC_TAR_BLOCK) % AFC_TAR_BLOCK) != EXIT_SUCCESS) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+int afc_untar_next(afc_untar_t *untar, afc_tar_member_t *member) {
+    static const char zeros[AFC_TAR_BLOCK];
+    afc_untar_pending_t pending;
+    afc_tar_header_t header;
+
+    if (afc_untar_skip(untar, untar->remaining + untar->pad) != EXIT_SUCCESS)
+        return -1;
+    untar->remaining = 0;
+    untar->pad = 0;
+
+    memset(&pending, 0, sizeof(pending));
+    while (1) {
+        size_t avail = afc_untar_fill(untar, AFC_TAR_BLOCK);
+        if (avail == 0 && errno == 0)
+            return 0;       // no end marker, the archive just stops
+        if (avail < AFC_TAR_BLOCK) {
+            if (errno == 0)
+                errno = EINVAL;
+            return -1;
+        }
+        memcpy(&header, untar->buf + untar->pos, AFC_TAR_BLOCK);
+        afc_untar_consume(untar, AFC_TAR_BLOCK);
+
+        if (!memcmp(&header, zeros, AFC_TAR_BLOCK))
+            return 0;
+        if (!afc_untar_checksum(&header)) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        uint64_t size = 0, mtime = 0;
+        if (afc_untar_number(header.size, sizeof(header.size), &size) != EXIT_SUCCESS ||
+            afc_untar_number(header.mtime, sizeof(header.mtime), &mtime) != EXIT_SUCCESS) {
+            errno = EINVAL;
+            return -1;
+        }
+        // records that describe the next header rather than being a member
+        if (header.typeflag == 'x' || header.typeflag == 'g' || header.typeflag == 'L' || header.typeflag == 'K') {
+            if (header.typeflag == 'g') {
+                if (afc_untar_skip(untar, size + (AFC_TAR_BLOCK - size % AFC_TAR_BLOCK) % AFC_TAR_BLOCK) != EXIT_SUCCESS)
+                    return -1;
+                continue;
+            }
+            char *data = afc_untar_record(untar, size);
+            if (!data)
+                return -1;
+            int ret = EXIT_SUCCESS;
+            if (header.typeflag == 'x') {
+                ret = afc_untar_pax(untar, data, (size_t)size, &pending);
+                if (ret != EXIT_SUCCESS && errno != ENAMETOOLONG)
+                    errno = EINVAL;
+            } else if (strlen(data) >= AFC_TAR_PATH_MAX) {
+                errno = ENAMETOOLONG;
+                ret = EXIT_FAILURE;
+            } else if (header.typeflag == 'L' && !pending.name) {
+                strcpy(untar->name, data);      // a pax path wins over a GNU long name
+                pending.name = true;
+            } else if (header.typeflag == 'K' && !pending.link) {
+                strcpy(untar->link, data);
+                pending.link = true;
+            }
+            free(data);
+            if (ret != EXIT_SUCCESS)
+                return -1;
+            continue;
+        }
+        if (pending.size)
+            size = pending.sizeValue;
+
+        if (!pending.name) {
+            char field[AFC_TAR_NAME_LEN + 1], prefix[AFC_TAR_PREFIX_LEN + 1];
+            afc_untar_field(field, header.name, sizeof(header.name));
+            // GNU tar keeps other things where ustar has the prefix, its magic is "ustar  "
+            if (!memcmp(header.magic, "ustar", 6) && header.prefix[0]) {
+                afc_untar_field(prefix, header.prefix, sizeof(header.prefix));
+                snprintf(untar->name, AFC_TAR_PATH_MAX, "%s/%s", prefix, field);
+            } else {
+                snprintf(untar->name, AFC_TAR_PATH_MAX, "%s", field);
+            }
+        }
+        if (!pending.link)
+            afc_untar_field(untar->link, header.linkname, sizeof(header.linkname));
+
+        memset(member, 0, sizeof(afc_tar_member_t));
+        switch (header.typeflag) {
+            case '0': case '\0': case '7':
+                member->type = AFC_TAR_FILE;
+                break;
+            case '5':
+                member->type = AFC_TAR_DIR;
+                break;
+            case '2':
+                member->type = AFC_TAR_SYMLINK;
+                break;
+            case '1':
+                member->type = AFC_TAR_HARDLINK;
+                break;
+            default:
+                member->type = AFC_TAR_OTHER;
+                break;
+        }
+
+        // "./x" and "/x" are x, and a folder loses its trailing slash (old archives mark folders only by that)
+        char *name = untar->name;
+        while (name[0] == '/' || (name[0] == '.' && name[1] == '/'))
+            name += (name[0] == '/') ? 1 : 2;
+        size_t len = strlen(name);
+        if (len > 0 && name[len - 1] == '/' && member->type == AFC_TAR_FILE && header.typeflag == '\0')
+            member->type = AFC_TAR_DIR;
+        while (len > 0 && name[len - 1] == '/')
+            name[--len] = '\0';
+        if (!strcmp(name, "."))
+            name[0] = '\0';
+
+        member->name = name;
+        member->link = (member->type == AFC_TAR_SYMLINK || member->type == AFC_TAR_HARDLINK) ? untar->link : NULL;
+        member->size = (member->type == AFC_TAR_FILE) ? size : 0;
+        member->mtime = (pending.mtime) ? pending.mtimeValue : mtime * 1000000000ULL;
+
+        // a folder or link with a size still has that much data after it, skipped on the next call
+        untar->remaining = size;
+        untar->pad = (AFC_TAR_BLOCK - size % AFC_TAR_BLOCK) % AFC_TAR_BLOCK;
+        return 1;
+    }
+}
+
+int afc_untar_read(afc_untar_t *untar, const char **data, size_t *length) {
+    *data = NULL;
+    *length = 0;
+    if (untar->remaining == 0)
+        return EXIT_SUCCESS;
+
+    size_t avail = afc_untar_fill(untar, 1);
+    if (avail == 0) {
+        if (errno == 0)
+            errno = EINVAL;     // the archive ends in the middle of this member
+        return EXIT_FAILURE;
+    }
+    *data = untar->buf + untar->pos;
+    *length = (avail < untar->remaining) ? avail : (size_t)untar->remaining;
+    afc_untar_consume(untar, *length);
+    untar->remaining -= *length;
+    return EXIT_SUCCESS;
+}
+
+void afc_untar_close(afc_untar_t *untar) {
+    if (untar->close)
+        close(untar->fd);
+    free(untar->buf);
+    untar->buf = NULL;
+}
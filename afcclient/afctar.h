@@ -0,0 +1,126 @@
+/*
+ * afctar
+ *
+ * clone --tar writes the tree as one tar stream instead of a file per entry,
+ * so the local side is a single sequential write that can just as well go
+ * into a pipe (zstd, an uploader) as onto disk.
+ *
+ * the format is ustar, with a pax extended header in front of any entry whose
+ * path, link target or size doesn't fit the ustar fields. the device reports
+ * no permission bits, files go in as 0644, folders as 0755 and symlinks as
+ * 0777, with the mtime of the device to the second.
+ *
+ * output is collected in a large buffer and written out whole, one write()
+ * per AFC_TAR_BUFFER no matter how small the files are.
+ *
+ * put --tar goes the other way with afc_untar_t, a sequential reader for the
+ * same archives and what GNU tar and bsdtar write: ustar, pax 'x' headers
+ * (path, linkpath, size, mtime), GNU long names and base-256 sizes. member data
+ * is handed out straight from the read buffer, nothing is copied on the way
+ * to the device.
+ */
+
+#ifndef _afctar_h
+#define _afctar_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_TAR_BLOCK       512
+#define AFC_TAR_BUFFER      (1024 * 1024)
+#define AFC_TAR_PATH_MAX    4096
+
+typedef struct afc_tar_t {
+    int fd;
+    bool close;             // fd is ours, not stdout
+    char *buf;
+    size_t used;
+    uint64_t remaining;     // bytes still owed to the file entry being written
+    uint64_t pad;           // and the padding after them
+    int error;              // errno of the first failed write, nothing is written after that
+} afc_tar_t;
+
+// path "-" is stdout. errno is set on failure
+int afc_tar_create(afc_tar_t *tar, const char *path);
+
+// name is the path inside the archive, mtime in nanoseconds as the device reports it
+int afc_tar_add_dir(afc_tar_t *tar, const char *name, uint64_t mtime);
+
+int afc_tar_add_symlink(afc_tar_t *tar, const char *name, const char *target, uint64_t mtime);
+
+/*
+
+ starts a file entry of size bytes, its data follows with afc_tar_write. afc_tar_end_file
+ pads the entry out, with zeros in place of whatever of the size was not written, so the
+ archive stays readable when a file gets shorter while it is read.
+
+ */
+int afc_tar_begin_file(afc_tar_t *tar, const char *name, uint64_t size, uint64_t mtime);
+
+// data beyond the size given to afc_tar_begin_file is dropped
+int afc_tar_write(afc_tar_t *tar, const char *data, size_t length);
+
+// how many bytes of the current file were missing and padded with zeros, 0 when it was complete
+uint64_t afc_tar_end_file(afc_tar_t *tar);
+
+// writes the end of archive marker and flushes. returns EXIT_FAILURE with errno set if any write failed
+int afc_tar_close(afc_tar_t *tar);
+
+// reading, for put --tar
+
+typedef enum {
+    AFC_TAR_FILE = 0,
+    AFC_TAR_DIR,
+    AFC_TAR_SYMLINK,
+    AFC_TAR_HARDLINK,       // link is the path of an earlier member
+    AFC_TAR_OTHER           // devices, fifos and whatever else afc can't make, the data is skipped
+} afc_tar_type_t;
+
+typedef struct afc_tar_member_t {
+    afc_tar_type_t type;
+    const char *name;       // as stored without a leading "./" or "/" or a folder's trailing slash. valid until the next afc_untar_next
+    const char *link;       // target of a SYMLINK or HARDLINK, NULL otherwise
+    uint64_t size;          // data bytes, 0 for anything but a FILE
+    uint64_t mtime;         // nanoseconds
+} afc_tar_member_t;
+
+typedef struct afc_untar_t {
+    int fd;
+    bool close;             // fd is ours, not stdin
+    char *buf;
+    size_t len;             // bytes in buf
+    size_t pos;             // next unread byte in buf
+    uint64_t remaining;     // data of the current member not handed out yet
+    uint64_t pad;
+    uint64_t offset;        // position in the archive, for error messages
+    char name[AFC_TAR_PATH_MAX];
+    char link[AFC_TAR_PATH_MAX];
+} afc_untar_t;
+
+// path "-" is stdin. errno is set on failure
+int afc_untar_open(afc_untar_t *untar, const char *path);
+
+/*
+
+ skips what is left of the current member and reads the next header, pax and GNU long name
+ records included. returns 1 with member filled in, 0 at the end of the archive, -1 with errno
+ set when reading fails or the archive is damaged (EINVAL, a bad checksum or a truncated member).
+
+ */
+int afc_untar_next(afc_untar_t *untar, afc_tar_member_t *member);
+
+// points data at the next piece of the current member, straight in the read buffer and valid until the next call. length 0 is the end of it
+int afc_untar_read(afc_untar_t *untar, const char **data, size_t *length);
+
+void afc_untar_close(afc_untar_t *untar);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afctar_h
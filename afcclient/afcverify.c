@@ -0,0 +1,125 @@
+/*
+ * afcverify
+ *
+ * sampled read-back for --verify, see afcverify.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "afcverify.h"
+#include "afcentry.h"
+#include "afclocal.h"
+#include "libidev.h"
+
+// where the samples go, a fresh set on every run so repeated runs cover more of the file
+static int afc_verify_offsets(uint64_t size, uint64_t *offsets) {
+    int i, count = 0;
+
+    if (size <= (uint64_t)AFC_VERIFY_SAMPLES * AFC_VERIFY_BLOCK) {
+        for (i = 0; (uint64_t)i * AFC_VERIFY_BLOCK < size; i++)
+            offsets[count++] = (uint64_t)i * AFC_VERIFY_BLOCK;
+        return count;
+    }
+
+    uint64_t seed = (uint64_t)time(NULL) ^ (size * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)clock();
+    offsets[count++] = 0;
+    offsets[count++] = size - AFC_VERIFY_BLOCK;
+    while (count < AFC_VERIFY_SAMPLES) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        offsets[count++] = (seed % (size - AFC_VERIFY_BLOCK)) & ~(uint64_t)4095;
+    }
+    return count;
+}
+
+static afc_error_t afc_verify_read(afc_client_t afc, uint64_t handle, uint64_t offset, char *buf, uint32_t length, uint32_t *have) {
+    afc_error_t err = afc_file_seek(afc, handle, (int64_t)offset, SEEK_SET);
+
+    *have = 0;
+    while (err == AFC_E_SUCCESS && *have < length) {
+        uint32_t bytes = 0;
+        err = afc_file_read(afc, handle, buf + *have, length - *have, &bytes);
+        if (err == AFC_E_SUCCESS && bytes == 0)
+            break;
+        *have += bytes;
+    }
+    return err;
+}
+
+afc_error_t afc_verify_sample(afc_client_t afc, const char *remote, const char *local, bool *match, uint64_t *where, int *local_error) {
+    uint64_t offsets[AFC_VERIFY_SAMPLES];
+    uint64_t size = 0;
+    afc_local_t file;
+    int i;
+
+    *match = false;
+    *where = 0;
+    *local_error = 0;
+
+    if (afc_local_open(&file, local, &size) != EXIT_SUCCESS) {
+        *local_error = errno;
+        return AFC_E_SUCCESS;
+    }
+
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+    afc_error_t err = afc_entry_stat(afc, &arena, remote, &entry);
+    uint64_t remoteSize = (err == AFC_E_SUCCESS) ? entry.size : 0;
+    // a symlink reports the size of the link, reading it gives the target, only the samples can tell
+    bool sized = (err == AFC_E_SUCCESS && entry.type != AFC_ENTRY_LINK);
+    afc_arena_free(&arena);
+    if (err != AFC_E_SUCCESS || (sized && remoteSize != size)) {
+        *where = (remoteSize < size) ? remoteSize : size;
+        afc_local_close(&file);
+        return err;
+    }
+
+    char *theirs = malloc(AFC_VERIFY_BLOCK);
+    char *mine = malloc(AFC_VERIFY_BLOCK);
+    uint64_t handle = 0;
+    if (!theirs || !mine)
+        err = AFC_E_NO_MEM;
+    else
+        err = afc_file_open(afc, remote, AFC_FOPEN_RDONLY, &handle);
+
+    int count = afc_verify_offsets(size, offsets);
+    bool same = true;
+    for (i = 0; err == AFC_E_SUCCESS && same && i < count; i++) {
+        uint32_t length = (size - offsets[i] < AFC_VERIFY_BLOCK) ? (uint32_t)(size - offsets[i]) : AFC_VERIFY_BLOCK;
+        uint32_t have = 0;
+        size_t got = 0;
+
+        err = afc_verify_read(afc, handle, offsets[i], theirs, length, &have);
+        if (err != AFC_E_SUCCESS)
+            break;
+        if (afc_local_read_at(&file, mine, length, offsets[i], &got) != EXIT_SUCCESS) {
+            *local_error = errno;
+            break;
+        }
+        if (idev_verbose)
+            fprintf(stderr, "[debug] verify sample at %llu of %s: %u bytes\n", (unsigned long long)offsets[i], remote, length);
+
+        // either side coming up short is a mismatch right there
+        uint32_t j, n = (have < got) ? have : (uint32_t)got;
+        for (j = 0; j < n && theirs[j] == mine[j]; j++)
+            ;
+        if (j < length) {
+            same = false;
+            *where = offsets[i] + j;
+        }
+    }
+    if (err == AFC_E_SUCCESS && *local_error == 0)
+        *match = same;
+
+    if (handle)
+        afc_file_close(afc, handle);
+    afc_local_close(&file);
+    free(theirs);
+    free(mine);
+    return err;
+}
@@ -0,0 +1,41 @@
+/*
+ * afcverify
+ *
+ * the read-back half of --verify. the digest of a transfer is taken from the
+ * bytes as they go through (afchash), that says what was sent but not that it
+ * landed. reading all of the target back would cost a second transfer, so only
+ * a sample of it is: the first and the last block and a few picked at random
+ * in between, each compared with the same range on the other side, plus the
+ * size on both ends. a file no larger than the sample is compared whole.
+ */
+
+#ifndef _afcverify_h
+#define _afcverify_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libimobiledevice/afc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_VERIFY_SAMPLES  8
+#define AFC_VERIFY_BLOCK    (64 * 1024)     // bytes per sample
+
+/*
+
+ compares remote on the device with the local file at local, sizes first and then up to
+ AFC_VERIFY_SAMPLES blocks of both. *match says whether everything agreed, when it didn't
+ *where is the first offset found to differ (the shorter length if the sizes don't match).
+ a local file that can't be read leaves its errno in local_error. returns the first afc error.
+
+ */
+afc_error_t afc_verify_sample(afc_client_t afc, const char *remote, const char *local, bool *match, uint64_t *where, int *local_error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcverify_h
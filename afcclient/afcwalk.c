@@ -0,0 +1,726 @@
+/*
+ * afcwalk
+ *
+ * work stealing directory walker, see afcwalk.h
+ *
+ * a work item is either a directory to read or a batch of names in a directory
+ * to stat. reading a directory only turns its names into batches, so a folder
+ * with thousands of files is stat'ed by every worker instead of the one that
+ * happened to find it. pending counts queued + running items, the walk is done
+ * when it drops to zero.
+ *
+ * every worker fills its own entry array and arena without locking, they are
+ * concatenated and sorted once at the end. afc_walk_stream skips all of that,
+ * each entry goes to the callback the moment it is stat'ed and only folder
+ * paths, which the items below them point at, are kept.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "afcwalk.h"
+#include "libidev.h"
+
+typedef struct afc_walk_item_t {
+    const char *dir;            // directory to read, or the folder the names live in (arena owned)
+    char **names;               // NULL for a directory read
+    int count;
+} afc_walk_item_t;
+
+typedef struct afc_walk_deque_t {
+    pthread_mutex_t lock;
+    afc_walk_item_t **items;    // owner pushes and pops at tail, thieves take from head
+    size_t head;
+    size_t tail;
+    size_t cap;
+} afc_walk_deque_t;
+
+typedef struct afc_walk_t afc_walk_t;
+
+typedef struct afc_walk_worker_t {
+    afc_walk_t *walk;
+    int index;
+    afc_client_t afc;
+    idev_afc_connection_t con;
+    pthread_t thread;
+    bool started;
+    afc_walk_deque_t deque;
+    afc_entry_t *entries;
+    size_t count;
+    size_t cap;
+    afc_arena_t arena;
+    afc_arena_t scratch;        // afc_walk_stream, the entry being handed out
+    char *pathbuf;              // scratch for joining names, the entry keeps its own copy
+    size_t pathcap;
+} afc_walk_worker_t;
+
+struct afc_walk_t {
+    int flags;
+    afc_walk_fn fn;             // afc_walk_stream, NULL when collecting a tree
+    void *ctx;
+    int count;
+    afc_walk_worker_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // items were pushed or the walk is over
+    size_t pending;
+    unsigned long generation;   // bumped on every push so an idle worker can't miss one
+};
+
+#pragma mark - Paths
+
+// same joining rules the listing code always used: "" is the root, a trailing slash is kept as is
+static const char *afc_walk_join(char **buf, size_t *cap, const char *dir, const char *name) {
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    if (dlen + nlen + 2 > *cap) {
+        char *grown = realloc(*buf, dlen + nlen + 2);
+        if (!grown)
+            return NULL;
+        *buf = grown;
+        *cap = dlen + nlen + 2;
+    }
+    char *path = *buf;
+
+    if (dlen == 0) {
+        memcpy(path, name, nlen + 1);
+    } else if (dir[dlen-1] == '/') {
+        memcpy(path, dir, dlen);
+        memcpy(path + dlen, name, nlen + 1);
+    } else {
+        memcpy(path, dir, dlen);
+        path[dlen] = '/';
+        memcpy(path + dlen + 1, name, nlen + 1);
+    }
+    return path;
+}
+
+int afc_walk_path_compare(const char *a, const char *b) {
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+
+    while (*x && *x == *y) {
+        x++;
+        y++;
+    }
+    if (*x == *y)
+        return 0;
+    if (*x == '/')
+        return (*y) ? -1 : 1;
+    if (*y == '/')
+        return (*x) ? 1 : -1;
+    return (*x < *y) ? -1 : 1;
+}
+
+static int afc_walk_entry_compare(const void *a, const void *b) {
+    return afc_walk_path_compare(((const afc_entry_t *)a)->path, ((const afc_entry_t *)b)->path);
+}
+
+#pragma mark - Deques
+
+static void afc_walk_item_free(afc_walk_item_t *item) {
+    int i;
+    if (!item)
+        return;
+    for (i = 0; item->names && i < item->count; i++)
+        free(item->names[i]);
+    free(item->names);
+    free(item);
+}
+
+static bool afc_walk_deque_push(afc_walk_deque_t *deque, afc_walk_item_t *item) {
+    bool ok = true;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head == deque->tail) {
+        deque->head = 0;
+        deque->tail = 0;
+    }
+    if (deque->tail == deque->cap) {
+        // reuse the stolen space at the front before growing
+        if (deque->head > 0) {
+            memmove(deque->items, deque->items + deque->head, (deque->tail - deque->head) * sizeof(afc_walk_item_t *));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            size_t cap = (deque->cap) ? deque->cap * 2 : 64;
+            afc_walk_item_t **items = realloc(deque->items, cap * sizeof(afc_walk_item_t *));
+            if (items) {
+                deque->items = items;
+                deque->cap = cap;
+            } else {
+                ok = false;
+            }
+        }
+    }
+    if (ok)
+        deque->items[deque->tail++] = item;
+    pthread_mutex_unlock(&deque->lock);
+
+    return ok;
+}
+
+static afc_walk_item_t *afc_walk_deque_pop(afc_walk_deque_t *deque) {
+    afc_walk_item_t *item = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head)
+        item = deque->items[--deque->tail];
+    pthread_mutex_unlock(&deque->lock);
+
+    return item;
+}
+
+static afc_walk_item_t *afc_walk_deque_steal(afc_walk_deque_t *deque) {
+    afc_walk_item_t *item = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head)
+        item = deque->items[deque->head++];
+    pthread_mutex_unlock(&deque->lock);
+
+    return item;
+}
+
+#pragma mark - Workers
+
+// queues item on the worker's own deque, runs it in place if that fails so nothing is lost
+static void afc_walk_push(afc_walk_worker_t *worker, afc_walk_item_t *item);
+
+static void afc_walk_run(afc_walk_worker_t *worker, afc_walk_item_t *item);
+
+static void afc_walk_push(afc_walk_worker_t *worker, afc_walk_item_t *item) {
+    afc_walk_t *walk = worker->walk;
+
+    pthread_mutex_lock(&walk->lock);
+    walk->pending++;
+    walk->generation++;
+    pthread_mutex_unlock(&walk->lock);
+
+    if (!afc_walk_deque_push(&worker->deque, item)) {
+        afc_walk_run(worker, item);
+        return;
+    }
+
+    pthread_mutex_lock(&walk->lock);
+    pthread_cond_signal(&walk->work);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static afc_entry_t *afc_walk_append(afc_walk_worker_t *worker) {
+    if (worker->count == worker->cap) {
+        size_t cap = (worker->cap) ? worker->cap * 2 : 256;
+        afc_entry_t *entries = realloc(worker->entries, cap * sizeof(afc_entry_t));
+        if (!entries)
+            return NULL;
+        worker->entries = entries;
+        worker->cap = cap;
+    }
+    return &worker->entries[worker->count];
+}
+
+// splits a directory listing into stat batches on the worker's deque
+static afc_error_t afc_walk_queue_names(afc_walk_worker_t *worker, const char *dir, char **list) {
+    afc_walk_item_t *batch = NULL;
+    int i;
+
+    for (i = 0; list[i]; i++) {
+        if (strcmp(list[i], ".") == 0 || strcmp(list[i], "..") == 0)
+            continue;
+
+        if (!batch) {
+            batch = calloc(1, sizeof(afc_walk_item_t));
+            if (batch) {
+                batch->dir = dir;
+                batch->names = calloc(AFC_WALK_BATCH, sizeof(char *));
+            }
+            if (!batch || !batch->names) {
+                fprintf(stderr, "Error: out of memory listing \"%s\"\n", dir);
+                afc_walk_item_free(batch);
+                return AFC_E_NO_MEM;
+            }
+        }
+        batch->names[batch->count++] = strdup(list[i]);
+        if (batch->count == AFC_WALK_BATCH) {
+            afc_walk_push(worker, batch);
+            batch = NULL;
+        }
+    }
+    if (batch)
+        afc_walk_push(worker, batch);
+
+    return AFC_E_SUCCESS;
+}
+
+// AFC_WALK_UNREAD, fn hears about a path that was skipped
+static void afc_walk_unread(int flags, afc_walk_fn fn, void *ctx, const char *path) {
+    afc_entry_t entry;
+
+    if (!fn || !(flags & AFC_WALK_UNREAD) || !path)
+        return;
+    memset(&entry, 0, sizeof(afc_entry_t));
+    entry.path = path;
+    entry.unread = true;
+    fn(&entry, ctx);
+}
+
+static void afc_walk_read_dir(afc_walk_worker_t *worker, afc_walk_item_t *item) {
+    afc_walk_t *walk = worker->walk;
+    char **list = NULL;
+
+    if (idev_verbose)
+        fprintf(stderr, "[debug] reading afc directory contents at \"%s\"\n", item->dir);
+
+    afc_error_t err = afc_read_directory(worker->afc, item->dir, &list);
+    if (err != AFC_E_SUCCESS || !list) {
+        fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", item->dir, idev_afc_strerror(err));
+        if (list)
+            idevice_device_list_free(list);
+        afc_walk_unread(walk->flags, walk->fn, walk->ctx, item->dir);
+        return;
+    }
+
+    if (afc_walk_queue_names(worker, item->dir, list) != AFC_E_SUCCESS)
+        afc_walk_unread(walk->flags, walk->fn, walk->ctx, item->dir);
+    idevice_device_list_free(list);
+}
+
+// NAMES without RECURSIVE, the name is all there is to report
+static bool afc_walk_names_only(int flags) {
+    return (flags & AFC_WALK_NAMES) && !(flags & AFC_WALK_RECURSIVE);
+}
+
+static afc_error_t afc_walk_name_entry(afc_arena_t *arena, const char *path, afc_entry_t *entry) {
+    memset(entry, 0, sizeof(afc_entry_t));
+    entry->path = afc_arena_strdup(arena, path);
+    return (entry->path) ? AFC_E_SUCCESS : AFC_E_NO_MEM;
+}
+
+// a kept entry is either counted into the worker's array or handed straight to the callback
+static void afc_walk_keep(afc_walk_worker_t *worker, const afc_entry_t *entry) {
+    afc_walk_t *walk = worker->walk;
+
+    if (walk->fn)
+        walk->fn(entry, walk->ctx);
+    else
+        worker->count++;
+}
+
+static void afc_walk_stat(afc_walk_worker_t *worker, afc_walk_item_t *item) {
+    afc_walk_t *walk = worker->walk;
+    afc_arena_t *arena = (walk->fn) ? &worker->scratch : &worker->arena;
+    afc_entry_t streamed;
+    int i;
+
+    for (i = 0; i < item->count; i++) {
+        if (!item->names[i])
+            continue;
+
+        const char *path = afc_walk_join(&worker->pathbuf, &worker->pathcap, item->dir, item->names[i]);
+        afc_entry_t *entry = (walk->fn) ? &streamed : afc_walk_append(worker);
+        if (!path || !entry) {
+            fprintf(stderr, "Error: out of memory listing \"%s\"\n", item->dir);
+            afc_walk_unread(walk->flags, walk->fn, walk->ctx, item->dir);
+            continue;
+        }
+        if (walk->fn)
+            afc_arena_reset(arena);
+
+        if (afc_walk_names_only(walk->flags)) {
+            if (afc_walk_name_entry(arena, path, entry) == AFC_E_SUCCESS)
+                afc_walk_keep(worker, entry);
+            continue;
+        }
+
+        afc_error_t err = afc_entry_stat(worker->afc, arena, path, entry);
+        if (err != AFC_E_SUCCESS) {
+            fprintf(stderr, "Error: info error for path: %s - %s\n", path, idev_afc_strerror(err));
+            afc_walk_unread(walk->flags, walk->fn, walk->ctx, path);
+            continue;
+        }
+
+        if (entry->type == AFC_ENTRY_FILE || entry->type == AFC_ENTRY_LINK) {
+            afc_walk_keep(worker, entry);
+        } else if (entry->type == AFC_ENTRY_DIR) {
+            // kept before its items are queued, so a streamed folder comes ahead of its contents
+            const char *dir = entry->path;
+            if (walk->flags & AFC_WALK_DIRS)
+                afc_walk_keep(worker, entry);
+            if (!(walk->flags & AFC_WALK_RECURSIVE))
+                continue;
+
+            afc_walk_item_t *sub = calloc(1, sizeof(afc_walk_item_t));
+            // the scratch copy is gone with the next name, the folder's items need theirs for longer
+            if (walk->fn)
+                dir = afc_arena_strdup(&worker->arena, dir);
+            if (sub && dir) {
+                sub->dir = dir;
+                afc_walk_push(worker, sub);
+            } else {
+                free(sub);
+                fprintf(stderr, "Error: out of memory, skipping \"%s\"\n", path);
+                afc_walk_unread(walk->flags, walk->fn, walk->ctx, path);
+            }
+        }
+    }
+}
+
+static void afc_walk_run(afc_walk_worker_t *worker, afc_walk_item_t *item) {
+    afc_walk_t *walk = worker->walk;
+
+    if (item->names)
+        afc_walk_stat(worker, item);
+    else
+        afc_walk_read_dir(worker, item);
+    afc_walk_item_free(item);
+
+    pthread_mutex_lock(&walk->lock);
+    if (--walk->pending == 0)
+        pthread_cond_broadcast(&walk->work);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static afc_walk_item_t *afc_walk_next(afc_walk_worker_t *worker) {
+    afc_walk_t *walk = worker->walk;
+
+    for (;;) {
+        pthread_mutex_lock(&walk->lock);
+        unsigned long generation = walk->generation;
+        bool done = (walk->pending == 0);
+        pthread_mutex_unlock(&walk->lock);
+        if (done)
+            return NULL;
+
+        afc_walk_item_t *item = afc_walk_deque_pop(&worker->deque);
+        int i;
+        for (i = 1; !item && i < walk->count; i++)
+            item = afc_walk_deque_steal(&walk->workers[(worker->index + i) % walk->count].deque);
+        if (item)
+            return item;
+
+        // nothing to take, sleep until somebody pushes or the last item finishes
+        pthread_mutex_lock(&walk->lock);
+        while (walk->pending > 0 && walk->generation == generation)
+            pthread_cond_wait(&walk->work, &walk->lock);
+        pthread_mutex_unlock(&walk->lock);
+    }
+}
+
+static void *afc_walk_worker_main(void *arg) {
+    afc_walk_worker_t *worker = arg;
+    afc_walk_item_t *item;
+
+    while ((item = afc_walk_next(worker)) != NULL)
+        afc_walk_run(worker, item);
+
+    return NULL;
+}
+
+#pragma mark - Walk
+
+static afc_error_t afc_walk_parallel(afc_client_t afc, const char *path, int flags, int workers, afc_tree_t *tree, afc_walk_fn fn, void *ctx) {
+    memset(tree, 0, sizeof(afc_tree_t));
+
+    // read the top level here so the caller still gets READ_ERROR for a file and can fall back
+    char **list = NULL;
+    if (idev_verbose)
+        fprintf(stderr, "[debug] reading afc directory contents at \"%s\"\n", path);
+    afc_error_t err = afc_read_directory(afc, path, &list);
+    if (err != AFC_E_SUCCESS || !list) {
+        if (list)
+            idevice_device_list_free(list);
+        return (err != AFC_E_SUCCESS) ? err : AFC_E_UNKNOWN_ERROR;
+    }
+
+    if (workers < 1 || afc_walk_names_only(flags))
+        workers = 1;   // a single directory read, nothing to spread around
+
+    afc_walk_t walk;
+    memset(&walk, 0, sizeof(afc_walk_t));
+    walk.flags = flags;
+    walk.fn = fn;
+    walk.ctx = ctx;
+    walk.workers = calloc(workers, sizeof(afc_walk_worker_t));
+    const char *root = afc_arena_strdup(&tree->arena, path);
+    if (!walk.workers || !root) {
+        free(walk.workers);
+        afc_arena_free(&tree->arena);
+        idevice_device_list_free(list);
+        return AFC_E_NO_MEM;
+    }
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.work, NULL);
+
+    // worker 0 is us on the caller's connection, the rest get their own
+    int i;
+    walk.workers[0].afc = afc;
+    walk.count = 1;
+    for (i = 1; i < workers; i++) {
+        afc_walk_worker_t *worker = &walk.workers[walk.count];
+        if (idev_afc_connection_open(&worker->con) != EXIT_SUCCESS)
+            break;
+        worker->afc = worker->con.afc;
+        walk.count++;
+    }
+    for (i = 0; i < walk.count; i++) {
+        walk.workers[i].walk = &walk;
+        walk.workers[i].index = i;
+        pthread_mutex_init(&walk.workers[i].deque.lock, NULL);
+    }
+    if (walk.count < workers)
+        fprintf(stderr, "Warning: only %d of %d afc connections could be opened\n", walk.count, workers);
+
+    // seed worker 0 with the top level names, stealing spreads them from there
+    err = afc_walk_queue_names(&walk.workers[0], root, list);
+    idevice_device_list_free(list);
+
+    for (i = 1; i < walk.count; i++) {
+        if (pthread_create(&walk.workers[i].thread, NULL, afc_walk_worker_main, &walk.workers[i]) == 0)
+            walk.workers[i].started = true;
+    }
+    if (idev_verbose && walk.count > 1)
+        fprintf(stderr, "[debug] walking \"%s\" with %d afc connections\n", path, walk.count);
+
+    afc_walk_worker_main(&walk.workers[0]);
+
+    size_t total = 0;
+    for (i = 0; i < walk.count; i++) {
+        if (walk.workers[i].started)
+            pthread_join(walk.workers[i].thread, NULL);
+        total += walk.workers[i].count;
+    }
+
+    // one flat array for the caller, the strings stay where the workers put them
+    afc_entry_t *all = (total) ? malloc(total * sizeof(afc_entry_t)) : NULL;
+    size_t n = 0;
+    for (i = 0; i < walk.count; i++) {
+        afc_walk_worker_t *worker = &walk.workers[i];
+        if (all && worker->count) {
+            memcpy(all + n, worker->entries, worker->count * sizeof(afc_entry_t));
+            n += worker->count;
+        }
+        afc_arena_merge(&tree->arena, &worker->arena);
+        afc_arena_free(&worker->scratch);
+        free(worker->entries);
+        free(worker->pathbuf);
+        free(worker->deque.items);
+        pthread_mutex_destroy(&worker->deque.lock);
+        if (i > 0)
+            idev_afc_connection_close(&worker->con);
+    }
+    pthread_cond_destroy(&walk.work);
+    pthread_mutex_destroy(&walk.lock);
+    free(walk.workers);
+
+    if (total && !all) {
+        afc_arena_free(&tree->arena);
+        return AFC_E_NO_MEM;
+    }
+
+    if (n > 1)
+        qsort(all, n, sizeof(afc_entry_t), afc_walk_entry_compare);
+
+    tree->entries = all;
+    tree->count = n;
+    return err;
+}
+
+afc_error_t afc_walk(afc_client_t afc, const char *path, int flags, int workers, afc_tree_t *tree) {
+    return afc_walk_parallel(afc, path, flags, workers, tree, NULL, NULL);
+}
+
+afc_error_t afc_walk_stream(afc_client_t afc, const char *path, int flags, int workers, afc_walk_fn fn, void *ctx) {
+    afc_tree_t tree;
+    afc_error_t err = afc_walk_parallel(afc, path, flags, workers, &tree, fn, ctx);
+    afc_tree_free(&tree);   // no entries in it, just the folder paths
+
+    // a file, report just that like the ordered walk does
+    if (err == AFC_E_READ_ERROR) {
+        afc_arena_t arena = { NULL };
+        afc_entry_t entry;
+        err = afc_entry_stat(afc, &arena, path, &entry);
+        if (err == AFC_E_SUCCESS)
+            fn(&entry, ctx);
+        afc_arena_free(&arena);
+    }
+    return err;
+}
+
+void afc_tree_free(afc_tree_t *tree) {
+    free(tree->entries);
+    afc_arena_free(&tree->arena);
+    tree->entries = NULL;
+    tree->count = 0;
+}
+
+#pragma mark - Ordered walk
+
+typedef struct afc_walk_frame_t {
+    char *dir;
+    char **names;               // sorted, without "." and ".."
+    size_t next;
+    size_t count;
+} afc_walk_frame_t;
+
+static int afc_walk_name_compare(const void *a, const void *b) {
+    return afc_walk_path_compare(*(char * const *)a, *(char * const *)b);
+}
+
+static void afc_walk_frame_free(afc_walk_frame_t *frame) {
+    size_t i;
+    for (i = 0; i < frame->count; i++)
+        free(frame->names[i]);
+    free(frame->names);
+    free(frame->dir);
+}
+
+static afc_error_t afc_walk_frame_read(afc_client_t afc, const char *dir, afc_walk_frame_t *frame) {
+    char **list = NULL;
+    size_t i, n = 0;
+
+    memset(frame, 0, sizeof(afc_walk_frame_t));
+    if (idev_verbose)
+        fprintf(stderr, "[debug] reading afc directory contents at \"%s\"\n", dir);
+
+    afc_error_t err = afc_read_directory(afc, dir, &list);
+    if (err != AFC_E_SUCCESS || !list) {
+        if (list)
+            idevice_device_list_free(list);
+        return (err != AFC_E_SUCCESS) ? err : AFC_E_UNKNOWN_ERROR;
+    }
+
+    // the listing's own strings are reused, only "." and ".." are dropped
+    for (i = 0; list[i]; i++) {
+        if (strcmp(list[i], ".") == 0 || strcmp(list[i], "..") == 0)
+            free(list[i]);
+        else
+            list[n++] = list[i];
+    }
+    list[n] = NULL;
+    if (n > 1)
+        qsort(list, n, sizeof(char *), afc_walk_name_compare);
+
+    frame->dir = strdup(dir);
+    if (!frame->dir) {
+        idevice_device_list_free(list);
+        return AFC_E_NO_MEM;
+    }
+    frame->names = list;
+    frame->count = n;
+    return AFC_E_SUCCESS;
+}
+
+afc_error_t afc_walk_ordered(afc_client_t afc, const char *path, int flags, afc_walk_fn fn, void *ctx) {
+    char *pathbuf = NULL;
+    size_t pathcap = 0;
+    afc_arena_t arena = { NULL };
+    afc_entry_t entry;
+
+    afc_walk_frame_t *stack = malloc(sizeof(afc_walk_frame_t) * 16);
+    size_t depth = 0, cap = 16;
+    if (!stack)
+        return AFC_E_NO_MEM;
+
+    afc_error_t err = afc_walk_frame_read(afc, path, &stack[0]);
+    if (err == AFC_E_READ_ERROR) {
+        if (idev_verbose)
+            fprintf(stderr, "[debug] directory read error -- falling back to file info at %s\n", path);
+        err = afc_entry_stat(afc, &arena, path, &entry);
+        if (err == AFC_E_SUCCESS)
+            fn(&entry, ctx);
+        afc_arena_free(&arena);
+        free(stack);
+        return err;
+    }
+    if (err != AFC_E_SUCCESS) {
+        free(stack);
+        return err;
+    }
+    depth = 1;
+
+    while (depth > 0) {
+        afc_walk_frame_t *frame = &stack[depth-1];
+        if (frame->next == frame->count) {
+            afc_walk_frame_free(frame);
+            depth--;
+            continue;
+        }
+
+        const char *lpath = afc_walk_join(&pathbuf, &pathcap, frame->dir, frame->names[frame->next++]);
+        if (!lpath) {
+            err = AFC_E_NO_MEM;
+            break;
+        }
+
+        afc_arena_reset(&arena);
+        if (afc_walk_names_only(flags)) {
+            if (afc_walk_name_entry(&arena, lpath, &entry) == AFC_E_SUCCESS)
+                fn(&entry, ctx);
+            continue;
+        }
+
+        afc_error_t serr = afc_entry_stat(afc, &arena, lpath, &entry);
+        if (serr != AFC_E_SUCCESS) {
+            fprintf(stderr, "Error: info error for path: %s - %s\n", lpath, idev_afc_strerror(serr));
+            afc_walk_unread(flags, fn, ctx, lpath);
+            continue;
+        }
+
+        if (entry.type == AFC_ENTRY_DIR) {
+            if (flags & AFC_WALK_DIRS)
+                fn(&entry, ctx);
+            if (!(flags & AFC_WALK_RECURSIVE))
+                continue;
+
+            if (depth == cap) {
+                afc_walk_frame_t *grown = realloc(stack, sizeof(afc_walk_frame_t) * cap * 2);
+                if (!grown) {
+                    err = AFC_E_NO_MEM;
+                    break;
+                }
+                stack = grown;
+                cap *= 2;
+            }
+            serr = afc_walk_frame_read(afc, entry.path, &stack[depth]);
+            if (serr == AFC_E_SUCCESS) {
+                depth++;
+            } else {
+                fprintf(stderr, "Error: afc list \"%s\" failed: %s\n", entry.path, idev_afc_strerror(serr));
+                afc_walk_unread(flags, fn, ctx, entry.path);
+            }
+        } else if (entry.type == AFC_ENTRY_FILE || entry.type == AFC_ENTRY_LINK) {
+            fn(&entry, ctx);
+        }
+    }
+
+    while (depth > 0)
+        afc_walk_frame_free(&stack[--depth]);
+    free(stack);
+    free(pathbuf);
+    afc_arena_free(&arena);
+    return err;
+}
+
+afc_error_t afc_walk_each(afc_client_t afc, const char *path, int flags, int workers, afc_walk_fn fn, void *ctx) {
+    if (workers <= 1)
+        return afc_walk_ordered(afc, path, flags, fn, ctx);
+
+    afc_tree_t tree;
+    size_t i;
+    afc_error_t err = afc_walk(afc, path, flags, workers, &tree);
+    for (i = 0; i < tree.count; i++)
+        fn(&tree.entries[i], ctx);
+    afc_tree_free(&tree);
+
+    // a file, report just that like the ordered walk does
+    if (err == AFC_E_READ_ERROR) {
+        afc_arena_t arena = { NULL };
+        afc_entry_t entry;
+        err = afc_entry_stat(afc, &arena, path, &entry);
+        if (err == AFC_E_SUCCESS)
+            fn(&entry, ctx);
+        afc_arena_free(&arena);
+    }
+    return err;
+}
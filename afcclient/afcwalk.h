@@ -0,0 +1,106 @@
+/*
+ * afcwalk
+ *
+ * breadth-first, multi-connection directory walker behind afc_list_path.
+ *
+ * directory reads and batches of stat requests are work items on per-worker
+ * deques. a worker takes its own newest item first and, once it runs dry,
+ * steals the oldest item of another worker, so one deep narrow subtree doesn't
+ * leave everybody else idle. there is no recursion, the tree depth only costs
+ * heap. results are sorted by path at the end (parents before their contents)
+ * so the output is the same from run to run.
+ *
+ * afc_walk_ordered is the streaming counterpart, one connection, same order.
+ * afc_walk_stream streams from all the connections at once, in no order.
+ */
+
+#ifndef _afcwalk_h
+#define _afcwalk_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "libimobiledevice/afc.h"
+#include "afcentry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_WALK_RECURSIVE  0x1     // descend into directories
+#define AFC_WALK_DIRS       0x2     // report directories as entries, not just what is in them
+#define AFC_WALK_NAMES      0x4     // directory reads only, see below
+#define AFC_WALK_UNREAD     0x8     // fn also gets the paths that had to be skipped, see below
+
+/*
+
+ AFC_WALK_NAMES is for listings that only need paths. without RECURSIVE no name is stat'ed
+ at all: every name is reported, folders included, with just path set and type UNKNOWN.
+ with RECURSIVE each name still takes one stat as a type probe, since afc has no other
+ way to tell a folder from a file, but no entry asks for more than that.
+
+ */
+
+/*
+
+ AFC_WALK_UNREAD is for callers that act on what is missing. a streamed or ordered walk reports
+ every folder it couldn't list and every name it couldn't stat to fn as well, as an entry with
+ only path and unread set. nothing below such a path was walked.
+
+ */
+
+#define AFC_WALK_BATCH 32   // names stat'ed per work item, small enough to spread a huge directory around
+
+// a finished walk: one flat array, every string in it owned by arena
+typedef struct afc_tree_t {
+    afc_entry_t *entries;
+    size_t count;
+    afc_arena_t arena;
+} afc_tree_t;
+
+/*
+
+ walks path with up to workers connections (the caller's afc plus workers - 1 opened on
+ the same session). flags are AFC_WALK_* above, afc_list_path used to give directories only
+ when recursive so that is RECURSIVE | DIRS or 0. returns the error from reading path itself,
+ everything below that is reported and skipped.
+
+ */
+afc_error_t afc_walk(afc_client_t afc, const char *path, int flags, int workers, afc_tree_t *tree);
+
+void afc_tree_free(afc_tree_t *tree);
+
+// called once per entry by afc_walk_ordered, the entry is only valid during the call
+typedef void (*afc_walk_fn)(const afc_entry_t *entry, void *ctx);
+
+/*
+
+ single connection depth-first walk that hands out entries as soon as they are stat'ed,
+ in the same order afc_walk sorts them into. keeps one directory listing per level in
+ memory instead of the whole tree, for output that can be written as it comes. a file
+ path is reported as a single entry instead of failing with READ_ERROR.
+
+ */
+afc_error_t afc_walk_ordered(afc_client_t afc, const char *path, int flags, afc_walk_fn fn, void *ctx);
+
+/*
+
+ afc_walk with the sorting and the tree left out: fn gets each entry as soon as a worker has
+ stat'ed it, from that worker's thread, so it has to be thread safe and sees entries in no
+ particular order (a folder does come before anything in it). fn may block, the worker
+ just stops walking until it returns. only folder paths are held on to, not files.
+
+ */
+afc_error_t afc_walk_stream(afc_client_t afc, const char *path, int flags, int workers, afc_walk_fn fn, void *ctx);
+
+// afc_walk_ordered with one worker, otherwise afc_walk and the sorted result handed out afterwards. same entries either way.
+afc_error_t afc_walk_each(afc_client_t afc, const char *path, int flags, int workers, afc_walk_fn fn, void *ctx);
+
+// path order used for the final sort, '/' sorts before everything so a folder's contents stay together
+int afc_walk_path_compare(const char *a, const char *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcwalk_h
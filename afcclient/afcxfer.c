@@ -0,0 +1,308 @@
+/*
+ * afcxfer
+ *
+ * transfer sizing for the afc_file_read / afc_file_write loops, see afcxfer.h
+ *
+ * adaptive mode starts at AFC_XFER_START_CHUNK and doubles the request size
+ * as long as each step is measurably faster than the last one, then settles on
+ * the best size it saw. a TOO_MUCH_DATA or timeout reply halves the size and
+ * lowers the ceiling so we never ask for that much again on this handle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include "afcxfer.h"
+#include "libidev.h"
+
+#define AFC_XFER_SAMPLES    4       // full sized requests timed before judging a size
+#define AFC_XFER_GAIN       1.05    // a doubling has to buy at least 5% to be kept
+#define AFC_XFER_ALIGN      4096    // buffers start on a page and cover whole pages
+
+uint32_t afc_chunk_size = 0;
+
+static double afc_xfer_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static const char *afc_xfer_mode_name(afc_xfer_mode_t mode) {
+    switch (mode) {
+        case AFC_XFER_FIXED:
+            return "fixed";
+        case AFC_XFER_SINGLE:
+            return "single read";
+        case AFC_XFER_ADAPTIVE:
+        default:
+            return "adaptive";
+    }
+}
+
+/*
+
+ accepts "auto" or a byte count with an optional k/m suffix, ie: 65536, 256k, 1m
+
+ */
+
+int afc_xfer_parse_size(const char *arg, uint32_t *size) {
+    if (!arg || !*arg)
+        return -1;
+
+    if (strcmp(arg, "auto") == 0) {
+        *size = 0;
+        return 0;
+    }
+
+    char *end = NULL;
+    unsigned long long val = strtoull(arg, &end, 10);
+    if (end == arg)
+        return -1;
+
+    switch (tolower((unsigned char)*end)) {
+        case 'k':
+            val *= 1024;
+            end++;
+            break;
+        case 'm':
+            val *= 1024 * 1024;
+            end++;
+            break;
+    }
+    if (*end != '\0' || val < 512 || val > AFC_XFER_MAX_CHUNK)
+        return -1;
+
+    *size = (uint32_t)val;
+    return 0;
+}
+
+void afc_xfer_init(afc_xfer_t *xfer, uint64_t expected) {
+    memset(xfer, 0, sizeof(afc_xfer_t));
+    xfer->expected = expected;
+    xfer->ceiling = AFC_XFER_MAX_CHUNK;
+
+    uint32_t single_limit = (afc_chunk_size) ? afc_chunk_size : AFC_XFER_SMALL_FILE;
+
+    if (expected > 0 && expected <= single_limit) {
+        xfer->mode = AFC_XFER_SINGLE;
+        xfer->chunk = (uint32_t)expected;
+    } else if (afc_chunk_size) {
+        xfer->mode = AFC_XFER_FIXED;
+        xfer->chunk = afc_chunk_size;
+    } else {
+        xfer->mode = AFC_XFER_ADAPTIVE;
+        xfer->chunk = AFC_XFER_START_CHUNK;
+    }
+    xfer->best_chunk = xfer->chunk;
+}
+
+static char *afc_xfer_aligned_alloc(size_t size) {
+#if defined(_WIN32)
+    return _aligned_malloc(size, AFC_XFER_ALIGN);
+#else
+    void *buf = NULL;
+    return (posix_memalign(&buf, AFC_XFER_ALIGN, size) == 0) ? buf : NULL;
+#endif
+}
+
+void afc_xfer_buffer_free(char *buf) {
+#if defined(_WIN32)
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
+
+// the buffer never has to keep its contents when it grows, so it is simply replaced
+char *afc_xfer_buffer_grow(char **buf, uint32_t *bufsize, uint32_t size) {
+    if (*bufsize < size) {
+        uint32_t grown = (size + AFC_XFER_ALIGN - 1) & ~(uint32_t)(AFC_XFER_ALIGN - 1);
+        char *fresh = afc_xfer_aligned_alloc(grown);
+        if (!fresh)
+            return NULL;
+        if (*buf)
+            afc_xfer_buffer_free(*buf);
+        *buf = fresh;
+        *bufsize = grown;
+    }
+    return *buf;
+}
+
+void afc_xfer_free(afc_xfer_t *xfer) {
+    if (xfer->buf)
+        afc_xfer_buffer_free(xfer->buf);
+    xfer->buf = NULL;
+    xfer->bufsize = 0;
+}
+
+void afc_xfer_report(afc_xfer_t *xfer, const char *path) {
+    if (!idev_verbose)
+        return;
+
+    fprintf(stderr, "[debug] %s: %s transfer, chunk size %u bytes", path, afc_xfer_mode_name(xfer->mode), xfer->chunk);
+    if (xfer->mode == AFC_XFER_ADAPTIVE && xfer->best_rate > 0)
+        fprintf(stderr, " (%.1f MB/s)", xfer->best_rate / (1024 * 1024));
+    if (xfer->backoffs)
+        fprintf(stderr, ", backed off %d time(s)", xfer->backoffs);
+    fprintf(stderr, "\n");
+}
+
+static char *afc_xfer_buffer(afc_xfer_t *xfer, uint32_t size) {
+    return afc_xfer_buffer_grow(&xfer->buf, &xfer->bufsize, size);
+}
+
+// the next request size, never above what the device has accepted so far
+static uint32_t afc_xfer_want(afc_xfer_t *xfer) {
+    uint32_t want = xfer->chunk;
+    if (xfer->mode == AFC_XFER_SINGLE && xfer->expected > xfer->offset && xfer->expected - xfer->offset < want)
+        want = (uint32_t)(xfer->expected - xfer->offset);
+    else if (xfer->mode == AFC_XFER_SINGLE && want < AFC_XFER_MIN_CHUNK)
+        want = AFC_XFER_MIN_CHUNK;     // past st_size, a file that grew isn't read a few bytes at a time
+    if (xfer->limit > xfer->offset && xfer->limit - xfer->offset < want)
+        want = (uint32_t)(xfer->limit - xfer->offset);
+    if (want > xfer->ceiling)
+        want = xfer->ceiling;
+    return (want) ? want : AFC_XFER_MIN_CHUNK;
+}
+
+// halves the request size after the device choked on it, returns false when there is nothing left to give
+static bool afc_xfer_backoff(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, uint32_t want, afc_error_t err) {
+    if (err != AFC_E_TOO_MUCH_DATA && err != AFC_E_OP_TIMEOUT)
+        return false;
+    if (want <= AFC_XFER_MIN_CHUNK)
+        return false;
+
+    // a timed out request may have moved the file position, put it back where we think it is
+    if (err == AFC_E_OP_TIMEOUT && afc_file_seek(afc, handle, (int64_t)xfer->offset, SEEK_SET) != AFC_E_SUCCESS)
+        return false;
+
+    xfer->ceiling = want / 2;
+    if (xfer->ceiling < AFC_XFER_MIN_CHUNK)
+        xfer->ceiling = AFC_XFER_MIN_CHUNK;
+    if (xfer->chunk > xfer->ceiling)
+        xfer->chunk = xfer->ceiling;
+    if (xfer->best_chunk > xfer->ceiling)
+        xfer->best_chunk = xfer->ceiling;
+    xfer->settled = true;
+    xfer->backoffs++;
+
+    if (idev_verbose)
+        fprintf(stderr, "[debug] %s on a %u byte request, backing off to %u\n", idev_afc_strerror(err), want, xfer->ceiling);
+
+    return true;
+}
+
+static void afc_xfer_adapt(afc_xfer_t *xfer, uint32_t want, uint32_t bytes, double elapsed) {
+    if (xfer->mode != AFC_XFER_ADAPTIVE || xfer->settled)
+        return;
+
+    // a short read near the end of the file says nothing about the request size
+    if (bytes < want)
+        return;
+
+    xfer->sample_bytes += bytes;
+    xfer->sample_time += elapsed;
+    if (++xfer->sample_count < AFC_XFER_SAMPLES)
+        return;
+
+    double rate = xfer->sample_bytes / ((xfer->sample_time > 0.000001) ? xfer->sample_time : 0.000001);
+    xfer->sample_bytes = 0;
+    xfer->sample_time = 0;
+    xfer->sample_count = 0;
+
+    if (rate > xfer->best_rate * AFC_XFER_GAIN) {
+        xfer->best_rate = rate;
+        xfer->best_chunk = xfer->chunk;
+        if (xfer->chunk * 2 <= xfer->ceiling) {
+            xfer->chunk *= 2;
+        } else {
+            xfer->settled = true;
+        }
+    } else {
+        xfer->chunk = xfer->best_chunk;
+        xfer->settled = true;
+    }
+}
+
+uint32_t afc_xfer_next_size(afc_xfer_t *xfer) {
+    return afc_xfer_want(xfer);
+}
+
+afc_error_t afc_xfer_read(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, uint32_t *bytes_read) {
+    *bytes_read = 0;
+    if (!afc_xfer_buffer(xfer, afc_xfer_want(xfer)))
+        return AFC_E_NO_MEM;
+    return afc_xfer_read_into(afc, handle, xfer, xfer->buf, bytes_read);
+}
+
+afc_error_t afc_xfer_read_into(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, char *buf, uint32_t *bytes_read) {
+    afc_error_t err;
+    uint32_t want;
+    double elapsed;
+
+    *bytes_read = 0;
+
+    // no shortcut once st_size bytes are in, like every other mode a single read still ends with
+    // the read that hits EOF, a file that grew since it was stat'ed would be cut off otherwise
+    if (xfer->limit && xfer->offset >= xfer->limit)
+        return AFC_E_SUCCESS;
+
+    do {
+        // a backoff only ever makes the request smaller, buf still fits it
+        want = afc_xfer_want(xfer);
+
+        double start = afc_xfer_now();
+        err = afc_file_read(afc, handle, buf, want, bytes_read);
+        elapsed = afc_xfer_now() - start;
+    } while (err != AFC_E_SUCCESS && afc_xfer_backoff(afc, handle, xfer, want, err));
+
+    if (err == AFC_E_SUCCESS) {
+        xfer->offset += *bytes_read;
+        afc_xfer_adapt(xfer, want, *bytes_read, elapsed);
+    }
+    return err;
+}
+
+afc_error_t afc_xfer_write(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, const char *data, uint32_t length, uint32_t *bytes_written) {
+    afc_error_t err = AFC_E_SUCCESS;
+
+    *bytes_written = 0;
+    while (*bytes_written < length) {
+        uint32_t want = afc_xfer_want(xfer);
+        uint32_t left = length - *bytes_written;
+        uint32_t piece = (left < want) ? left : want;
+        uint32_t written = 0;
+
+        double start = afc_xfer_now();
+        err = afc_file_write(afc, handle, data + *bytes_written, piece, &written);
+        double elapsed = afc_xfer_now() - start;
+
+        if (err != AFC_E_SUCCESS) {
+            if (afc_xfer_backoff(afc, handle, xfer, piece, err))
+                continue;
+            break;
+        }
+
+        *bytes_written += written;
+        xfer->offset += written;
+        afc_xfer_adapt(xfer, want, written, elapsed);
+
+        if (written == 0) {
+            err = AFC_E_WRITE_ERROR;
+            break;
+        }
+    }
+    return err;
+}
+
+// put sizes its local reads from the same chunk, so the buffer is handed out here
+char *afc_xfer_write_buffer(afc_xfer_t *xfer, uint32_t *size) {
+    *size = afc_xfer_want(xfer);
+    return afc_xfer_buffer(xfer, *size);
+}
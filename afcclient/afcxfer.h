@@ -0,0 +1,91 @@
+/*
+ * afcxfer
+ *
+ * transfer sizing for the afc_file_read / afc_file_write loops.
+ *
+ * every get/put/clone/export/cat used to move data in fixed 8k requests, which
+ * on a multi GB file means hundreds of thousands of usbmux round trips. this
+ * picks the request size instead: fixed (--chunk-size=N), a single read sized
+ * from st_size for small files, or adaptive, growing while throughput keeps
+ * improving and backing off when the device says TOO_MUCH_DATA or times out.
+ */
+
+#ifndef _afcxfer_h
+#define _afcxfer_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libimobiledevice/afc.h"
+#include "afchash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_XFER_MIN_CHUNK      (8 * 1024)          // the old CHUNKSZ, never back off below this
+#define AFC_XFER_START_CHUNK    (64 * 1024)         // where adaptive mode starts probing
+#define AFC_XFER_MAX_CHUNK      (4 * 1024 * 1024)   // largest request we will ever issue
+#define AFC_XFER_SMALL_FILE     (1024 * 1024)       // files up to this size are read in one request
+
+typedef enum {
+    AFC_XFER_ADAPTIVE = 0,
+    AFC_XFER_FIXED,
+    AFC_XFER_SINGLE
+} afc_xfer_mode_t;
+
+typedef struct afc_xfer_t {
+    afc_xfer_mode_t mode;
+    char *buf;              // request buffer, always at least chunk bytes
+    uint32_t bufsize;
+    uint32_t chunk;         // size of the next request
+    uint32_t ceiling;       // lowered every time the device rejects a size
+    uint64_t expected;      // st_size when known, 0 otherwise
+    uint64_t offset;        // bytes moved so far, used to reposition after a timeout
+    uint64_t limit;         // requests stop at this offset, 0 is no limit
+    afc_hash_t *hash;       // --verify, afcpipe feeds it every byte in file order
+    bool settled;           // adaptive mode stopped probing
+    double best_rate;       // bytes/sec at the best size seen so far
+    uint32_t best_chunk;
+    uint64_t sample_bytes;  // bytes/time accumulated at the current size
+    double sample_time;
+    int sample_count;
+    int backoffs;
+} afc_xfer_t;
+
+// 0 means adaptive, anything else is a fixed request size set with --chunk-size
+extern uint32_t afc_chunk_size;
+
+int afc_xfer_parse_size(const char *arg, uint32_t *size);
+
+void afc_xfer_init(afc_xfer_t *xfer, uint64_t expected);
+
+void afc_xfer_free(afc_xfer_t *xfer);
+
+void afc_xfer_report(afc_xfer_t *xfer, const char *path);
+
+// reads the next chunk into xfer->buf, bytes_read == 0 means end of file
+afc_error_t afc_xfer_read(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, uint32_t *bytes_read);
+
+// size of the next read request, a buffer handed to afc_xfer_read_into has to hold this much
+uint32_t afc_xfer_next_size(afc_xfer_t *xfer);
+
+// afc_xfer_read into a buffer of the caller's, for when several reads are in flight
+afc_error_t afc_xfer_read_into(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, char *buf, uint32_t *bytes_read);
+
+// page aligned buffers like the one in afc_xfer_t, growing one doesn't keep what was in it
+char *afc_xfer_buffer_grow(char **buf, uint32_t *bufsize, uint32_t size);
+
+void afc_xfer_buffer_free(char *buf);
+
+// buffer for the next local read on an upload, size is set to the current request size
+char *afc_xfer_write_buffer(afc_xfer_t *xfer, uint32_t *size);
+
+// writes all of data, splitting it into requests of the current chunk size
+afc_error_t afc_xfer_write(afc_client_t afc, uint64_t handle, afc_xfer_t *xfer, const char *data, uint32_t length, uint32_t *bytes_written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcxfer_h
@@ -0,0 +1,103 @@
+/*
+ * afcxml
+ *
+ * streaming plist XML writer, see afcxml.h
+ *
+ * mirrors libplist's xml writer for an array of string dicts: tab indentation,
+ * <array/> when there is nothing in it, and only & < > escaped in keys and
+ * strings.
+ */
+
+#include <string.h>
+
+#include "afcxml.h"
+
+#define AFC_XML_HEADER "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+    "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n" \
+    "<plist version=\"1.0\">\n"
+
+static void afc_xml_escaped(FILE *out, const char *str) {
+    const char *start = str;
+    const char *cur;
+
+    for (cur = str; *cur; cur++) {
+        const char *rep = NULL;
+        switch (*cur) {
+            case '&':
+                rep = "&amp;";
+                break;
+            case '<':
+                rep = "&lt;";
+                break;
+            case '>':
+                rep = "&gt;";
+                break;
+            default:
+                continue;
+        }
+        fwrite(start, 1, cur - start, out);
+        fputs(rep, out);
+        start = cur + 1;
+    }
+    fwrite(start, 1, cur - start, out);
+}
+
+static void afc_xml_string(FILE *out, const char *key, const char *val) {
+    fputs("\t\t<key>", out);
+    afc_xml_escaped(out, key);
+    fputs("</key>\n\t\t<string>", out);
+    afc_xml_escaped(out, val);
+    fputs("</string>\n", out);
+}
+
+static void afc_xml_number(FILE *out, const char *key, unsigned long long val) {
+    fprintf(out, "\t\t<key>%s</key>\n\t\t<string>%llu</string>\n", key, val);
+}
+
+void afc_xml_begin(afc_xml_t *xml, FILE *out) {
+    xml->out = out;
+    xml->count = 0;
+    fputs(AFC_XML_HEADER, out);
+}
+
+void afc_xml_entry(afc_xml_t *xml, const afc_entry_t *entry, const char *mtime, const char *birthtime) {
+    FILE *out = xml->out;
+
+    if (xml->count++ == 0)
+        fputs("<array>\n", out);
+
+    // same keys in the same order as afc_entry_plist
+    fputs("\t<dict>\n", out);
+    afc_xml_string(out, "path", entry->path);
+    if (entry->has & AFC_ENTRY_HAS_SIZE)
+        afc_xml_number(out, "st_size", entry->size);
+    if (entry->has & AFC_ENTRY_HAS_BLOCKS)
+        afc_xml_number(out, "st_blocks", entry->blocks);
+    if (entry->has & AFC_ENTRY_HAS_NLINK)
+        afc_xml_number(out, "st_nlink", entry->nlink);
+    if (afc_entry_type_name(entry->type))
+        afc_xml_string(out, "st_ifmt", afc_entry_type_name(entry->type));
+    if (entry->has & AFC_ENTRY_HAS_MTIME)
+        afc_xml_string(out, "st_mtime", mtime);
+    if (entry->has & AFC_ENTRY_HAS_BIRTHTIME)
+        afc_xml_string(out, "st_birthtime", birthtime);
+    if (entry->link)
+        afc_xml_string(out, "LinkTarget", entry->link);
+    fputs("\t</dict>\n", out);
+}
+
+void afc_xml_name(afc_xml_t *xml, const char *path) {
+    FILE *out = xml->out;
+
+    if (xml->count++ == 0)
+        fputs("<array>\n", out);
+
+    fputs("\t<dict>\n", out);
+    afc_xml_string(out, "path", path);
+    fputs("\t</dict>\n", out);
+}
+
+void afc_xml_end(afc_xml_t *xml) {
+    fputs((xml->count) ? "</array>\n" : "<array/>\n", xml->out);
+    fputs("</plist>\n", xml->out);
+}
@@ -0,0 +1,41 @@
+/*
+ * afcxml
+ *
+ * writes a listing straight out as plist XML, one <dict> per entry as it is
+ * handed in, instead of building the whole plist_t tree and converting it with
+ * plist_to_xml at the end. the bytes are the same ones libplist would produce
+ * for the array afc_list_path returns.
+ */
+
+#ifndef _afcxml_h
+#define _afcxml_h
+
+#include <stdio.h>
+
+#include "afcentry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct afc_xml_t {
+    FILE *out;
+    size_t count;
+} afc_xml_t;
+
+// header, the <array> itself is held back until we know whether it is empty
+void afc_xml_begin(afc_xml_t *xml, FILE *out);
+
+// times come preformatted so the output matches afc_file_info_for_path
+void afc_xml_entry(afc_xml_t *xml, const afc_entry_t *entry, const char *mtime, const char *birthtime);
+
+// --names-only, a dict with nothing but the path
+void afc_xml_name(afc_xml_t *xml, const char *path);
+
+void afc_xml_end(afc_xml_t *xml);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afcxml_h
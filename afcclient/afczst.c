@@ -0,0 +1,493 @@
+/*
+ * afczst
+ *
+ * parallel zstd frames for clone --compress, see afczst.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "afczst.h"
+
+#if defined(HAVE_ZSTD)
+
+#include <zstd.h>
+
+#define AFC_ZST_SKIPPABLE_MAGIC     0x184D2A5E  // skippable frame, the seek table goes in one
+#define AFC_ZST_SEEKABLE_MAGIC      0x8F92EAB1  // last 4 bytes of a seekable file
+
+typedef struct afc_zst_block_t {
+    afc_zst_t *zst;
+    struct afc_zst_block_t *next;       // in the pool queue
+    struct afc_zst_block_t *after;      // the next block of the same file
+    char *in;
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    int error;
+    bool done;
+} afc_zst_block_t;
+
+struct afc_zst_pool_t {
+    int count;
+    int level;
+    bool index;
+    pthread_t *threads;
+    pthread_mutex_t lock;       // the queue, every block's done/out and the totals
+    pthread_cond_t work;        // a block was queued or the pool is shutting down
+    pthread_cond_t done;        // a block was compressed, the files waiting on one check theirs
+    afc_zst_block_t *head;
+    afc_zst_block_t *tail;
+    bool shutdown;
+    uint64_t original;
+    uint64_t compressed;
+};
+
+struct afc_zst_t {
+    afc_zst_pool_t *pool;
+    int fd;
+    afc_zst_block_t *current;   // being filled
+    afc_zst_block_t *first;     // submitted and not written yet, in file order
+    afc_zst_block_t *last;
+    int inflight;
+    bool started;               // a block was submitted, an empty file still gets one frame
+    int error;
+    uint64_t original;
+    uint64_t compressed;
+    uint32_t *frames;           // compressed and original size of each frame, for the seek table
+    size_t frame_count;
+    size_t frame_cap;
+};
+
+static int afc_zst_cpus() {
+    int cpus = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0)
+        cpus = (int)online;
+#endif
+    return cpus;
+}
+
+int afc_zst_parse(const char *arg, int *level) {
+    if (strncmp(arg, "zstd", 4) != 0 || (arg[4] != '\0' && arg[4] != ':'))
+        return -1;
+    *level = ZSTD_CLEVEL_DEFAULT;
+    if (arg[4] == '\0')
+        return 0;
+
+    char *end = NULL;
+    long value = strtol(arg + 5, &end, 10);
+    if (end == arg + 5 || *end != '\0' || value < ZSTD_minCLevel() || value > ZSTD_maxCLevel() || value == 0)
+        return -1;
+    *level = (int)value;
+    return 0;
+}
+
+#pragma mark - pool
+
+static void *afc_zst_thread_main(void *arg) {
+    afc_zst_pool_t *pool = arg;
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+
+    // a checksum in every frame, zstd -d and zstd -t catch a damaged file
+    if (cctx) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, pool->level);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->shutdown)
+            pthread_cond_wait(&pool->work, &pool->lock);
+
+        if (!pool->head)
+            break;
+
+        afc_zst_block_t *block = pool->head;
+        pool->head = block->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        size_t bound = ZSTD_compressBound(block->in_len);
+        char *out = (cctx) ? malloc(bound) : NULL;
+        size_t out_len = 0;
+        int error = 0;
+        if (!out) {
+            error = ENOMEM;
+        } else {
+            out_len = ZSTD_compress2(cctx, out, bound, block->in, block->in_len);
+            if (ZSTD_isError(out_len)) {
+                fprintf(stderr, "Error: zstd: %s\n", ZSTD_getErrorName(out_len));
+                error = EIO;
+                free(out);
+                out = NULL;
+                out_len = 0;
+            }
+        }
+        free(block->in);
+        block->in = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        block->out = out;
+        block->out_len = out_len;
+        block->error = error;
+        block->done = true;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    ZSTD_freeCCtx(cctx);
+    return NULL;
+}
+
+afc_zst_pool_t *afc_zst_pool_new(int threads, int level, bool index) {
+    int i;
+
+    if (threads <= 0)
+        threads = afc_zst_cpus();
+    if (threads > AFC_ZST_MAX_THREADS)
+        threads = AFC_ZST_MAX_THREADS;
+
+    afc_zst_pool_t *pool = calloc(1, sizeof(afc_zst_pool_t));
+    if (!pool)
+        return NULL;
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pool->level = level;
+    pool->index = index;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[pool->count], NULL, afc_zst_thread_main, pool) == 0)
+            pool->count++;
+    }
+    if (pool->count == 0) {
+        afc_zst_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int afc_zst_pool_size(afc_zst_pool_t *pool) {
+    return pool->count;
+}
+
+void afc_zst_pool_totals(afc_zst_pool_t *pool, uint64_t *original, uint64_t *compressed) {
+    pthread_mutex_lock(&pool->lock);
+    *original = pool->original;
+    *compressed = pool->compressed;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void afc_zst_pool_free(afc_zst_pool_t *pool) {
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+#pragma mark - files
+
+afc_zst_t *afc_zst_open(afc_zst_pool_t *pool, int fd) {
+    afc_zst_t *zst = calloc(1, sizeof(afc_zst_t));
+    if (!zst)
+        return NULL;
+    zst->pool = pool;
+    zst->fd = fd;
+    return zst;
+}
+
+static int afc_zst_put(afc_zst_t *zst, const char *data, size_t length) {
+    while (length > 0) {
+#if defined(_WIN32)
+        ssize_t written = write(zst->fd, data, (unsigned int)length);
+#else
+        ssize_t written = write(zst->fd, data, length);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return EXIT_FAILURE;
+        }
+        if (written == 0) {
+            errno = EIO;
+            return EXIT_FAILURE;
+        }
+        data += written;
+        length -= written;
+        zst->compressed += written;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void afc_zst_frame(afc_zst_t *zst, uint32_t compressed, uint32_t original) {
+    if (zst->frame_count == zst->frame_cap) {
+        size_t cap = (zst->frame_cap) ? zst->frame_cap * 2 : 16;
+        uint32_t *grown = realloc(zst->frames, cap * 2 * sizeof(uint32_t));
+        if (!grown) {
+            zst->error = ENOMEM;
+            return;
+        }
+        zst->frames = grown;
+        zst->frame_cap = cap;
+    }
+    zst->frames[zst->frame_count * 2] = compressed;
+    zst->frames[zst->frame_count * 2 + 1] = original;
+    zst->frame_count++;
+}
+
+// writes out finished blocks from the front until at most limit are left in flight
+static void afc_zst_drain(afc_zst_t *zst, int limit) {
+    afc_zst_pool_t *pool = zst->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (zst->first && (zst->first->done || zst->inflight > limit)) {
+        if (!zst->first->done) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+            continue;
+        }
+        afc_zst_block_t *block = zst->first;
+        zst->first = block->after;
+        if (!zst->first)
+            zst->last = NULL;
+        zst->inflight--;
+        pthread_mutex_unlock(&pool->lock);
+
+        // nothing after a failed block is written, the frames have to stay in order
+        if (zst->error == 0 && block->error)
+            zst->error = block->error;
+        if (zst->error == 0) {
+            if (afc_zst_put(zst, block->out, block->out_len) == EXIT_SUCCESS) {
+                zst->original += block->in_len;
+                if (zst->pool->index)
+                    afc_zst_frame(zst, (uint32_t)block->out_len, (uint32_t)block->in_len);
+            } else {
+                zst->error = (errno) ? errno : EIO;
+            }
+        }
+        free(block->out);
+        free(block);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void afc_zst_submit(afc_zst_t *zst) {
+    afc_zst_pool_t *pool = zst->pool;
+    afc_zst_block_t *block = zst->current;
+
+    zst->current = NULL;
+    zst->started = true;
+
+    pthread_mutex_lock(&pool->lock);
+    if (zst->last)
+        zst->last->after = block;
+    else
+        zst->first = block;
+    zst->last = block;
+    zst->inflight++;
+
+    if (pool->tail)
+        pool->tail->next = block;
+    else
+        pool->head = block;
+    pool->tail = block;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    // one block per thread keeps them all busy on a single file, more would only hold memory
+    afc_zst_drain(zst, pool->count);
+}
+
+static int afc_zst_block_new(afc_zst_t *zst) {
+    zst->current = calloc(1, sizeof(afc_zst_block_t));
+    if (zst->current)
+        zst->current->in = malloc(AFC_ZST_BLOCK);
+    if (!zst->current || !zst->current->in) {
+        free(zst->current);
+        zst->current = NULL;
+        zst->error = ENOMEM;
+        return EXIT_FAILURE;
+    }
+    zst->current->zst = zst;
+    return EXIT_SUCCESS;
+}
+
+int afc_zst_write(afc_zst_t *zst, const char *data, size_t length) {
+    while (length > 0 && zst->error == 0) {
+        if (!zst->current && afc_zst_block_new(zst) != EXIT_SUCCESS)
+            break;
+
+        afc_zst_block_t *block = zst->current;
+        size_t take = AFC_ZST_BLOCK - block->in_len;
+        if (take > length)
+            take = length;
+        memcpy(block->in + block->in_len, data, take);
+        block->in_len += take;
+        data += take;
+        length -= take;
+
+        if (block->in_len == AFC_ZST_BLOCK)
+            afc_zst_submit(zst);
+    }
+
+    if (zst->error) {
+        errno = zst->error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void afc_zst_le32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+/*
+
+ the seek table of the zstd seekable format: a skippable frame holding the compressed and
+ original size of every frame, then the frame count, a descriptor byte (no checksums, the
+ frames carry their own) and the seekable magic number.
+
+ */
+
+static void afc_zst_seek_table(afc_zst_t *zst) {
+    size_t size = 8 + zst->frame_count * 8 + 9;
+    unsigned char *table = malloc(size);
+    size_t i, at = 0;
+
+    if (!table) {
+        zst->error = ENOMEM;
+        return;
+    }
+    afc_zst_le32(table + at, AFC_ZST_SKIPPABLE_MAGIC);
+    afc_zst_le32(table + at + 4, (uint32_t)(size - 8));
+    at += 8;
+    for (i = 0; i < zst->frame_count; i++, at += 8) {
+        afc_zst_le32(table + at, zst->frames[i * 2]);
+        afc_zst_le32(table + at + 4, zst->frames[i * 2 + 1]);
+    }
+    afc_zst_le32(table + at, (uint32_t)zst->frame_count);
+    table[at + 4] = 0;
+    afc_zst_le32(table + at + 5, AFC_ZST_SEEKABLE_MAGIC);
+
+    if (afc_zst_put(zst, (const char *)table, size) != EXIT_SUCCESS)
+        zst->error = (errno) ? errno : EIO;
+    free(table);
+}
+
+int afc_zst_finish(afc_zst_t *zst) {
+    afc_zst_pool_t *pool = zst->pool;
+
+    // an empty file is still one frame, a .zst of zero bytes is not something zstd -d takes
+    if (zst->error == 0 && (zst->current || !zst->started) && (zst->current || afc_zst_block_new(zst) == EXIT_SUCCESS))
+        afc_zst_submit(zst);
+    else if (zst->current) {
+        free(zst->current->in);
+        free(zst->current);
+        zst->current = NULL;
+    }
+    afc_zst_drain(zst, 0);
+
+    if (zst->error == 0 && pool->index)
+        afc_zst_seek_table(zst);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->original += zst->original;
+    pool->compressed += zst->compressed;
+    pthread_mutex_unlock(&pool->lock);
+
+    int error = zst->error;
+    free(zst->frames);
+    free(zst);
+    if (error) {
+        errno = error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#else
+
+// built without libzstd, main() turns --compress down before any of these is reached
+
+int afc_zst_parse(const char *arg, int *level) {
+    (void)arg;
+    (void)level;
+    errno = ENOSYS;
+    return -1;
+}
+
+afc_zst_pool_t *afc_zst_pool_new(int threads, int level, bool index) {
+    (void)threads;
+    (void)level;
+    (void)index;
+    errno = ENOSYS;
+    return NULL;
+}
+
+int afc_zst_pool_size(afc_zst_pool_t *pool) {
+    (void)pool;
+    return 0;
+}
+
+void afc_zst_pool_totals(afc_zst_pool_t *pool, uint64_t *original, uint64_t *compressed) {
+    (void)pool;
+    *original = 0;
+    *compressed = 0;
+}
+
+void afc_zst_pool_free(afc_zst_pool_t *pool) {
+    (void)pool;
+}
+
+afc_zst_t *afc_zst_open(afc_zst_pool_t *pool, int fd) {
+    (void)pool;
+    (void)fd;
+    errno = ENOSYS;
+    return NULL;
+}
+
+int afc_zst_write(afc_zst_t *zst, const char *data, size_t length) {
+    (void)zst;
+    (void)data;
+    (void)length;
+    errno = ENOSYS;
+    return EXIT_FAILURE;
+}
+
+int afc_zst_finish(afc_zst_t *zst) {
+    (void)zst;
+    errno = ENOSYS;
+    return EXIT_FAILURE;
+}
+
+#endif // HAVE_ZSTD
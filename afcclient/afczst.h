@@ -0,0 +1,70 @@
+/*
+ * afczst
+ *
+ * clone --compress=zstd[:level], files are written as <name>.zst while they
+ * arrive instead of being compressed in a second pass over the plain copy.
+ *
+ * the data of a file is cut into AFC_ZST_BLOCK blocks and every block becomes
+ * a zstd frame of its own, compressed by one of the threads of afc_zst_pool_t.
+ * the pool is shared by all files of a clone and sized apart from the afc
+ * connections (--compress-threads), so one large file is compressed on every
+ * core and many small ones keep the cores busy between them. frames are
+ * written out in order by whoever feeds the file, a file has at most one block
+ * per compression thread in flight. consecutive frames are a valid zstd
+ * stream, zstd -d and anything built on libzstd read the result as one file.
+ *
+ * with --compress-index a seek table in the zstd seekable format goes at the
+ * end, the compressed and original size of every frame. it is a skippable
+ * frame, plain decoders pass over it, while a reader that knows it can go to
+ * any offset of the original file and decompress just that frame.
+ *
+ * libzstd is optional, the Makefile defines HAVE_ZSTD when it finds zstd.h.
+ * without it every function here fails with ENOSYS and --compress is refused.
+ */
+
+#ifndef _afczst_h
+#define _afczst_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_ZST_BLOCK           (1024 * 1024)   // original bytes per frame
+#define AFC_ZST_MAX_THREADS     64
+#define AFC_ZST_SUFFIX          ".zst"
+
+typedef struct afc_zst_pool_t afc_zst_pool_t;
+typedef struct afc_zst_t afc_zst_t;
+
+// "zstd" or "zstd:<level>", level is 3 when left out
+int afc_zst_parse(const char *arg, int *level);
+
+// threads <= 0 means one per cpu. NULL when not even one thread could be started
+afc_zst_pool_t *afc_zst_pool_new(int threads, int level, bool index);
+
+int afc_zst_pool_size(afc_zst_pool_t *pool);
+
+// original and compressed bytes of every file finished so far
+void afc_zst_pool_totals(afc_zst_pool_t *pool, uint64_t *original, uint64_t *compressed);
+
+// every file has to be finished first
+void afc_zst_pool_free(afc_zst_pool_t *pool);
+
+// a compressed stream into fd, which is written to front to back from the current position
+afc_zst_t *afc_zst_open(afc_zst_pool_t *pool, int fd);
+
+// takes length bytes of the original, may block until a frame is compressed and written. errno is set on failure
+int afc_zst_write(afc_zst_t *zst, const char *data, size_t length);
+
+// compresses and writes what is left, then the seek table, and frees zst. errno is set on failure
+int afc_zst_finish(afc_zst_t *zst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _afczst_h
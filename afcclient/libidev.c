@@ -47,6 +47,7 @@
 bool idev_verbose=false;
 
 #include "libidev.h"
+#include "afcout.h"
 
 #include "plist/plist.h"
 
@@ -90,6 +91,33 @@ char * devices_to_xml(afc_idevice_info_t **devices, int itemCount) {
     return xmlData;
 }
 
+/**
+ 
+ same fields as devices_to_xml, one --format record per device
+ 
+ */
+
+void devices_to_records(afc_idevice_info_t **devices, int itemCount, afc_out_t *out) {
+    
+    int i;
+    for (i = 0; i < itemCount; i++) {
+        afc_idevice_info_t *currentDevice = devices[i];
+        afc_out_record_begin(out);
+        afc_out_string(out, "ProductType", currentDevice->productType);
+        afc_out_string(out, "ProductVersion", currentDevice->productVersion);
+        afc_out_string(out, "BuildVersion", currentDevice->buildVersion);
+        afc_out_string(out, "DeviceName", currentDevice->deviceName);
+        afc_out_string(out, "DeviceClass", currentDevice->deviceClass);
+        afc_out_string(out, "HardwareModel", currentDevice->hardwareModel);
+        afc_out_string(out, "HardwarePlatform", currentDevice->hardwarePlatform);
+        afc_out_string(out, "UniqueDeviceID", currentDevice->uniqueDeviceID);
+        afc_out_uint(out, "UniqueChipID", currentDevice->uniqueChipID);
+        afc_out_bool(out, "PasswordProtected", currentDevice->passwordProtected);
+        afc_out_record_end(out);
+        free(currentDevice);
+    }
+}
+
 /**
  
  creates an afc_idevice_info_t struct for a particular device based on its uuid
@@ -635,7 +663,34 @@ int idev_lockdownd_start_service (
  
  
 
-void idev_list_installed_apps(idevice_t idevice, bool filterSharing, bool xml) {
+// string value of key in an app's instproxy dict, NULL if missing. caller frees
+static char *idev_app_string(plist_t app_info, const char *key) {
+    char *val = NULL;
+    plist_t node = plist_dict_get_item(app_info, key);
+    if (node && plist_get_node_type(node) == PLIST_STRING)
+        plist_get_string_val(node, &val);
+    return val;
+}
+
+// one --format record per app, a fixed set of keys so every row has the same columns
+static void idev_app_record(plist_t app_info, afc_out_t *out) {
+    static const char *keys[] = { "CFBundleIdentifier", "CFBundleDisplayName", "ApplicationType", "CFBundleShortVersionString", "CFBundleVersion", "Path" };
+    size_t i;
+    uint8_t sharing = false;
+    
+    afc_out_record_begin(out);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        char *val = idev_app_string(app_info, keys[i]);
+        afc_out_string(out, keys[i], val);
+        if (val)
+            free(val);
+    }
+    plist_get_bool_val(plist_dict_get_item(app_info, "UIFileSharingEnabled"), &sharing);
+    afc_out_bool(out, "UIFileSharingEnabled", sharing);
+    afc_out_record_end(out);
+}
+
+void idev_list_installed_apps(idevice_t idevice, bool filterSharing, bool xml, afc_out_t *out) {
     int simple = 0;
     plist_t appList = plist_new_array();
     if (idevice == NULL) {
@@ -701,20 +756,13 @@ void idev_list_installed_apps(idevice_t idevice, bool filterSharing, bool xml) {
                      */
                     //fprintf(stderr, "Identifier: %s, Name: %s Path: %s\n", appid_str, name_str, path_str);
                     
-                    if (filterSharing == true && sharing == true && systemApp == false){
-                        if (xml){
-                            plist_array_append_item(appList, app_info);
-                        } else {
-                            fprintf(stderr, "%s : %s\n", name_str, appid_str);
-                        }
-                        
-                    } else if (filterSharing == false) {
-                        if (xml){
-                            
-                            plist_array_append_item(appList, app_info);
-                        } else {
-                            fprintf(stderr, "%s : %s\n", name_str, appid_str);
-                        }
+                    bool listed = (filterSharing == false || (sharing == true && systemApp == false));
+                    if (listed && out) {
+                        idev_app_record(app_info, out);
+                    } else if (listed && xml) {
+                        plist_array_append_item(appList, app_info);
+                    } else if (listed) {
+                        fprintf(stderr, "%s : %s\n", name_str, appid_str);
                     }
                     if (appid_str)
                         free(appid_str);
@@ -873,6 +921,144 @@ char * idev_get_app_path(idevice_t idevice, lockdownd_client_t lockd, const char
 
 #pragma mark - AFC helpers
 
+/*
+ 
+ the device and lockdown session of the afc client currently handed to a block, so more
+ connections to the same service (or the same app container) can be opened for worker threads.
+ only valid for the duration of the idev_afc_client_ex / idev_afc_app_client callback.
+ 
+ */
+
+static idevice_t session_idev = NULL;
+static lockdownd_client_t session_client = NULL;
+static char *session_service = NULL;
+static char *session_appid = NULL;
+
+// starts house_arrest, vends the app's Documents and hands back an afc client on top of it
+static int idev_house_arrest_afc_new(idevice_t idev, lockdownd_client_t client, char *appid, house_arrest_client_t *ha_out, afc_client_t *afc_out) {
+    int ret = EXIT_FAILURE;
+    
+    lockdownd_service_descriptor_t ldsvc=NULL;
+    lockdownd_error_t lret = lockdownd_start_service(client, HOUSE_ARREST_SERVICE_NAME, &ldsvc);
+    
+    if (lret == LOCKDOWN_E_SUCCESS && ldsvc) {
+        
+        house_arrest_client_t ha_client=NULL;
+        house_arrest_error_t ha_err = house_arrest_client_new(idev, ldsvc, &ha_client);
+        
+        if (ha_err == HOUSE_ARREST_E_SUCCESS && ha_client) {
+            
+            ha_err = house_arrest_send_command(ha_client, "VendDocuments", appid);
+            
+            if (ha_err == HOUSE_ARREST_E_SUCCESS) {
+                plist_t dict = NULL;
+                ha_err = house_arrest_get_result(ha_client, &dict);
+                
+                if (ha_err == HOUSE_ARREST_E_SUCCESS && dict) {
+                    plist_t errnode = plist_dict_get_item(dict, "Error");
+                    
+                    if (!errnode) {
+                        afc_client_t afc=NULL;
+                        afc_error_t afc_err = afc_client_new_from_house_arrest_client(ha_client, &afc);
+                        
+                        if (afc_err == AFC_E_SUCCESS && afc) {
+                            
+                            *afc_out = afc;
+                            *ha_out = ha_client;
+                            ha_client = NULL;
+                            ret = EXIT_SUCCESS;
+                            
+                        } else {
+                            fprintf(stderr, "Error: could not get afc client from house arrest: %s\n", idev_afc_strerror(afc_err));
+                        }
+                        
+                    } else {
+                        char *str = NULL;
+                        plist_get_string_val(errnode, &str);
+                        fprintf(stderr, "Error: house_arrest service responded: %s\n", str);
+                        if (strcmp("InstallationLookupFailed", str) == 0)
+                        {
+                            ret = 20;
+                        }
+                        if (str)
+                            free(str);
+                    }
+                } else {
+                    fprintf(stderr, "Error: Could not get result form house_arrest service: %s\n",
+                            idev_house_arrest_strerror(ha_err));
+                }
+                
+                if (dict)
+                    plist_free(dict);
+                
+            } else {
+                fprintf(stderr, "Error: Could not send VendContainer command with argument:%s - %s\n",
+                        appid, idev_house_arrest_strerror(ha_err));
+            }
+            
+        } else {
+            fprintf(stderr, "Error: Unable to create house arrest client: %s\n", idev_house_arrest_strerror(ha_err));
+        }
+        
+        if (ha_client)
+            house_arrest_client_free(ha_client);
+        
+    } else {
+        fprintf(stderr, "Error: unable to start service: %s - %s\n", HOUSE_ARREST_SERVICE_NAME, idev_lockdownd_strerror(lret));
+    }
+    
+    if (ldsvc)
+        lockdownd_service_descriptor_free(ldsvc);
+    
+    return ret;
+}
+
+int idev_afc_connection_open(idev_afc_connection_t *con) {
+    int ret = EXIT_FAILURE;
+    
+    con->afc = NULL;
+    con->ha = NULL;
+    
+    if (!session_idev || !session_client) {
+        fprintf(stderr, "Error: no active afc session to open another connection on\n");
+        return ret;
+    }
+    
+    if (session_appid) {
+        return idev_house_arrest_afc_new(session_idev, session_client, session_appid, &con->ha, &con->afc);
+    }
+    
+    lockdownd_service_descriptor_t ldsvc = NULL;
+    lockdownd_error_t ldret = lockdownd_start_service(session_client, session_service, &ldsvc);
+    
+    if ((ldret == LOCKDOWN_E_SUCCESS) && ldsvc) {
+        afc_error_t afc_err = afc_client_new(session_idev, ldsvc, &con->afc);
+        
+        if (afc_err == AFC_E_SUCCESS && con->afc) {
+            ret = EXIT_SUCCESS;
+        } else {
+            fprintf(stderr, "Error: unable to create afc client: %s\n", idev_afc_strerror(afc_err));
+            con->afc = NULL;
+        }
+    } else {
+        fprintf(stderr, "Error: could not start service: %s\n", session_service);
+    }
+    
+    if (ldsvc) lockdownd_service_descriptor_free(ldsvc);
+    
+    return ret;
+}
+
+void idev_afc_connection_close(idev_afc_connection_t *con) {
+    // house_arrest has to outlive the afc client riding on its connection
+    if (con->afc)
+        afc_client_free(con->afc);
+    if (con->ha)
+        house_arrest_client_free(con->ha);
+    con->afc = NULL;
+    con->ha = NULL;
+}
+
 int idev_afc_client_ex(
                        char *clientname,
                        char *udid,
@@ -891,8 +1077,16 @@ int idev_afc_client_ex(
         
         if (afc_err == AFC_E_SUCCESS && afc) {
             
+            session_idev = idev;
+            session_client = client;
+            session_service = afc_servicename;
+            
             ret = block(idev, client, ldsvc, afc);
             
+            session_idev = NULL;
+            session_client = NULL;
+            session_service = NULL;
+            
         } else {
             fprintf(stderr, "Error: unable to create afc client: %s\n", idev_afc_strerror(afc_err));
         }
@@ -918,75 +1112,25 @@ int idev_afc_client(char *clientname, char *udid, bool root, int(^block)(afc_cli
 int idev_afc_app_client(char *clientname, char *udid, char *appid, int(^block)(afc_client_t afc))
 {
     return idev_lockdownd_client(clientname, udid, ^int(idevice_t idev, lockdownd_client_t client) {
-        int ret = EXIT_FAILURE;
+        house_arrest_client_t ha_client = NULL;
+        afc_client_t afc = NULL;
         
-        lockdownd_service_descriptor_t ldsvc=NULL;
-        lockdownd_error_t lret = lockdownd_start_service(client, HOUSE_ARREST_SERVICE_NAME, &ldsvc);
+        int ret = idev_house_arrest_afc_new(idev, client, appid, &ha_client, &afc);
         
-        if (lret == LOCKDOWN_E_SUCCESS && ldsvc) {
+        if (ret == EXIT_SUCCESS) {
             
-            house_arrest_client_t ha_client=NULL;
-            house_arrest_error_t ha_err = house_arrest_client_new(idev, ldsvc, &ha_client);
+            session_idev = idev;
+            session_client = client;
+            session_appid = appid;
             
-            if (ha_err == HOUSE_ARREST_E_SUCCESS && ha_client) {
-                
-                ha_err = house_arrest_send_command(ha_client, "VendDocuments", appid);
-                
-                if (ha_err == HOUSE_ARREST_E_SUCCESS) {
-                    plist_t dict = NULL;
-                    ha_err = house_arrest_get_result(ha_client, &dict);
-                    
-                    if (ha_err == HOUSE_ARREST_E_SUCCESS && dict) {
-                        plist_t errnode = plist_dict_get_item(dict, "Error");
-                        
-                        if (!errnode) {
-                            afc_client_t afc=NULL;
-                            afc_error_t afc_err = afc_client_new_from_house_arrest_client(ha_client, &afc);
-                            
-                            if (afc_err == AFC_E_SUCCESS && afc) {
-                                
-                                ret = block(afc);
-                                
-                            } else {
-                                fprintf(stderr, "Error: could not get afc client from house arrest: %s\n", idev_afc_strerror(afc_err));
-                            }
-                            
-                            if (afc)
-                                afc_client_free(afc);
-                            
-                        } else {
-                            char *str = NULL;
-                            plist_get_string_val(errnode, &str);
-                            fprintf(stderr, "Error: house_arrest service responded: %s\n", str);
-                            if (strcmp("InstallationLookupFailed", str) == 0)
-                            {
-                                ret = 20;
-                            }
-                            if (str)
-                                free(str);
-                        }
-                    } else {
-                        fprintf(stderr, "Error: Could not get result form house_arrest service: %s\n",
-                                idev_house_arrest_strerror(ha_err));
-                    }
-                    
-                    if (dict)
-                        plist_free(dict);
-                    
-                } else {
-                    fprintf(stderr, "Error: Could not send VendContainer command with argument:%s - %s\n",
-                            appid, idev_house_arrest_strerror(ha_err));
-                }
-                
-            } else {
-                fprintf(stderr, "Error: Unable to create house arrest client: %s\n", idev_house_arrest_strerror(ha_err));
-            }
+            ret = block(afc);
             
-            if (ha_client)
-                house_arrest_client_free(ha_client);
+            session_idev = NULL;
+            session_client = NULL;
+            session_appid = NULL;
             
-        } else {
-            fprintf(stderr, "Error: unable to start service: %s - %s\n", HOUSE_ARREST_SERVICE_NAME, idev_lockdownd_strerror(lret));
+            afc_client_free(afc);
+            house_arrest_client_free(ha_client);
         }
         
         return ret;
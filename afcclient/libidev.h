@@ -15,6 +15,7 @@
 #include <stdbool.h>
 
 #include "afcclient.h"
+#include "afcout.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,6 +49,7 @@ typedef struct afc_idevice_info_t {
 
 LIBGMMD_EXPORT char * get_deviceid_from_type(char *deviceType);
 LIBGMMD_EXPORT char * devices_to_xml(afc_idevice_info_t **devices, int itemCount);
+LIBGMMD_EXPORT void devices_to_records(afc_idevice_info_t **devices, int itemCount, afc_out_t *out);
 LIBGMMD_EXPORT afc_idevice_info_t ** get_attached_devices(int *deviceCount);
 LIBGMMD_EXPORT int print_device_xml();
 LIBGMMD_EXPORT int print_device_info();
@@ -68,7 +70,8 @@ const char *idev_afc_strerror(afc_error_t errnum);
 
 char * idev_get_app_path(idevice_t idevice, lockdownd_client_t lockd, const char *app);
 
-void idev_list_installed_apps(idevice_t idevice, bool filterSharing, bool xml);
+// out is NULL for the text / -x output, otherwise one --format record per app
+void idev_list_installed_apps(idevice_t idevice, bool filterSharing, bool xml, afc_out_t *out);
 
 int idev_lockdownd_client (
         char *clientname,
@@ -114,6 +117,20 @@ int idev_afc_app_client(
         int(^block)(afc_client_t afc) );
 
     
+    
+typedef struct idev_afc_connection_t {
+    afc_client_t afc;
+    house_arrest_client_t ha;   // only set for app containers, keeps the vended connection alive
+} idev_afc_connection_t;
+
+// opens another connection to the afc service (or app container) of the running
+// idev_afc_client_ex / idev_afc_app_client block, on the same lockdown session.
+// not thread safe, open every connection before handing them to worker threads.
+int idev_afc_connection_open(idev_afc_connection_t *con);
+
+void idev_afc_connection_close(idev_afc_connection_t *con);
+
+    
 #ifdef __cplusplus
 }
 #endif
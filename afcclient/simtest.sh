@@ -0,0 +1,226 @@
+#!/bin/sh
+#
+# simtest.sh, byte-exactness check for afcclient-sim (make simtest)
+#
+# builds a fixture tree with random data, then clones, gets, puts and resumes it
+# through the simulator, incrementally, into a store, compressed, verified and as a
+# tar stream, and compares every result with cmp/diff. AFCSIM_LATENCY_US and the
+# other AFCSIM_* settings are passed through, so the same runs can be timed:
+#
+#   AFCSIM_LATENCY_US=1000 ./simtest.sh ./afcclient-sim
+#
+# the exit status of afcclient isn't relied on, every step is judged by the bytes
+# it left behind. the output of all runs is in the log printed on failure.
+#
+
+BIN=${1:-./afcclient-sim}
+case "$BIN" in
+    /*) ;;
+    *) BIN="$(pwd)/$BIN" ;;
+esac
+if [ ! -x "$BIN" ]; then
+    echo "simtest: $BIN not found, run make sim first" >&2
+    exit 2
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/afcsim.XXXXXX") || exit 2
+trap 'rm -rf "$WORK"' EXIT
+ROOT="$WORK/root"
+LOG="$WORK/log"
+failed=0
+unset AFCSIM_SINGLE_WRITER     # the segmented runs need more than one writer, it has a step of its own
+
+pass() { echo "ok   $1"; }
+fail() { echo "FAIL $1"; failed=$((failed + 1)); }
+check() {
+    name=$1
+    shift
+    if "$@" >/dev/null 2>&1; then pass "$name"; else fail "$name"; fi
+}
+sim() {
+    echo "+ afcclient $*" >>"$LOG"
+    AFCSIM_ROOT="$ROOT" "$BIN" -q "$@" >>"$LOG" 2>&1
+}
+random() {
+    head -c "$2" /dev/urandom >"$1"
+}
+# st_mtime in nanoseconds as the simulated device reports it, for hand made .afcpart files
+remote_mtime() {
+    AFCSIM_ROOT="$ROOT" "$BIN" --format=tsv info "$1" 2>/dev/null | awk -F '\t' 'NR == 2 { print $6 }'
+}
+afcpart() {
+    printf 'afcpart 1\nst_size %s\nst_mtime %s\n' "$2" "$(remote_mtime "$3")" >"$1.afcpart"
+}
+# whether the runs since log line $1 printed a line matching $2
+logged() {
+    tail -n +$(($1 + 1)) "$LOG" | grep -q "$2"
+}
+# whether they moved data in ranges over several connections (needs -v)
+segmented() {
+    logged "$1" '^\[debug\] range'
+}
+same_file() {
+    [ "$(ls -di "$1" | awk '{ print $1 }')" = "$(ls -di "$2" | awk '{ print $1 }')" ]
+}
+sha256() {
+    if command -v sha256sum >/dev/null 2>&1; then sha256sum <"$1"; else shasum -a 256 <"$1"; fi | awk '{ print $1 }'
+}
+
+# fixture: empty, tiny, exactly one single read, just over it, and large. the one file above
+# AFC_SEGMENT_MIN_FILE (64 MiB) is kept out of the clone fixture to keep that quick
+mkdir -p "$ROOT/Documents/sub/deeper" "$ROOT/Documents/with space" "$ROOT/Documents/emptydir"
+: >"$ROOT/Documents/empty"
+random "$ROOT/Documents/one" 1
+random "$ROOT/Documents/small.bin" 5000
+random "$ROOT/Documents/sub/exact.bin" 1048576
+random "$ROOT/Documents/sub/over.bin" 1048577
+random "$ROOT/Documents/with space/name.txt" 777
+random "$ROOT/Documents/sub/deeper/big.bin" 12582917
+i=0
+while [ $i -lt 40 ]; do
+    random "$ROOT/Documents/sub/f$i" $((i * 131))
+    i=$((i + 1))
+done
+BIG="Documents/sub/deeper/big.bin"
+random "$ROOT/huge.bin" 67121209
+HUGE="huge.bin"
+
+# clone, serial and over a worker pool
+sim clone Documents "$WORK/clone1"
+check "clone" diff -r "$ROOT/Documents" "$WORK/clone1/Documents"
+sim -j 4 clone Documents "$WORK/clone4"
+check "clone -j 4" diff -r "$ROOT/Documents" "$WORK/clone4/Documents"
+
+# get, one request, adaptive, and segmented over several connections
+sim get Documents/small.bin "$WORK/small.bin"
+check "get small" cmp "$ROOT/Documents/small.bin" "$WORK/small.bin"
+sim get "$BIG" "$WORK/big1.bin"
+check "get large" cmp "$ROOT/$BIG" "$WORK/big1.bin"
+sim -j 4 get "$BIG" "$WORK/big4.bin"
+check "get -j 4, below the segment size" cmp "$ROOT/$BIG" "$WORK/big4.bin"
+sim --chunk-size=64k get "$BIG" "$WORK/big64k.bin"
+check "get --chunk-size=64k" cmp "$ROOT/$BIG" "$WORK/big64k.bin"
+mark=$(wc -l <"$LOG")
+sim -v -j 4 get "$HUGE" "$WORK/huge4.bin"
+check "get -j 4 segmented" cmp "$ROOT/$HUGE" "$WORK/huge4.bin"
+check "get -j 4 went over ranges" segmented "$mark"
+
+# put, a file and a whole folder
+random "$WORK/up.bin" 3000001
+sim put "$WORK/up.bin" up.bin
+check "put" cmp "$WORK/up.bin" "$ROOT/up.bin"
+sim -j 4 put "$WORK/up.bin" up4.bin
+check "put -j 4, below the segment size" cmp "$WORK/up.bin" "$ROOT/up4.bin"
+sim -j 4 put -R "$WORK/clone1/Documents" tree
+check "put -R -j 4" diff -r "$WORK/clone1/Documents" "$ROOT/tree"
+mark=$(wc -l <"$LOG")
+sim -v -j 4 put "$WORK/huge4.bin" huge4.bin
+check "put -j 4 segmented" cmp "$WORK/huge4.bin" "$ROOT/huge4.bin"
+check "put -j 4 went over ranges" segmented "$mark"
+
+# a device that takes one writer per file, the segmented upload falls back to one connection
+export AFCSIM_SINGLE_WRITER=1
+sim -j 4 put "$WORK/huge4.bin" single.bin
+unset AFCSIM_SINGLE_WRITER
+check "put -j 4, single writer" cmp "$WORK/huge4.bin" "$ROOT/single.bin"
+check "put -j 4, single writer fallback" grep -q "takes only one writer on single.bin" "$LOG"
+
+# get --resume from a partial file, with the rest well above one single read
+head -c 4194304 "$ROOT/$BIG" >"$WORK/resume.bin"
+afcpart "$WORK/resume.bin" 12582917 "$BIG"
+sim --resume get "$BIG" "$WORK/resume.bin"
+check "get --resume" cmp "$ROOT/$BIG" "$WORK/resume.bin"
+check "get --resume clears .afcpart" test ! -e "$WORK/resume.bin.afcpart"
+
+# and with less than one single read left, so the tail is read in one request from the middle
+head -c 12000000 "$ROOT/$BIG" >"$WORK/tail.bin"
+afcpart "$WORK/tail.bin" 12582917 "$BIG"
+sim --resume get "$BIG" "$WORK/tail.bin"
+check "get --resume, short tail" cmp "$ROOT/$BIG" "$WORK/tail.bin"
+
+# put --resume on top of what an earlier upload left
+head -c 1000000 "$WORK/up.bin" >"$ROOT/upr.bin"
+sim --resume put "$WORK/up.bin" upr.bin
+check "put --resume" cmp "$WORK/up.bin" "$ROOT/upr.bin"
+head -c 2500000 "$WORK/up.bin" >"$ROOT/uptail.bin"
+sim --resume put "$WORK/up.bin" uptail.bin
+check "put --resume, short tail" cmp "$WORK/up.bin" "$ROOT/uptail.bin"
+
+# --incremental, after a file was added, one deleted and one became a folder between two runs
+mkdir -p "$ROOT/inc"
+random "$ROOT/inc/turns" 3000
+random "$ROOT/inc/stays" 2000
+random "$ROOT/inc/goes" 1000
+sim --incremental clone inc "$WORK/inc"
+check "clone --incremental" diff -r "$ROOT/inc" "$WORK/inc/inc"
+random "$ROOT/inc/added" 4000
+rm -f "$ROOT/inc/goes" "$ROOT/inc/turns"
+mkdir "$ROOT/inc/turns"
+random "$ROOT/inc/turns/inside" 1500
+mark=$(wc -l <"$LOG")
+sim --incremental -j 4 clone inc "$WORK/inc"
+check "clone --incremental, add, delete and file to folder" diff -r "$ROOT/inc" "$WORK/inc/inc"
+check "clone --incremental, counts" logged "$mark" "2 copied, 1 skipped, 2 deleted, 0 failed"
+
+# --store and --link-dest, unchanged files end up as hardlinks instead of copies
+sim --store="$WORK/store" clone Documents "$WORK/store1"
+sim --store="$WORK/store" -j 4 clone Documents "$WORK/store2"
+check "clone --store" diff -r "$ROOT/Documents" "$WORK/store2/Documents"
+check "clone --store shares files" same_file "$WORK/store1/$BIG" "$WORK/store2/$BIG"
+sim --incremental clone Documents "$WORK/ld1"
+sim --link-dest="$WORK/ld1" -j 4 clone Documents "$WORK/ld2"
+check "clone --link-dest" diff -r "$ROOT/Documents" "$WORK/ld2/Documents"
+check "clone --link-dest shares files" same_file "$WORK/ld1/$BIG" "$WORK/ld2/$BIG"
+
+# --compress, every file as <file>.zst
+mark=$(wc -l <"$LOG")
+sim --compress=zstd -j 4 clone Documents "$WORK/zst"
+if logged "$mark" "built without it"; then
+    echo "skip clone --compress, afcclient is built without libzstd"
+elif ! command -v zstd >/dev/null 2>&1; then
+    echo "skip clone --compress, no zstd to check it with"
+else
+    zstd -qdc "$WORK/zst/$BIG.zst" >"$WORK/big.unzst" 2>/dev/null
+    check "clone --compress" cmp "$ROOT/$BIG" "$WORK/big.unzst"
+    zstd -qdc "$WORK/zst/Documents/with space/name.txt.zst" >"$WORK/name.unzst" 2>/dev/null
+    check "clone --compress, small file" cmp "$ROOT/Documents/with space/name.txt" "$WORK/name.unzst"
+fi
+
+# sum and --verify, against a digest taken locally
+mark=$(wc -l <"$LOG")
+sim --hash=sha256 sum Documents/small.bin
+check "sum" logged "$mark" "^$(sha256 "$ROOT/Documents/small.bin")  Documents/small.bin$"
+mark=$(wc -l <"$LOG")
+sim --hash=sha256 -j 4 sum Documents
+check "sum -j 4 of a folder" logged "$mark" "^$(sha256 "$ROOT/Documents/with space/name.txt")  Documents/with space/name.txt$"
+mark=$(wc -l <"$LOG")
+sim --verify get "$BIG" "$WORK/verify.bin"
+check "get --verify" logged "$mark" "^Verified $WORK/verify.bin"
+mark=$(wc -l <"$LOG")
+sim --verify -j 4 put "$WORK/huge4.bin" verify.bin
+check "put --verify" logged "$mark" "^Verified verify.bin"
+
+# clone --tar and put --tar back, with symlinks. a hardlink only comes from tar(1), clone --tar
+# writes every file in full
+mkdir -p "$ROOT/tarsrc/sub"
+random "$ROOT/tarsrc/a" 3000
+random "$ROOT/tarsrc/sub/b" 2000000
+ln -s sub/b "$ROOT/tarsrc/tofile"
+ln -s sub "$ROOT/tarsrc/todir"
+ln "$ROOT/tarsrc/a" "$ROOT/tarsrc/hard"
+sim --tar="$WORK/clone.tar" -j 4 clone tarsrc
+sim --tar="$WORK/clone.tar" put back
+check "clone --tar, put --tar" diff -r "$ROOT/tarsrc" "$ROOT/back/tarsrc"
+check "put --tar, symlink to a file" test "$(readlink "$ROOT/back/tarsrc/tofile")" = sub/b
+check "put --tar, symlink to a folder" test "$(readlink "$ROOT/back/tarsrc/todir")" = sub
+(cd "$ROOT" && tar -cf "$WORK/local.tar" tarsrc)
+sim --tar="$WORK/local.tar" -j 4 put hback
+check "put --tar of tar(1)" diff -r "$ROOT/tarsrc" "$ROOT/hback/tarsrc"
+check "put --tar, hardlink" same_file "$ROOT/hback/tarsrc/a" "$ROOT/hback/tarsrc/hard"
+
+if [ $failed -ne 0 ]; then
+    echo "simtest: $failed failed, log:"
+    cat "$LOG"
+    exit 1
+fi
+echo "simtest: all passed"